@@ -3,16 +3,34 @@
 #include <xxhash.h>
 #include <iostream>
 #include "types.h"
+#include "hash_policy.h"
 
 #pragma pack(push,1)
 struct Bucket {
   vec_t alpha;
   vec_hash_t gamma;
 };
+
+// A Bucket of a vector whose indices all fit in 32 bits. Two thirds the size of a Bucket
+struct NarrowBucket {
+  uint32_t alpha;
+  vec_hash_t gamma;
+};
 #pragma pack(pop)
 
 namespace Bucket_Boruvka {
   static constexpr size_t col_hash_bits = sizeof(col_hash_t) * 8;
+
+  /**
+   * XXH3_64bits_withSeed() of a single index (see XXH3Hash). Spelled out so that it is always
+   * inlined into the update loops: once the hash is called out of line on the address of the
+   * index GCC 12 may drop the store of the index before the call.
+   * @param index  Vector index to hash
+   * @param seed   The seed of the hash
+   * @return       The same value as XXH3_64bits_withSeed(&index, sizeof(vec_t), seed).
+   */
+  inline static uint64_t xxh3_index(const vec_t index, const uint64_t seed);
+
   /**
    * Hashes the column index and the update index together to determine the depth of an update
    * This is used as a parameter to Bucket::contains.
@@ -24,6 +42,44 @@ namespace Bucket_Boruvka {
   inline static col_hash_t get_index_depth(const vec_t update_idx, const long seed_and_col,
    const vec_hash_t max_depth);
 
+  // get_index_depth() under the cached key of the column's seed
+  inline static col_hash_t get_index_depth(const vec_t update_idx,
+                                           const SketchHash::Key &column_key,
+                                           const vec_hash_t max_depth);
+
+  // a single 64 bit hash gives the depths of depth_slice_columns columns, one slice each
+  static constexpr size_t depth_slice_bits = 8;
+  static constexpr size_t depth_slice_columns = 64 / depth_slice_bits;
+
+  /**
+   * The depth of an update in one of the columns sharing a sliced hash: the number of trailing
+   * zeros of the column's slice. If the slice is all zero the depth continues past
+   * depth_slice_bits with a hash of the column's own, so that the depths follow the same
+   * distribution as those of get_index_depth.
+   * @param update_idx   Vector index to update
+   * @param slice_hash   Hash of update_idx shared by the columns
+   * @param slice        Position of the column among the columns sharing slice_hash
+   * @param column_key   Key of the column, for depths of at least depth_slice_bits
+   * @param max_depth    The maximum depth to return
+   * @return             The depth of the update in the column.
+   */
+  inline static col_hash_t get_sliced_depth(const vec_t update_idx, const uint64_t slice_hash,
+                                            const size_t slice,
+                                            const SketchHash::Key &column_key,
+                                            const vec_hash_t max_depth);
+
+  /**
+   * get_sliced_depth of every column sharing a sliced hash at once.
+   * @param update_idx   Vector index to update
+   * @param slice_hash   Hash of update_idx shared by the columns
+   * @param column_keys  Keys of the depth_slice_columns columns, in slice order
+   * @param max_depth    The maximum depth to return
+   * @return             The depths of the update, packed one per byte in slice order.
+   */
+  inline static uint64_t get_sliced_depths(const vec_t update_idx, const uint64_t slice_hash,
+                                           const SketchHash::Key *column_keys,
+                                           const vec_hash_t max_depth);
+
   /**
    * Hashes the index for checksumming
    * This is used to as a parameter to Bucket::update
@@ -33,6 +89,10 @@ namespace Bucket_Boruvka {
    */
   inline static vec_hash_t get_index_hash(const vec_t index, const long sketch_seed);
 
+  // get_index_hash() under the cached key of the sketch's checksum seed. Checksums are always
+  // XXH3Hash, whatever the hash policy of the depths
+  inline static vec_hash_t get_index_hash(const vec_t index, const XXH3Hash::Key &checksum_key);
+
   /**
    * Checks whether a Bucket is good, assuming the Bucket contains all elements.
    * @param bucket       The bucket to check
@@ -40,6 +100,7 @@ namespace Bucket_Boruvka {
    * @return             true if this Bucket is good, else false.
    */
   inline static bool is_good(const Bucket &bucket, const long sketch_seed);
+  inline static bool is_good(const Bucket &bucket, const XXH3Hash::Key &checksum_key);
 
   /**
    * Updates a Bucket with the given update index
@@ -49,25 +110,228 @@ namespace Bucket_Boruvka {
    */
   inline static void update(Bucket& bucket, const vec_t update_idx,
                             const vec_hash_t update_hash);
+
+  /**
+   * The multi-lane hash kernels below compute exactly the same values as get_index_depth and
+   * get_index_hash but hash 4 (AVX2) or 8 (AVX-512) indices per instruction stream. The best
+   * kernel the CPU supports is selected at startup. They implement XXH3Hash only: with other
+   * hash policies the multi-lane depth functions hash one index at a time.
+   */
+  enum HashKernel {
+    SCALAR_HASH,
+    AVX2_HASH,
+    AVX512_HASH,
+  };
+
+  /**
+   * @return  true if the CPU we are running on supports the given kernel.
+   */
+  bool hash_kernel_supported(HashKernel kernel);
+
+  /**
+   * Override the kernel selected at startup. Mostly useful for testing and benchmarking.
+   * @return  false (and leaves the kernel unchanged) if the kernel is not supported.
+   */
+  bool set_hash_kernel(HashKernel kernel);
+
+  HashKernel get_hash_kernel();
+
+  /**
+   * Multi-lane get_index_depth for a single update index under many column seeds.
+   * The seeds are first_seed, first_seed + seed_stride, first_seed + 2 * seed_stride, ...
+   * @param update_idx   Vector index to update
+   * @param first_seed   Seed of the first column
+   * @param seed_stride  Difference between the seeds of consecutive columns
+   * @param num_seeds    Number of columns to hash
+   * @param max_depth    The maximum depth to return
+   * @param depths       [out] The depth of the update in each column
+   */
+  inline void get_index_depths(const vec_t update_idx, const uint64_t first_seed,
+                        const uint64_t seed_stride, const size_t num_seeds,
+                        const vec_hash_t max_depth, col_hash_t *depths);
+
+  /**
+   * Multi-lane get_index_depth for many update indices under a single column seed.
+   * @param update_idxs   Vector indices to update
+   * @param num_idxs      Number of indices
+   * @param seed_and_col  Combination of seed and column
+   * @param max_depth     The maximum depth to return
+   * @param depths        [out] The depth of each update
+   */
+  inline void get_batch_depths(const vec_t *update_idxs, const size_t num_idxs,
+                        const uint64_t seed_and_col, const vec_hash_t max_depth,
+                        col_hash_t *depths);
+
+  /**
+   * Multi-lane get_index_hash for many indices.
+   * @param idxs         Vector indices to hash
+   * @param num_idxs     Number of indices
+   * @param sketch_seed  The seed of the Sketch these indices belong to
+   * @param hashes       [out] The checksum of each index
+   */
+  inline void get_batch_hashes(const vec_t *idxs, const size_t num_idxs, const uint64_t sketch_seed,
+                        vec_hash_t *hashes);
+
+  /**
+   * Kernels for merging and zeroing bucket memory. Since merging two sketches XORs their buckets
+   * field by field, it is equivalent to XORing the raw bytes of the bucket arrays. As with the
+   * hash kernels, the best kernel the CPU supports is selected at startup.
+   */
+  enum MergeKernel {
+    SCALAR_MERGE,
+    AVX2_MERGE,
+    AVX512_MERGE,
+  };
+
+  /**
+   * @return  true if the CPU we are running on supports the given kernel.
+   */
+  bool merge_kernel_supported(MergeKernel kernel);
+
+  /**
+   * Override the kernel selected at startup. Mostly useful for testing and benchmarking.
+   * @return  false (and leaves the kernel unchanged) if the kernel is not supported.
+   */
+  bool set_merge_kernel(MergeKernel kernel);
+
+  MergeKernel get_merge_kernel();
+
+  /**
+   * XOR bytes of bucket memory from src into dst. The ranges must not overlap.
+   * @param dst    Bucket memory to merge into
+   * @param src    Bucket memory to merge
+   * @param bytes  Number of bytes to merge
+   */
+  void xor_bucket_memory(void *dst, const void *src, size_t bytes);
+
+  /**
+   * Zero bytes of bucket memory. Ranges of at least nontemporal_zero_bytes are written with
+   * non-temporal stores so zeroing a large sketch does not evict the rest of the cache.
+   * @param dst    Bucket memory to zero
+   * @param bytes  Number of bytes to zero
+   */
+  void zero_bucket_memory(void *dst, size_t bytes);
+
+  // Smaller ranges (such as the delta sketches zeroed before every batch) are about to be
+  // written again, so they are better off staying in cache.
+  static constexpr size_t nontemporal_zero_bytes = 16 << 20;
+
+  // below this many lanes the kernel call costs more than the scalar hashes it replaces
+  static constexpr size_t min_kernel_lanes = 4;
+
+  // out of line entry points of the selected kernel (see src/bucket.cpp)
+  void get_index_depths_kernel(const vec_t update_idx, const uint64_t first_seed,
+                               const uint64_t seed_stride, const size_t num_seeds,
+                               const vec_hash_t max_depth, col_hash_t *depths);
+  void get_batch_depths_kernel(const vec_t *update_idxs, const size_t num_idxs,
+                               const uint64_t seed_and_col, const vec_hash_t max_depth,
+                               col_hash_t *depths);
+  void get_batch_hashes_kernel(const vec_t *idxs, const size_t num_idxs,
+                               const uint64_t sketch_seed, vec_hash_t *hashes);
 } // namespace Bucket_Boruvka
 
+inline uint64_t Bucket_Boruvka::xxh3_index(const vec_t index, const uint64_t seed) {
+  return XXH3Hash::hash(index, XXH3Hash::make_key(seed));
+}
+
 inline col_hash_t Bucket_Boruvka::get_index_depth(const vec_t update_idx, const long seed_and_col,
                                                   const vec_hash_t max_depth) {
-  col_hash_t depth_hash = col_hash(&update_idx, sizeof(vec_t), seed_and_col);
+  return get_index_depth(update_idx, SketchHash::make_key(seed_and_col), max_depth);
+}
+
+inline col_hash_t Bucket_Boruvka::get_index_depth(const vec_t update_idx,
+                                                  const SketchHash::Key &column_key,
+                                                  const vec_hash_t max_depth) {
+  col_hash_t depth_hash = SketchHash::hash(update_idx, column_key);
   depth_hash |= (1ull << max_depth); // assert not > max_depth by ORing
   return __builtin_ctzll(depth_hash);
 }
 
+inline col_hash_t Bucket_Boruvka::get_sliced_depth(const vec_t update_idx,
+                                                   const uint64_t slice_hash, const size_t slice,
+                                                   const SketchHash::Key &column_key,
+                                                   const vec_hash_t max_depth) {
+  uint64_t bits = (slice_hash >> (slice * depth_slice_bits)) & ((1 << depth_slice_bits) - 1);
+  if (max_depth <= depth_slice_bits) return __builtin_ctzll(bits | (1ull << max_depth));
+  if (bits != 0) return __builtin_ctzll(bits);
+  return depth_slice_bits + get_index_depth(update_idx, column_key, max_depth - depth_slice_bits);
+}
+
+inline uint64_t Bucket_Boruvka::get_sliced_depths(const vec_t update_idx,
+                                                  const uint64_t slice_hash,
+                                                  const SketchHash::Key *column_keys,
+                                                  const vec_hash_t max_depth) {
+  static_assert(depth_slice_bits == 8, "the depths are counted a byte at a time");
+  constexpr uint64_t ones = 0x0101010101010101ULL;
+  uint64_t below_lowest = (slice_hash - ones) & ~slice_hash;  // exact if no byte is zero
+  if (max_depth <= depth_slice_bits || (below_lowest & (ones << 7)) != 0) {
+    // a depth is capped or continues past its slice
+    uint64_t depths = 0;
+    for (size_t slice = 0; slice < depth_slice_columns; slice++) {
+      uint64_t depth = get_sliced_depth(update_idx, slice_hash, slice, column_keys[slice],
+                                        max_depth);
+      depths |= depth << (slice * depth_slice_bits);
+    }
+    return depths;
+  }
+  // count the bits below the lowest set bit of every byte
+  constexpr uint64_t pairs = 0x5555555555555555ULL;
+  constexpr uint64_t nibbles = 0x3333333333333333ULL;
+  uint64_t count = below_lowest - ((below_lowest >> 1) & pairs);
+  count = (count & nibbles) + ((count >> 2) & nibbles);
+  return (count + (count >> 4)) & (ones * 0x0F);
+}
+
 inline vec_hash_t Bucket_Boruvka::get_index_hash(const vec_t update_idx, const long sketch_seed) {
-  return vec_hash(&update_idx, sizeof(vec_t), sketch_seed);
+  return xxh3_index(update_idx, sketch_seed);
+}
+
+inline vec_hash_t Bucket_Boruvka::get_index_hash(const vec_t update_idx,
+                                                 const XXH3Hash::Key &checksum_key) {
+  return XXH3Hash::hash(update_idx, checksum_key);
 }
 
 inline bool Bucket_Boruvka::is_good(const Bucket &bucket, const long sketch_seed) {
   return bucket.gamma == get_index_hash(bucket.alpha, sketch_seed);
 }
 
+inline bool Bucket_Boruvka::is_good(const Bucket &bucket, const XXH3Hash::Key &checksum_key) {
+  return bucket.gamma == get_index_hash(bucket.alpha, checksum_key);
+}
+
 inline void Bucket_Boruvka::update(Bucket& bucket, const vec_t update_idx,
                                    const vec_hash_t update_hash) {
   bucket.alpha ^= update_idx;
   bucket.gamma ^= update_hash;
 }
+
+inline void Bucket_Boruvka::get_index_depths(const vec_t update_idx, const uint64_t first_seed,
+                                             const uint64_t seed_stride, const size_t num_seeds,
+                                             const vec_hash_t max_depth, col_hash_t *depths) {
+  if (!SketchHash::has_hash_kernels || num_seeds < min_kernel_lanes) {
+    for (size_t i = 0; i < num_seeds; i++)
+      depths[i] = get_index_depth(update_idx, first_seed + i * seed_stride, max_depth);
+    return;
+  }
+  get_index_depths_kernel(update_idx, first_seed, seed_stride, num_seeds, max_depth, depths);
+}
+
+inline void Bucket_Boruvka::get_batch_depths(const vec_t *update_idxs, const size_t num_idxs,
+                                             const uint64_t seed_and_col,
+                                             const vec_hash_t max_depth, col_hash_t *depths) {
+  if (!SketchHash::has_hash_kernels || num_idxs < min_kernel_lanes) {
+    for (size_t i = 0; i < num_idxs; i++)
+      depths[i] = get_index_depth(update_idxs[i], seed_and_col, max_depth);
+    return;
+  }
+  get_batch_depths_kernel(update_idxs, num_idxs, seed_and_col, max_depth, depths);
+}
+
+inline void Bucket_Boruvka::get_batch_hashes(const vec_t *idxs, const size_t num_idxs,
+                                             const uint64_t sketch_seed, vec_hash_t *hashes) {
+  if (num_idxs < min_kernel_lanes) {
+    for (size_t i = 0; i < num_idxs; i++) hashes[i] = get_index_hash(idxs[i], sketch_seed);
+    return;
+  }
+  get_batch_hashes_kernel(idxs, num_idxs, sketch_seed, hashes);
+}
@@ -1,4 +1,5 @@
 #pragma once
+#include "sketch_arena.h"
 
 // Graph parameters
 class CCAlgConfiguration {
@@ -14,6 +15,28 @@ private:
   // Size of update batches as relative to the size of a Supernode
   double _batch_factor = 1;
 
+  // Whether to back the memory of the vertex sketches with huge pages
+  HugePageMode _huge_pages = TRANSPARENT_HUGE_PAGES;
+
+  // A vertex stores the exact set of its incident edges, rather than a sketch, while the set
+  // takes at most this fraction of the memory of a sketch. 0 gives every vertex a sketch
+  double _sparse_sketch_factor = 0.125;
+
+  // Sketching algorithm of the vertex sketches
+  SketchAlgorithm _sketch_algorithm = default_sketch_algorithm;
+
+  // Whether the vertex sketches store 32 bit indices when every edge index fits in 32 bits, that
+  // is for graphs of at most 2^16 vertices. Shrinks the sketches by a third
+  bool _narrow_indices = true;
+
+  // Whether the vertex sketches take the depths of several columns from each hash of an update
+  // (SLICED_DEPTHS) rather than hashing every column
+  bool _sliced_depths = false;
+
+  // Whether write_binary and construct_from_serialized_data transfer the sketches with O_DIRECT,
+  // bypassing the page cache. Files on file systems without direct IO are read and written as usual
+  bool _direct_io = false;
+
   friend class CCSketchAlg;
 
 public:
@@ -23,11 +46,23 @@ public:
   CCAlgConfiguration& disk_dir(std::string disk_dir);
   CCAlgConfiguration& sketches_factor(double factor);
   CCAlgConfiguration& batch_factor(double factor);
+  CCAlgConfiguration& huge_pages(HugePageMode mode);
+  CCAlgConfiguration& sparse_sketch_factor(double factor);
+  CCAlgConfiguration& sketch_algorithm(SketchAlgorithm algorithm);
+  CCAlgConfiguration& narrow_indices(bool narrow);
+  CCAlgConfiguration& sliced_depths(bool sliced);
+  CCAlgConfiguration& direct_io(bool direct);
 
   // getters
   std::string get_disk_dir() { return _disk_dir; }
   double get_sketches_factor() { return _sketches_factor; }
   double get_batch_factor() { return _batch_factor; }
+  HugePageMode get_huge_pages() { return _huge_pages; }
+  double get_sparse_sketch_factor() { return _sparse_sketch_factor; }
+  SketchAlgorithm get_sketch_algorithm() { return _sketch_algorithm; }
+  bool get_narrow_indices() { return _narrow_indices; }
+  bool get_sliced_depths() { return _sliced_depths; }
+  bool get_direct_io() { return _direct_io; }
 
   friend std::ostream& operator<< (std::ostream &out, const CCAlgConfiguration &conf);
 
@@ -1,26 +1,35 @@
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cstdlib>
 #include <exception>
 #include <fstream>
 #include <iostream>
 #include <mutex>
-#include <set>
-#include <unordered_set>
 #include <vector>
 #include <memory>
 #include <cassert>
 
 #include "cc_alg_configuration.h"
+#include "chunked_file.h"
 #include "return_types.h"
 #include "sketch.h"
+#include "shared_store.h"
+#include "sketch_arena.h"
+#include "snapshot.h"
+#include "sparse_sketch.h"
 #include "dsu.h"
+#include "forest_edges.h"
 
 #ifdef VERIFY_SAMPLES_F
 #include "test/graph_verifier.h"
 #endif
 
+#if defined(ATOMIC_MERGE) && !defined(SOA_BUCKETS)
+#error "ATOMIC_MERGE requires the SOA_BUCKETS bucket layout"
+#endif
+
 // Exceptions the Connected Components algorithm may throw
 class UpdateLockedException : public std::exception {
   virtual const char *what() const throw() {
@@ -28,6 +37,17 @@ class UpdateLockedException : public std::exception {
   }
 };
 
+// Thrown when merging algorithms whose sketches cannot be combined
+class MergeException : public std::exception {
+ private:
+  std::string err_msg;
+ public:
+  MergeException(const std::string &reason) : err_msg("Cannot merge: " + reason) {}
+  virtual const char* what() const throw() {
+    return err_msg.c_str();
+  }
+};
+
 struct MergeInstr {
   node_id_t root;
   node_id_t child;
@@ -45,9 +65,7 @@ struct alignas(64) GlobalMergeData {
   size_t num_merge_needed = -1;
   size_t num_merge_done = 0;
 
-  GlobalMergeData(node_id_t num_vertices, size_t seed, double sketches_factor)
-      : sketch(Sketch::calc_vector_length(num_vertices), seed,
-               Sketch::calc_cc_samples(num_vertices, sketches_factor)) {}
+  GlobalMergeData(const SketchParams &sketch_params) : sketch(sketch_params) {}
 
   GlobalMergeData(const GlobalMergeData&& other)
   : sketch(other.sketch) {
@@ -56,6 +74,29 @@ struct alignas(64) GlobalMergeData {
   }
 };
 
+// A chunk of the sketches serialized by CCSketchAlg::write_binary: the index of its first vertex
+// in the list of serialized vertices and the file offset of the sketch of that vertex
+struct SerializedChunk {
+  uint64_t first_vertex;
+  uint64_t offset;
+};
+
+// The header of a delta checkpoint written by CCSketchAlg::write_delta. It is followed by the
+// vertices of the delta and their sketches XORed with their sketches in the base, in SPARSE
+// chunks as in the files of CCSketchAlg::write_binary
+struct DeltaHeader {
+  char magic[8];
+  uint64_t seed;
+  uint64_t num_vertices;
+  uint64_t sequence;           // 1 for the first delta against the base, 2 for the next, ...
+  uint64_t base_header_bytes;  // the header of the base, up to its first sketch
+  uint64_t base_checksum;      // XXH3_64bits of the header of the base
+  uint32_t algorithm;          // the SketchAlgorithm of the sketches
+  uint32_t index_width;        // and their IndexWidth
+  uint32_t depth_hashing;      // and DepthHashing
+  uint32_t hash_policy;        // the sketch_hash_policy of the build that wrote the delta
+};
+
 // What type of query is the user going to perform. Used for has_cached_query()
 enum QueryCode {
   CONNECTIVITY,     // connected components and spanning forest of graph
@@ -71,9 +112,89 @@ class CCSketchAlg {
   node_id_t num_vertices;
   size_t seed;
   bool update_locked = false;
-  // a set containing one "representative" from each supernode
-  std::set<node_id_t> *representatives;
-  Sketch **sketches;
+  // the sketch of each vertex. Allocated together in one slab
+  SketchArena sketches;
+  // Each vertex starts out null: it has received no updates and its sketch is never touched, so
+  // the memory of its sketch is never populated. Once updated, its sparse sketch holds the exact
+  // set of its edges until the set grows too large and the vertex switches to its sketch.
+  SparseSketch *sparse_sketches;
+  size_t max_sparse_size;  // number of edges beyond which a vertex switches to its sketch
+  // locks for updating the vertex sketches. Vertex v uses lock v % num_sketch_mtx. With
+  // ATOMIC_MERGE only updates to sparse vertices are locked
+  StoreMutex *sketch_mtx;
+  static constexpr size_t num_sketch_mtx = 1 << 12;
+
+  // the header of the shared store holding the sketches and their locks, or null if they belong
+  // to this process alone. See create_shared_store()
+  SharedStoreHeader *shared_store = nullptr;
+
+  // Edges are encoded as the concatenation of their endpoints. When the sketches store 32 bit
+  // indices each endpoint takes narrow_endpoint_bits rather than 32 bits
+  static constexpr size_t narrow_endpoint_bits = 16;
+  static IndexWidth calc_index_width(node_id_t num_vertices, CCAlgConfiguration config);
+  inline vec_t edge_index(node_id_t src, node_id_t dst) const {
+    if (sketches.get_params().index_width == WIDE_INDEX)
+      return static_cast<vec_t>(concat_pairing_fn(src, dst));
+    return vec_t(std::min(src, dst)) << narrow_endpoint_bits | std::max(src, dst);
+  }
+  inline Edge index_edge(vec_t idx) const {
+    if (sketches.get_params().index_width == WIDE_INDEX) return inv_concat_pairing_fn(idx);
+    return {node_id_t(idx >> narrow_endpoint_bits),
+            node_id_t(idx & ((1 << narrow_endpoint_bits) - 1))};
+  }
+
+  inline bool is_sparse(node_id_t v) const { return !sparse_sketches[v].is_dense(); }
+  // a null vertex has an empty edge set. Its sketch is ZERO
+  inline bool is_null(node_id_t v) const {
+    return is_sparse(v) && sparse_sketches[v].size() == 0;
+  }
+  // the sketch that vertex v stands for. That of a sparse vertex is built in scratch
+  const Sketch &vertex_sketch(node_id_t v, std::unique_ptr<Sketch> &scratch) const;
+
+  // a vertex is dirty once it is updated after the last checkpoint: bit v % 64 of
+  // dirty_vertices[v / 64] is set. Cleared by write_binary() with FULL sketches and write_delta()
+  std::atomic<uint64_t> *dirty_vertices;
+  // likewise, a vertex is changed once it is updated after the last query that computed the
+  // components rather than answer from the DSU. Cleared by that query
+  std::atomic<uint64_t> *changed_vertices;
+  static inline void mark_bit(std::atomic<uint64_t> *bits, node_id_t v) {
+    std::atomic<uint64_t> &word = bits[v / 64];
+    uint64_t bit = uint64_t(1) << (v % 64);
+    // most updates are to vertices that are marked already, so only read the shared word
+    if (!(word.load(std::memory_order_relaxed) & bit))
+      word.fetch_or(bit, std::memory_order_relaxed);
+  }
+  inline void mark_dirty(node_id_t v) {
+    mark_bit(dirty_vertices, v);
+    mark_bit(changed_vertices, v);
+  }
+  void clear_dirty();
+  void clear_changed();
+
+  // the FULL checkpoint that delta checkpoints are XORed against. See write_delta()
+  struct CheckpointBase {
+    std::string file;
+    uint64_t header_bytes;
+    uint64_t header_checksum;
+    std::vector<uint64_t> offsets;  // of the sketch of each vertex in the file, 0 if it was null
+    uint64_t num_deltas;            // written against the base so far
+  };
+  std::unique_ptr<CheckpointBase> checkpoint_base;
+  static constexpr char delta_magic[8] = {'G', 'Z', 'D', 'E', 'L', 'T', 'A', '1'};
+
+  // make the FULL checkpoint file the base of the next delta checkpoints and clear the dirty
+  // vertices. header_checksum is the checksum of its first header_bytes bytes
+  void set_checkpoint_base(const std::string &file, uint64_t header_bytes,
+                           uint64_t header_checksum, const std::vector<node_id_t> &vertices,
+                           const std::vector<SerializedChunk> &chunks);
+
+  // apply a batch of updates to a sparse vertex, densifying it if the batch is too large.
+  // Return false if the vertex is dense and the batch must be applied to its sketch instead
+  bool sparse_update_batch(node_id_t src_vertex, const std::vector<node_id_t> &dst_vertices);
+
+  // update scratch with the sample of a sparse vertex and return if it modifies the DSU. scratch
+  // is left zero
+  bool sample_sparse_supernode(node_id_t v, Sketch &scratch);
   // DSU representation of supernode relationship
   DisjointSetUnion_MT<node_id_t> dsu;
 
@@ -84,12 +205,33 @@ class CCSketchAlg {
   // for accessing if the DSU is valid from threads that do not perform updates
   std::atomic<bool> shared_dsu_valid;
 
-  std::unordered_set<node_id_t> *spanning_forest;
-  std::mutex *spanning_forest_mtx;
-
-  // threads use these sketches to apply delta updates to our sketches
+  // the edges of the spanning forest that the DSU was built from. pre_insert() keeps it along
+  // with the DSU without locking
+  ForestEdges spanning_forest;
+
+  // the spanning forest edges deleted since the DSU was last found valid. The next query replaces
+  // them in repair_spanning_forest(), unless there are more than num_vertices /
+  // forest_repair_factor of them, in which case pre_insert() invalidates the DSU instead
+  std::vector<Edge> deleted_forest_edges;
+  std::mutex deleted_forest_mtx;
+  static constexpr node_id_t forest_repair_factor = 16;
+
+  // the spanning forest holds only edges of the graph, and its trees were the components of the
+  // last query that computed them, less the forest edges deleted since. Then the next query
+  // starts Boruvka from those trees, and pre_insert() erases the forest edges that updates delete
+  // when it does not keep the DSU. Unset when the sketches change other than by updates
+  bool warm_start_valid = true;
+
+  // threads use these sketches to apply delta updates to our sketches. They are zero between
+  // batches. Small batches record the buckets they touch in delta_touched and only those buckets
+  // are merged, larger batches merge the entire delta sketch.
   Sketch **delta_sketches = nullptr;
+  bucket_id_t **delta_touched = nullptr;
   size_t num_delta_sketches;
+  size_t sparse_batch_limit;  // largest batch that is merged sparsely
+
+  // a batch is merged sparsely if it touches at most 1 / sparse_delta_ratio of the buckets
+  static constexpr size_t sparse_delta_ratio = 8;
 
   CCAlgConfiguration config;
 #ifdef VERIFY_SAMPLES_F
@@ -110,6 +252,13 @@ class CCSketchAlg {
    */
   bool sample_supernode(Sketch &skt);
 
+  /**
+   * Merge the endpoints of an edge that a sample found in the DSU, and if they were not connected
+   * yet, add the edge to the spanning forest.
+   * @return  true if the endpoints were not connected yet.
+   */
+  bool add_sampled_edge(Edge e);
+
   /**
    * Calculate the instructions for what vertices to merge to form each component
    */
@@ -118,33 +267,169 @@ class CCSketchAlg {
   /**
    * @param reps         set containing the roots of each supernode
    * @param merge_instr  a list of lists of supernodes to be merged
+   * @param skip_root    root of a supernode that is not sampled, or num_vertices for none. Every
+   *                     other supernode is sampled, so any edge that leaves it is still found
    */
   bool perform_boruvka_round(const size_t cur_round, const std::vector<MergeInstr> &merge_instr,
-                             std::vector<GlobalMergeData> &global_merges);
+                             std::vector<GlobalMergeData> &global_merges, node_id_t skip_root);
 
   /**
    * Main parallel algorithm utilizing Boruvka and L_0 sampling.
    * Ensures that the DSU represents the Connected Components of the stream when called
+   * @param warm_start  start from the trees of the spanning forest rather than from singleton
+   *                    supernodes. Requires warm_start_valid
+   */
+  void boruvka_emulation(bool warm_start = false);
+
+  // rebuild the DSU from the edges of the spanning forest. Returns the number of edges
+  size_t rebuild_dsu_from_forest();
+
+  /**
+   * Repair the spanning forest of the last query that computed the components, rather than
+   * rebuild it. The DSU is rebuilt from the remaining forest edges, which splits the trees that
+   * lost edges into pieces, and Boruvka then runs on the components that may have changed alone:
+   * - While the DSU is valid otherwise, those are the pieces of the trees of the
+   *   deleted_forest_edges. Graph edges only join pieces of the same tree, so each round samples
+   *   every component of a tree but the largest one, until the tree has a single component left.
+   * - Otherwise, if warm_start_valid, those are the pieces that hold changed vertices, and each
+   *   round samples every component until its sample is ZERO. If the pieces hold more than
+   *   num_vertices / forest_repair_factor vertices, the caller should run a warm started
+   *   boruvka_emulation() instead.
+   * @return  true if the DSU and spanning forest hold the answer again, false if the caller must
+   *          run boruvka_emulation() instead.
+   */
+  bool repair_spanning_forest();
+
+  // write_binary splits the serialized sketches into chunks of about this many bytes, which are
+  // written and read in parallel
+  static constexpr size_t serial_chunk_bytes = 1 << 20;
+
+  /**
+   * Write header, the list of vertices and then a sketch for each of them in chunks that threads
+   * serialize and pwrite in parallel. The number of chunks and the chunk table are appended to
+   * header. Throws FileIOException if the file cannot be written.
+   * @param sketch_of  sketch_of(v, scratch) returns the sketch to write for vertex v, which it
+   *                   may build in scratch, a sketch of the thread
+   * @return           the chunks of the file
    */
-  void boruvka_emulation();
+  template <class SketchOf>
+  std::vector<SerializedChunk> write_sketch_chunks(const std::string &filename,
+                                                   std::vector<char> &header,
+                                                   const std::vector<node_id_t> &vertices,
+                                                   SerialType serial_type, SketchOf &&sketch_of);
+
+  /**
+   * Read the sketches of vertices from the chunks of a file, with a thread for each chunk at a
+   * time. Throws FileIOException if the file cannot be read.
+   * @param read_vertex  read_vertex(v, binary_in, scratch) reads the sketch of vertex v from
+   *                     binary_in. scratch is a sketch of the thread
+   */
+  template <class ReadVertex>
+  void read_sketch_chunks(int fd, int direct_fd, const std::string &input_file,
+                          const std::vector<node_id_t> &vertices,
+                          const std::vector<SerializedChunk> &chunks, ReadVertex &&read_vertex);
+
+  // apply the delta checkpoint of the given sequence number against the checkpoint base to the
+  // vertices that are not yet restored, and mark them restored
+  void apply_delta(const std::string &delta_file, uint64_t sequence, std::vector<bool> &restored);
+
+  // constructor for use when mapping a snapshot. fd is the open snapshot described by header
+  CCSketchAlg(const SnapshotHeader &header, int fd, const std::string &snapshot_file,
+              CCAlgConfiguration config);
 
-  // constructor for use when reading from a serialized file
-  CCSketchAlg(node_id_t num_vertices, size_t seed, std::ifstream &binary_stream,
+  // constructor for use with a shared store. fd is its segment and store its header, mapped by
+  // SharedStore::map_header(). If create the segment is new and is initialized
+  CCSketchAlg(node_id_t num_vertices, size_t seed, size_t num_samples, size_t cols_per_sample,
+              int fd, SharedStoreHeader *store, const std::string &store_name, bool create,
               CCAlgConfiguration config);
 
  public:
   CCSketchAlg(node_id_t num_vertices, size_t seed, CCAlgConfiguration config = CCAlgConfiguration());
   ~CCSketchAlg();
 
-  // construct a CC algorithm from a serialized file
+  /**
+   * Construct a CC algorithm from a file written by write_binary(). The chunks of the file are
+   * read in parallel, with direct IO if config asks for it. Throws FileIOException if the file
+   * cannot be read or is not of the current format, or if its sketches were written with another
+   * sketch algorithm, index width or depth hashing than config selects, or by a build of
+   * another hash policy.
+   * @param input_file  the file to read.
+   * @param config      [Optional] the configuration of the algorithm.
+   */
   static CCSketchAlg * construct_from_serialized_data(
       const std::string &input_file, CCAlgConfiguration config = CCAlgConfiguration());
 
+  /**
+   * Construct a CC algorithm from a checkpoint written by write_binary() with FULL sketches and
+   * the delta checkpoints written against it by write_delta(). Only the newest delta of each
+   * vertex is applied. More deltas may be written against the same base afterwards. Throws
+   * FileIOException if a file cannot be read or the deltas do not belong to the base.
+   * @param base_file    the checkpoint the deltas were written against.
+   * @param delta_files  the delta checkpoints in the order they were written.
+   * @param config       [Optional] the configuration of the algorithm.
+   */
+  static CCSketchAlg *construct_from_checkpoints(const std::string &base_file,
+                                                 const std::vector<std::string> &delta_files,
+                                                 CCAlgConfiguration config = CCAlgConfiguration());
+
+  /**
+   * Construct a CC algorithm from a snapshot written by write_snapshot(). The vertex sketches are
+   * mapped from the snapshot and used in place: their pages are read when first touched, and
+   * are copied rather than written back when updated. The sketch options of config are replaced
+   * by those of the snapshot. Throws SnapshotException if the snapshot is damaged or was written
+   * by a build that lays out its sketches differently.
+   * @param snapshot_file   the snapshot to map.
+   * @param config          [Optional] the configuration of the algorithm.
+   * @param verify_buckets  [Optional] whether to check the checksum of the sketches. This reads
+   *                        every page of the sketches, so loading is no longer lazy. The header
+   *                        and the edge sets of the sparse vertices are always checked.
+   */
+  static CCSketchAlg *construct_from_snapshot(const std::string &snapshot_file,
+                                              CCAlgConfiguration config = CCAlgConfiguration(),
+                                              bool verify_buckets = false);
+
+  /**
+   * Construct a CC algorithm whose vertex sketches live in a new POSIX shared memory segment, a
+   * shared store, so that other processes may attach to them with attach_shared_store(). Ingest
+   * processes apply their updates to the shared sketches with apply_update_batch() or
+   * apply_raw_buckets_update(), which lock them with mutexes in the segment (or merge them
+   * atomically with ATOMIC_MERGE), and any process may query them. Since other processes may
+   * have updated the sketches since, a query is never answered from the last one. It should run
+   * once the ingest processes have applied their updates. Every vertex holds its sketch,
+   * since the edge sets of sparse vertices would be private to one process. The store lasts until
+   * remove_shared_store() and the last process detaches. Throws SharedStoreException if the store
+   * already exists or cannot be created.
+   * @param store_name    the name of the segment, as for shm_open(): "/" and up to 254 more
+   *                      characters that are not slashes.
+   * @param num_vertices  the number of vertices of the graph.
+   * @param seed          the seed of the sketches.
+   * @param config        [Optional] the configuration of the algorithm.
+   */
+  static CCSketchAlg *create_shared_store(const std::string &store_name, node_id_t num_vertices,
+                                          size_t seed,
+                                          CCAlgConfiguration config = CCAlgConfiguration());
+
+  /**
+   * Construct a CC algorithm over the sketches of an existing shared store, see
+   * create_shared_store(). The sketch options of config are replaced by those of the store.
+   * Throws SharedStoreException if the store does not exist or was created by a build that lays
+   * out its sketches differently.
+   * @param store_name  the name of the store.
+   * @param config      [Optional] the configuration of the algorithm.
+   */
+  static CCSketchAlg *attach_shared_store(const std::string &store_name,
+                                          CCAlgConfiguration config = CCAlgConfiguration());
+
+  // remove a shared store. The processes attached to it keep using it until they detach
+  static void remove_shared_store(const std::string &store_name) {
+    SharedStore::remove(store_name);
+  }
+
   /**
    * Returns the number of buffered updates we would like to have in the update batches
    */
   size_t get_desired_updates_per_batch() {
-    size_t num = sketches[0]->bucket_array_bytes() / sizeof(node_id_t);
+    size_t num = sketches[0].bucket_array_bytes() / sizeof(node_id_t);
     num *= config._batch_factor;
     return num;
   }
@@ -161,11 +446,18 @@ class CCSketchAlg {
   void allocate_worker_memory(size_t num_workers) {
     num_delta_sketches = num_workers;
     delta_sketches = new Sketch *[num_delta_sketches];
+    delta_touched = new bucket_id_t *[num_delta_sketches];
     for (size_t i = 0; i < num_delta_sketches; i++) {
-      delta_sketches[i] =
-          new Sketch(Sketch::calc_vector_length(num_vertices), seed,
-                     Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor()));
+      delta_sketches[i] = new Sketch(sketches.get_params());
     }
+
+    // largest batch whose max_touched() is within the budget, and that fits in one chunk
+    const Sketch &delta = *delta_sketches[0];
+    size_t touched_budget = delta.get_buckets() / sparse_delta_ratio;
+    sparse_batch_limit = touched_budget == 0 ? 0 : (touched_budget - 1) / delta.get_columns();
+    sparse_batch_limit = std::min(sparse_batch_limit, Sketch::update_batch_chunk);
+    for (size_t i = 0; i < num_delta_sketches; i++)
+      delta_touched[i] = new bucket_id_t[delta.max_touched(sparse_batch_limit)];
   }
 
   /**
@@ -208,10 +500,46 @@ class CCSketchAlg {
    * The function performs a direct update to the associated sketch.
    * For performance reasons, do not use this function if possible.
    * 
-   * This function is not thread-safe
+   * This function is not thread-safe, nor safe while other processes update a shared store
    */
   void update(GraphUpdate upd);
 
+  /**
+   * Merge the sketches of another algorithm into those of this one, so that this algorithm holds
+   * the graph of both streams. Sketches are linear, so algorithms with the same seed that each
+   * ingested a part of a stream merge into the algorithm of the whole stream. The vertices are
+   * merged in parallel. Throws MergeException if the algorithms do not have the same number of
+   * vertices, seed and sketch shape.
+   *
+   * This function is not thread-safe
+   */
+  void merge(const CCSketchAlg &other);
+
+  /**
+   * Merge the sketches of a file written by write_binary() into those of this algorithm, as
+   * merge() does, without constructing another algorithm. The chunks of the file are read and
+   * merged in parallel. Throws FileIOException if the file cannot be read or holds the sketches
+   * of a different number of vertices, seed, sketch algorithm, index width, depth hashing or
+   * hash policy.
+   * @param input_file  the file to merge.
+   *
+   * This function is not thread-safe
+   */
+  void merge_serialized_data(const std::string &input_file);
+
+  /**
+   * Merge files written by write_binary() by algorithms with the same seed into one, as if it
+   * were written by the merge() of their algorithms. Throws FileIOException if a file cannot be
+   * read or written or does not hold the sketches of the same graph.
+   * @param input_files  the files to merge. At least one.
+   * @param output_file  the name of the file to (over)write the merged sketches to.
+   * @param type         [Optional] the format of the merged sketches (default = FULL).
+   * @param config       [Optional] the configuration of the algorithm the files are merged in.
+   */
+  static void merge_serialized_files(const std::vector<std::string> &input_files,
+                                     const std::string &output_file, SerialType type = FULL,
+                                     CCAlgConfiguration config = CCAlgConfiguration());
+
   /**
    * Main parallel query algorithm utilizing Boruvka and L_0 sampling.
    * @return  the connected components in the graph.
@@ -242,17 +570,48 @@ class CCSketchAlg {
 
   /**
    * Serialize the graph data to a binary file.
-   * @param filename the name of the file to (over)write data to.
+   * @param filename  the name of the file to (over)write data to.
+   * @param type      [Optional] the format of the vertex sketches (default = FULL). SPARSE
+   *                  writes only their non-zero buckets, which is much smaller for most graphs.
+   *                  RANGE writes the samples they have not used, which between queries is all
+   *                  of them. The format is recorded in the file.
+   *
+   * The sketches are split into chunks that threads serialize and pwrite at precomputed offsets
+   * of the file, with direct IO if the configuration asks for it. Throws FileIOException if the
+   * file cannot be written. With FULL sketches the file becomes the base of delta checkpoints,
+   * see write_delta().
+   */
+  void write_binary(const std::string &filename, SerialType type = FULL);
+
+  /**
+   * Write a delta checkpoint of the vertices updated since the last checkpoint. The deltas are
+   * written against a base: the last file written by write_binary() with FULL sketches or read by
+   * construct_from_serialized_data(), which must not change while deltas refer to it. A delta
+   * holds the sketch of each of its vertices XORed with the sketch of the vertex in the base, in
+   * the SPARSE format, so it stores only the buckets that changed since the base. Restore with
+   * construct_from_checkpoints(). Throws FileIOException if there is no base or a file cannot be
+   * read or written.
+   * @param filename  the name of the file to (over)write the delta to.
+   */
+  void write_delta(const std::string &filename);
+
+  /**
+   * Write a snapshot of the graph data to a file that construct_from_snapshot() can map. The
+   * sketches are written exactly as they are laid out in memory, and pages of sketches that are
+   * all zero are left as holes in the file. See snapshot.h for the format. Throws
+   * SnapshotException if the file cannot be written.
+   * @param filename  the name of the file to (over)write data to.
    */
-  void write_binary(const std::string &filename);
+  void write_snapshot(const std::string &filename);
 
   // time hooks for experiments
   std::chrono::steady_clock::time_point cc_alg_start;
   std::chrono::steady_clock::time_point cc_alg_end;
   size_t last_query_rounds = 0;
+  bool last_query_repaired = false;  // the query repaired the spanning forest rather than rebuild
 
   // getters
   inline node_id_t get_num_vertices() { return num_vertices; }
   inline size_t get_seed() { return seed; }
-  inline size_t max_rounds() { return sketches[0]->get_num_samples(); }
+  inline size_t max_rounds() { return sketches.get_params().num_samples; }
 };
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstddef>
+#include <exception>
+#include <streambuf>
+#include <string>
+
+/*
+ * Stream buffers over a chunk of a file, so that many threads may stream different chunks of the
+ * same file at once. They pwrite and pread at the offsets of their chunk, so no two threads share
+ * a file position, and Sketch::serialize() and Sketch::deserialize() work on them unchanged.
+ *
+ * Either may also be given a descriptor of the file opened with O_DIRECT, which bypasses the
+ * page cache. O_DIRECT requires the memory, offset and size of every transfer to be aligned to
+ * ChunkedFile::direct_alignment while chunks start and end anywhere. A FileChunkWriter therefore
+ * writes the whole aligned blocks of its chunk through the O_DIRECT descriptor and the partial
+ * blocks at either end through the other one. Those blocks may be shared with the neighbouring
+ * chunks, but no block is written both ways.
+ */
+
+class FileIOException : public std::exception {
+ private:
+  std::string err_msg;
+ public:
+  FileIOException(const std::string &file, const std::string &reason)
+      : err_msg("File " + file + ": " + reason) {}
+  virtual const char* what() const throw() {
+    return err_msg.c_str();
+  }
+};
+
+namespace ChunkedFile {
+  constexpr size_t direct_alignment = 4096;
+
+  // the size of the buffer of each stream. A multiple of direct_alignment
+  constexpr size_t buffer_bytes = 1 << 20;
+
+  /**
+   * Open file with O_DIRECT and the given flags.
+   * @return  the descriptor, or -1 if the file cannot be opened that way, for instance because
+   *          its file system does not support direct IO.
+   */
+  int open_direct(const std::string &file, int flags);
+
+  /**
+   * Read bytes bytes at offset of the file fd.
+   * @return  0, the errno of the read that failed, or EIO if the file ends first.
+   */
+  int read_at(int fd, void *data, size_t bytes, size_t offset);
+}  // namespace ChunkedFile
+
+class FileChunkWriter : public std::streambuf {
+ private:
+  int fd;
+  int direct_fd;      // -1 to write every block through fd
+  char *buffer;
+  size_t buf_offset;  // the file offset of buffer[0]
+  size_t head;        // bytes at the start of the buffer that precede the chunk
+  int err = 0;
+
+  void write_out(int to_fd, const char *data, size_t bytes, size_t offset);
+
+  // write out the buffer. Unless last, the partial block at its end stays buffered
+  void flush_buffer(bool last);
+
+ protected:
+  int_type overflow(int_type ch) override;
+  std::streamsize xsputn(const char *data, std::streamsize n) override;
+
+ public:
+  /**
+   * @param fd         the file to write to.
+   * @param direct_fd  the file opened with O_DIRECT, or -1.
+   * @param offset     the file offset of the chunk.
+   */
+  FileChunkWriter(int fd, int direct_fd, size_t offset);
+  ~FileChunkWriter();
+
+  // write out the rest of the chunk. Returns 0 or the errno of the first write that failed
+  int finish();
+
+  // the file offset of the next byte of the chunk
+  size_t tell() const { return buf_offset + (pptr() - buffer); }
+};
+
+class FileChunkReader : public std::streambuf {
+ private:
+  int fd;
+  int direct_fd;  // -1 to read through fd
+  char *buffer;
+  size_t offset;  // the file offset of egptr()
+  size_t end;
+  int err = 0;
+
+  // read up to bytes bytes at offset into data, returning how many were read
+  size_t read_in(int from_fd, char *data, size_t bytes, size_t offset);
+
+ protected:
+  int_type underflow() override;
+  std::streamsize xsgetn(char *data, std::streamsize n) override;
+
+ public:
+  /**
+   * @param fd         the file to read from.
+   * @param direct_fd  the file opened with O_DIRECT, or -1.
+   * @param offset     the file offset of the chunk.
+   * @param end        the file offset the chunk ends at. Reads past it fail.
+   */
+  FileChunkReader(int fd, int direct_fd, size_t offset, size_t end);
+  ~FileChunkReader();
+
+  // 0 or the errno of the first read that failed. A stream that fails without an error read
+  // past the end of the chunk or the file
+  int error() const { return err; }
+};
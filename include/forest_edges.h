@@ -0,0 +1,81 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "types.h"
+
+/**
+ * The edges of a spanning forest of a graph on num_vertices vertices, which has at most
+ * num_vertices - 1 of them. The edges are packed into one flat open-addressing hash table of
+ * 64 bit words, sized for a load factor of at most 2/3, so the forest costs 12 bytes per vertex
+ * rather than a set and a mutex of each vertex. Edges are inserted and erased concurrently and
+ * without locks by swapping the word of their slot with a compare and swap.
+ *
+ * Erased edges leave their slot marked as erased until clear(), so that lookups of the edges
+ * probed past it still find them. The slots to spare hold num_vertices / 2 erased edges.
+ */
+class ForestEdges {
+ private:
+  std::atomic<uint64_t> *slots;
+  size_t num_slots;
+
+  // src < dst, so no edge packs to either of these
+  static constexpr uint64_t empty_slot = UINT64_MAX;
+  static constexpr uint64_t erased_slot = UINT64_MAX - 1;
+
+  static inline uint64_t pack(Edge edge) {
+    return uint64_t(std::min(edge.src, edge.dst)) << 32 | std::max(edge.src, edge.dst);
+  }
+  static inline Edge unpack(uint64_t key) { return {node_id_t(key >> 32), node_id_t(key)}; }
+
+  // the slot to start probing for key at
+  inline size_t home_slot(uint64_t key) const {
+    uint64_t hash = key * 0x9E3779B97F4A7C15;
+    return (hash ^ (hash >> 29)) % num_slots;
+  }
+
+ public:
+  explicit ForestEdges(node_id_t num_vertices);
+  ~ForestEdges();
+
+  ForestEdges(const ForestEdges &) = delete;
+  ForestEdges &operator=(const ForestEdges &) = delete;
+
+  /**
+   * Insert an edge. Thread-safe. The forest must not hold num_vertices - 1 edges already.
+   * @return  false if the forest already held the edge.
+   */
+  bool insert(Edge edge);
+
+  /**
+   * Erase an edge. Thread-safe.
+   * @return  false if the forest did not hold the edge.
+   */
+  bool erase(Edge edge);
+
+  /**
+   * Whether the forest holds an edge. Thread-safe, though an edge inserted concurrently may or
+   * may not be seen.
+   */
+  bool contains(Edge edge) const;
+
+  // remove every edge. Not thread-safe
+  void clear();
+
+  // the edges, each with src < dst, in no particular order. Not thread-safe with insert()
+  std::vector<Edge> get_edges() const;
+
+  // call f(edge) on every edge. Not thread-safe with insert()
+  template <class F>
+  void for_each(F &&f) const {
+    for (size_t i = 0; i < num_slots; i++) {
+      uint64_t key = slots[i].load(std::memory_order_relaxed);
+      if (key != empty_slot && key != erased_slot) f(unpack(key));
+    }
+  }
+
+  inline size_t memory_bytes() const { return num_slots * sizeof(uint64_t); }
+};
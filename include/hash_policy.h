@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <graph_zeppelin_common.h>
+
+/*
+ * Hash functions that the sketches may use for the depths of vector indices in their columns.
+ * Each policy splits hashing into make_key(), which derives the key material of a seed, and
+ * hash(), which hashes an index under a key. Sketches derive the keys of all their seeds once
+ * and cache them (see SketchParams). Every bit of a hash is uniform, so a depth may be taken
+ * from its trailing zeros.
+ *
+ * The policy of a build is SketchHash, chosen with the MULTIPLY_SHIFT_HASH and TABULATION_HASH
+ * compilation definitions. The default is XXH3Hash. Checksums are always XXH3Hash: a checksum
+ * must also reject buckets holding structured sets of indices, and the sums and XORs of
+ * multiply-shift and tabulation hashes of such sets often equal the hash of another index.
+ */
+
+/**
+ * XXH3_64bits_withSeed() of a single index. For 8 byte inputs XXH3 reduces to
+ * XXH3_len_4to8_64b():
+ *   seed'   = seed ^ (bswap32(low32(seed)) << 32)
+ *   keyed   = rotl64(input, 32) ^ (secret_bitflip - seed')
+ *   hash    = rrmxmx(keyed, 8)
+ * where secret_bitflip is derived from the default XXH3 secret. The key is the part of the
+ * secret that the input is XORed with, secret_bitflip - seed'.
+ */
+struct XXH3Hash {
+  struct Key {
+    uint64_t keyed_secret;
+  };
+
+  static constexpr uint64_t secret_bitflip = 0xc73ab174c5ecd5a2ULL;  // kSecret[8..24)
+  static constexpr uint64_t prime_mx2 = 0x9FB21C651E98DF25ULL;
+  static constexpr uint64_t input_len = sizeof(vec_t);
+
+  // the multi-lane hash kernels of bucket.cpp compute this hash
+  static constexpr bool has_hash_kernels = true;
+
+  static inline Key make_key(const uint64_t seed) {
+    return {secret_bitflip - (seed ^ uint64_t(__builtin_bswap32(uint32_t(seed))) << 32)};
+  }
+
+  static inline uint64_t hash(const vec_t index, const Key &key) {
+    uint64_t h = (index << 32 | index >> 32) ^ key.keyed_secret;
+    h ^= (h << 49 | h >> 15) ^ (h << 24 | h >> 40);
+    h *= prime_mx2;
+    h ^= (h >> 35) + input_len;
+    h *= prime_mx2;
+    return h ^ (h >> 28);
+  }
+};
+
+/**
+ * Multiply-add-shift hashing (Dietzfelbinger 1996) of 64 bit indices to 64 bits:
+ *   hash = ((a * index + b) mod 2^128) >> 64
+ * with random 128 bit a and b. Strongly universal: the hashes of any two distinct indices are
+ * independent and uniform. Larger sets of indices are not independent, and columns sample
+ * measurably less often with this policy than with XXH3Hash.
+ */
+struct MultiplyShiftHash {
+  struct Key {
+    uint64_t a_lo;
+    uint64_t a_hi;
+    uint64_t b_lo;
+    uint64_t b_hi;
+  };
+
+  static constexpr bool has_hash_kernels = false;
+
+  static Key make_key(const uint64_t seed);
+
+  static inline uint64_t hash(const vec_t index, const Key &key) {
+    // only the high 64 bits of a_hi * index * 2^64 and b survive the shift
+    __uint128_t low = __uint128_t(key.a_lo) * index + key.b_lo;
+    return uint64_t(low >> 64) + key.a_hi * index + key.b_hi;
+  }
+};
+
+/**
+ * Simple tabulation hashing (Zobrist; Carter and Wegman): the XOR of a random table entry for
+ * each byte of the index. 3-independent, and known to behave much like a truly random hash in
+ * many applications (Patrascu and Thorup 2012). Each key holds 16 KiB of tables.
+ */
+struct TabulationHash {
+  static constexpr size_t num_chars = sizeof(vec_t);
+  struct Key {
+    uint64_t tables[num_chars][256];
+  };
+
+  static constexpr bool has_hash_kernels = false;
+
+  static Key make_key(const uint64_t seed);
+
+  static inline uint64_t hash(const vec_t index, const Key &key) {
+    uint64_t h = 0;
+    for (size_t i = 0; i < num_chars; i++) h ^= key.tables[i][(index >> (8 * i)) & 0xFF];
+    return h;
+  }
+};
+
+#if defined(MULTIPLY_SHIFT_HASH) && defined(TABULATION_HASH)
+#error "MULTIPLY_SHIFT_HASH cannot be combined with TABULATION_HASH"
+#endif
+
+// sketch_hash_policy identifies SketchHash in files of sketches, which only builds of the same
+// policy may read: the policy decides the bucket of every index
+#ifdef MULTIPLY_SHIFT_HASH
+typedef MultiplyShiftHash SketchHash;
+constexpr uint32_t sketch_hash_policy = 1;
+#elif defined(TABULATION_HASH)
+typedef TabulationHash SketchHash;
+constexpr uint32_t sketch_hash_policy = 2;
+#else
+typedef XXH3Hash SketchHash;
+constexpr uint32_t sketch_hash_policy = 0;
+#endif
@@ -7,6 +7,7 @@
 #include <vector>
 
 #include "dsu.h"
+#include "forest_edges.h"
 #include "types.h"
 
 // This class defines the connected components of a graph
@@ -32,6 +33,8 @@ class SpanningForest {
   node_id_t num_vertices;
  public:
   SpanningForest(node_id_t num_vertices, const std::unordered_set<node_id_t> *spanning_forest);
+  SpanningForest(node_id_t num_vertices, const ForestEdges &spanning_forest)
+      : edges(spanning_forest.get_edges()), num_vertices(num_vertices) {}
 
   const std::vector<Edge>& get_edges() const { return edges; }
 };
@@ -0,0 +1,98 @@
+#pragma once
+#include <pthread.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+
+#include "snapshot.h"
+
+/*
+ * POSIX shared memory segment holding the vertex sketches of a CCSketchAlg, so that several
+ * processes may ingest into and query the same sketches (see CCSketchAlg::create_shared_store).
+ *
+ *   SharedStoreHeader
+ *   the StoreMutexes that lock the vertex sketches
+ *   padding up to SharedStore::slab_offset
+ *   slab: SketchArena::get_slab() of the sketches of every vertex
+ *
+ * The sketches are described by a SnapshotHeader, so a store is only attached by builds that lay
+ * out their buckets the same way. Its vertex section is empty: every vertex of a store holds its
+ * sketch, since the edge sets of sparse vertices live in the memory of a single process.
+ */
+
+struct SharedStoreHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_locks;
+  uint64_t locks_offset;  // bytes from the start of the segment
+  SnapshotHeader sketches;
+  std::atomic<uint32_t> ready;  // set by the creator once the segment is initialized
+};
+
+class SharedStoreException : public std::exception {
+ private:
+  std::string err_msg;
+ public:
+  SharedStoreException(const std::string &name, const std::string &reason)
+      : err_msg("Shared store " + name + ": " + reason) {}
+  virtual const char* what() const throw() {
+    return err_msg.c_str();
+  }
+};
+
+/**
+ * Mutex of the vertex sketches of a CCSketchAlg. The mutexes of a shared store live in the
+ * segment and are shared by its processes. They are robust: if a process dies while holding one,
+ * the next process to lock it takes it over, so one failed ingest process does not stall the
+ * others. The updates the dead process was merging may then be partly applied, while those it had
+ * not yet merged are lost with it anyway.
+ */
+class StoreMutex {
+ private:
+  pthread_mutex_t mtx;
+
+ public:
+  // initialize the mutex in place. process_shared for a mutex in a shared store
+  void init(bool process_shared);
+  void destroy() { pthread_mutex_destroy(&mtx); }
+
+  void lock();
+  void unlock() { pthread_mutex_unlock(&mtx); }
+};
+
+namespace SharedStore {
+  constexpr char magic[8] = {'G', 'Z', 'S', 'H', 'A', 'R', 'E', 'D'};
+  constexpr uint32_t version = 1;
+
+  // the slab is placed where a snapshot would align it, after the header and the mutexes
+  constexpr size_t slab_offset = Snapshot::slab_alignment;
+
+  /**
+   * Open the segment of the store name, creating it if create. Names are those of shm_open(): a
+   * slash followed by up to NAME_MAX - 1 other characters. Throws SharedStoreException if it
+   * cannot be opened, or when creating, if it already exists.
+   */
+  int open(const std::string &name, bool create);
+
+  // map the header and mutexes of the segment fd. Throws SharedStoreException on failure
+  SharedStoreHeader *map_header(int fd, const std::string &name);
+  void unmap_header(SharedStoreHeader *header);
+
+  // the mutexes of the store described by header, mapped by map_header()
+  inline StoreMutex *locks(SharedStoreHeader *header) {
+    return reinterpret_cast<StoreMutex *>(reinterpret_cast<char *>(header) +
+                                          header->locks_offset);
+  }
+
+  /**
+   * Check that the segment fd holds an initialized store that this build may attach to, and
+   * that the segment is large enough to hold its slab. Throws SharedStoreException otherwise.
+   */
+  void validate(const SharedStoreHeader &header, int fd, const std::string &name);
+
+  // remove the store name. Processes attached to it keep it until they detach
+  void remove(const std::string &name);
+}  // namespace SharedStore
@@ -6,16 +6,27 @@
 #include <fstream>
 #include <unordered_set>
 #include <cmath>
-#include <mutex>
+#include <memory>
+#include <utility>
+#include <vector>
 
 #include "util.h"
 #include "bucket.h"
 
-// enum SerialType {
-//   FULL,
-//   RANGE,
-//   SPARSE,
-// };
+#if defined(ROUND_MAJOR_BUCKETS) && (defined(SOA_BUCKETS) || defined(DEPTH_MAJOR_BUCKETS))
+#error "ROUND_MAJOR_BUCKETS cannot be combined with SOA_BUCKETS or DEPTH_MAJOR_BUCKETS"
+#endif
+
+/**
+ * Serialized formats of a Sketch. All of them store buckets in the raw bucket format (64 bit
+ * index Buckets in column-major order), so they do not depend upon the bucket layout or index
+ * width of the sketch.
+ */
+enum SerialType {
+  FULL,    // every bucket
+  RANGE,   // the deterministic bucket and the columns of a range of samples
+  SPARSE,  // the positions and contents of the non-zero buckets
+};
 
 enum SampleResult {
   GOOD,  // sampling this sketch returned a single non-zero value
@@ -23,33 +34,413 @@ enum SampleResult {
   FAIL   // sampling this sketch failed to produce a single non-zero value
 };
 
+/**
+ * The sketching algorithm. CubeSketch samples uniformly (l0 sampling) by updating every bucket of
+ * a column up to the depth of an update. CameoSketch performs support finding instead: it only
+ * updates the bucket at that depth, which is faster but gives no guarantee of a uniform sample.
+ */
+enum SketchAlgorithm {
+  CAMEO_SKETCH,
+  CUBE_SKETCH,
+};
+
+// the algorithm of sketches that do not ask for one. Compile with L0_SAMPLING for CubeSketch
+#ifdef L0_SAMPLING
+static constexpr SketchAlgorithm default_sketch_algorithm = CUBE_SKETCH;
+#else
+static constexpr SketchAlgorithm default_sketch_algorithm = CAMEO_SKETCH;
+#endif
+
+/**
+ * Width of the index (alpha) stored in every bucket. The checksum (gamma) is always a vec_hash_t.
+ * A sketch with NARROW_INDEX stores NarrowBuckets, which take 8 bytes rather than 12, but every
+ * index of the sketched vector must be below 2^32. Narrowing the index loses nothing: a bucket
+ * holding a single index returns it exactly, and the chance that a bucket holding several
+ * indices passes the checksum is 2^-32 per bucket tested with either width.
+ */
+enum IndexWidth {
+  WIDE_INDEX,    // 64 bit indices
+  NARROW_INDEX,  // 32 bit indices
+};
+
+/**
+ * How the depth of an update in each column is chosen. COLUMN_DEPTHS hashes the update once per
+ * column. SLICED_DEPTHS hashes it once per Bucket_Boruvka::depth_slice_columns columns and takes
+ * the depth of each column from its own byte of the hash, hashing a column on its own only when
+ * its byte is zero (1 in 256). The depths have the same distribution either way and the columns
+ * remain independent, but the two give different sketches of the same vector.
+ */
+enum DepthHashing {
+  COLUMN_DEPTHS,
+  SLICED_DEPTHS,
+};
+
 struct SketchSample {
   vec_t idx;
   SampleResult result;
 };
 
+// index of a bucket within the bucket storage of a sketch
+#ifdef ROUND_MAJOR_BUCKETS
+// the columns of a round-major arena sketch span the whole arena
+typedef uint64_t bucket_id_t;
+#else
+typedef uint32_t bucket_id_t;
+#endif
+
 struct ExhaustiveSketchSample {
   std::unordered_set<vec_t> idxs;
   SampleResult result;
 };
 
+// the update and sample functions used by sketches of one shape (defined in sketch.cpp)
+struct SketchKernels;
+
 /**
- * Sketch for graph processing, either CubeSketch or CameoSketch.
- * Sub-linear representation of a vector.
+ * The shape of a Sketch. Every sketch built by a SketchArena shares a single copy of these
+ * parameters rather than storing them once per vertex.
  */
-class Sketch {
- private:
-  const uint64_t seed;     // seed for hash functions
+struct SketchParams {
+  uint64_t seed;           // seed for hash functions
   size_t num_samples;      // number of samples we can perform
   size_t cols_per_sample;  // number of columns to use on each sample
   size_t num_columns;      // Total number of columns. (product of above 2)
   size_t bkt_per_col;      // number of buckets per column
   size_t num_buckets;      // number of total buckets (product of above 2)
+  SketchAlgorithm algorithm;
+  IndexWidth index_width;
+  DepthHashing depth_hashing;
+  const SketchKernels *kernels;  // kernels specialized for this shape
+
+  // the hash keys of the seeds of the sketch, derived once and shared by copies of the params
+  XXH3Hash::Key checksum_key;
+  std::shared_ptr<const std::vector<SketchHash::Key>> hash_keys;
+  const SketchHash::Key *column_keys;  // rounded up to a whole number of depth slices
+  const SketchHash::Key *slice_keys;   // of every depth slice, for SLICED_DEPTHS
+#ifdef ROUND_MAJOR_BUCKETS
+  size_t column_stride;    // buckets from the start of one column to the next. bkt_per_col
+                           // unless the sketch belongs to a SketchArena
+#endif
+
+  SketchParams(vec_t vector_len, uint64_t seed, size_t num_samples, size_t cols_per_sample,
+               SketchAlgorithm algorithm = default_sketch_algorithm,
+               IndexWidth index_width = WIDE_INDEX,
+               DepthHashing depth_hashing = COLUMN_DEPTHS);
+
+  // bytes of the alpha and of the whole bucket in the bucket storage
+  inline size_t alpha_bytes() const {
+    return index_width == NARROW_INDEX ? sizeof(NarrowBucket::alpha) : sizeof(Bucket::alpha);
+  }
+  inline size_t bucket_bytes() const { return alpha_bytes() + sizeof(vec_hash_t); }
+
+  // bytes of memory needed to hold the buckets of one sketch (a multiple of the cache line size)
+  size_t bucket_memory_bytes() const;
+};
+
+/**
+ * Sketch for graph processing, either CubeSketch or CameoSketch.
+ * Sub-linear representation of a vector.
+ */
+class Sketch {
+  friend struct SketchParams;
+
+ private:
+  const SketchParams *params;  // shape of this sketch. Possibly shared with other sketches
+  bool owns_memory;            // false if params and buckets belong to a SketchArena
 
   size_t sample_idx = 0;   // number of samples performed so far
 
-  // bucket data
-  Bucket* buckets;
+  // bucket data. The alphas are vec_ts, or uint32_ts with NARROW_INDEX
+#ifdef SOA_BUCKETS
+  // structure of arrays: the alphas and gammas of all buckets are stored in separate, cache line
+  // aligned arrays. Merges become independent XORs over contiguous words.
+  void* bucket_alphas;
+  vec_hash_t* bucket_gammas;
+#else
+  void* buckets;  // Buckets, or NarrowBuckets with NARROW_INDEX
+#endif
+
+  // allocate the parameters and bucket storage of a standalone sketch (does not initialize it)
+  void allocate(const SketchParams &sketch_params);
+
+  // point the bucket arrays into bucket_memory, which holds params->bucket_memory_bytes() bytes
+  void set_bucket_memory(char *bucket_memory);
+
+  // call func(i, bucket) with the column-major index and contents of every non-zero bucket, in
+  // order. Skips runs of zero buckets a word at a time when the layout allows it
+  template <class Func>
+  void for_each_nonzero_bucket(Func &&func) const;
+  template <class bucket_t, class Func>
+  void for_each_nonzero_bucket_as(Func &&func) const;
+
+  // the SPARSE and RANGE formats. See serialize()
+  void serialize_sparse(std::ostream &binary_out) const;
+  void deserialize_sparse(std::istream &binary_in);
+  void deserialize_range(std::istream &binary_in);
+
+  // read or write the raw buckets with column-major indices [first_bucket, first_bucket + n)
+  void read_raw_buckets(std::istream &binary_in, size_t first_bucket, size_t n);
+  void write_raw_buckets(std::ostream &binary_out, size_t first_bucket, size_t n) const;
+
+  // return a pointer to the alphas of the buckets with column-major indices
+  // [first_bucket, first_bucket + n). May copy them into scratch (which must hold n values) if
+  // the layout does not store these alphas contiguously as vec_ts.
+  template <class bucket_t>
+  const vec_t* load_alphas(size_t first_bucket, size_t n, vec_t* scratch) const;
+
+#ifdef DEPTH_MAJOR_BUCKETS
+  // depth-major: the buckets of every column at a given depth are contiguous. Most updates land
+  // in the lowest depths so they touch only a few cache lines.
+  inline size_t column_stride() const { return 1; }
+  inline size_t depth_stride() const { return params->num_columns; }
+  static constexpr bool packed_columns = false;  // column_stride() == bkt_per_col
+
+  inline size_t deterministic_bucket() const { return params->num_buckets - 1; }
+
+  // the storage index of the bucket with the column-major index bucket_id
+  inline size_t bucket_position(size_t bucket_id) const {
+    if (bucket_id == params->num_buckets - 1) return bucket_id;  // deterministic bucket
+    return bucket_index(bucket_id / params->bkt_per_col, bucket_id % params->bkt_per_col);
+  }
+  // the column and depth of the bucket stored at bucket_id
+  inline size_t bucket_column(size_t bucket_id) const { return bucket_id % params->num_columns; }
+  inline size_t bucket_depth(size_t bucket_id) const { return bucket_id / params->num_columns; }
+#elif defined(ROUND_MAJOR_BUCKETS)
+  // round-major: within a SketchArena, column c of every sketch is stored in one contiguous
+  // region, so a Boruvka round streams through a single region rather than touching a few
+  // buckets of every sketch. The deterministic buckets follow the last column. A standalone
+  // sketch is stored column-major.
+  inline size_t column_stride() const { return params->column_stride; }
+  inline size_t depth_stride() const { return 1; }
+  static constexpr bool packed_columns = false;  // column_stride() == bkt_per_col
+  inline size_t deterministic_bucket() const {
+    return params->num_columns * params->column_stride;
+  }
+
+  // the storage index of the bucket with the column-major index bucket_id
+  inline size_t bucket_position(size_t bucket_id) const {
+    if (bucket_id == params->num_buckets - 1) return deterministic_bucket();
+    return bucket_index(bucket_id / params->bkt_per_col, bucket_id % params->bkt_per_col);
+  }
+  // the column and depth of the bucket stored at bucket_id
+  inline size_t bucket_column(size_t bucket_id) const {
+    return bucket_id / params->column_stride;
+  }
+  inline size_t bucket_depth(size_t bucket_id) const { return bucket_id % params->column_stride; }
+#else
+  // column-major: the buckets of each column are contiguous
+  inline size_t column_stride() const { return params->bkt_per_col; }
+  inline size_t depth_stride() const { return 1; }
+  static constexpr bool packed_columns = true;  // column_stride() == bkt_per_col
+  inline size_t deterministic_bucket() const { return params->num_buckets - 1; }
+  inline size_t bucket_position(size_t bucket_id) const { return bucket_id; }
+  // the column and depth of the bucket stored at bucket_id
+  inline size_t bucket_column(size_t bucket_id) const { return bucket_id / params->bkt_per_col; }
+  inline size_t bucket_depth(size_t bucket_id) const { return bucket_id % params->bkt_per_col; }
+#endif
+
+  inline size_t bucket_index(size_t column, size_t depth) const {
+    return column * column_stride() + depth * depth_stride();
+  }
+
+  // the storage index in this sketch of the bucket stored at bucket_id in other. Sketches of the
+  // same shape share a layout unless one of them belongs to a round-major SketchArena
+  inline size_t matching_bucket(const Sketch &other, size_t bucket_id) const {
+#ifdef ROUND_MAJOR_BUCKETS
+    return bucket_index(other.bucket_column(bucket_id), other.bucket_depth(bucket_id));
+#else
+    (void)other;
+    return bucket_id;
+#endif
+  }
+
+  /*
+   * The update and sample kernels are specialized on the algorithm, the bucket type and the
+   * number of buckets per column (and columns per sample when sampling), so that loop bounds and
+   * bucket strides are compile-time constants. A count of 0 reads the value from params at
+   * runtime instead. SketchParams picks the matching instantiation for its shape with
+   * select_kernels().
+   */
+  template <SketchAlgorithm algorithm, class bucket_t, size_t kBktPerCol>
+  void update_kernel(const vec_t update_idx);
+
+  // update_batch() restricted to the columns [first_column, end_column), optionally recording
+  // the id of every bucket it updates in touched
+  template <SketchAlgorithm algorithm, class bucket_t, size_t kBktPerCol, bool track_touched>
+  size_t update_batch_kernel(const vec_t *updates, size_t num_updates, size_t first_column,
+                             size_t end_column, bucket_id_t *touched);
+
+  // sample the columns of the sample beginning at first_column, ignoring the deterministic bucket
+  template <class bucket_t, size_t kColsPerSample, size_t kBktPerCol>
+  SketchSample sample_kernel(size_t first_column);
+
+  // kernels of every number of buckets per column in [min_kernel_depth, max_kernel_depth]
+  template <SketchAlgorithm algorithm, class bucket_t, size_t kColsPerSample, size_t... kDepths>
+  static const SketchKernels *kernel_table(std::index_sequence<kDepths...>);
+
+  // kernels that read the whole shape from params
+  template <SketchAlgorithm algorithm, class bucket_t>
+  static const SketchKernels *generic_kernels();
+
+  template <class bucket_t>
+  static const SketchKernels *select_kernels(SketchAlgorithm algorithm, size_t cols_per_sample,
+                                             size_t bkt_per_col);
+  static const SketchKernels *select_kernels(const SketchParams &shape);
+
+  // the depths of update_idx in the columns [first_column, first_column + num_cols)
+  inline void get_depths(const vec_t update_idx, size_t first_column, size_t num_cols,
+                         size_t max_depth, col_hash_t *depths) const {
+    if (params->depth_hashing == COLUMN_DEPTHS) {
+      if (SketchHash::has_hash_kernels) {
+        Bucket_Boruvka::get_index_depths(update_idx, column_seed(first_column),
+                                         column_seed_stride, num_cols, max_depth, depths);
+        return;
+      }
+      for (size_t i = 0; i < num_cols; i++)
+        depths[i] = Bucket_Boruvka::get_index_depth(update_idx, column_key(first_column + i),
+                                                    max_depth);
+      return;
+    }
+    constexpr size_t slice_cols = Bucket_Boruvka::depth_slice_columns;
+    constexpr size_t slice_bits = Bucket_Boruvka::depth_slice_bits;
+    for (size_t i = 0; i < num_cols;) {
+      size_t slice = (first_column + i) % slice_cols;
+      size_t slice_column = first_column + i - slice;
+      uint64_t slice_hash = SketchHash::hash(update_idx, slice_key(slice_column));
+      uint64_t packed = Bucket_Boruvka::get_sliced_depths(update_idx, slice_hash,
+                                                          &column_key(slice_column), max_depth);
+      for (; slice < slice_cols && i < num_cols; slice++, i++)
+        depths[i] = (packed >> (slice * slice_bits)) & ((1 << slice_bits) - 1);
+    }
+  }
+
+  // the depths of the updates in a single column. With SLICED_DEPTHS packed_depths holds the
+  // depths of the updates in the columns sharing a sliced hash with column, as returned by
+  // Bucket_Boruvka::get_sliced_depths(). They are recomputed if column is the first of these
+  // columns or if rehash is set
+  inline void get_batch_depths(const vec_t *updates, size_t num_updates, size_t column,
+                               size_t max_depth, bool rehash, uint64_t *packed_depths,
+                               col_hash_t *depths) const {
+    if (params->depth_hashing == COLUMN_DEPTHS) {
+      if (SketchHash::has_hash_kernels) {
+        Bucket_Boruvka::get_batch_depths(updates, num_updates, column_seed(column), max_depth,
+                                         depths);
+        return;
+      }
+      const SketchHash::Key &key = column_key(column);
+      for (size_t u = 0; u < num_updates; u++)
+        depths[u] = Bucket_Boruvka::get_index_depth(updates[u], key, max_depth);
+      return;
+    }
+    constexpr size_t slice_bits = Bucket_Boruvka::depth_slice_bits;
+    size_t slice = column % Bucket_Boruvka::depth_slice_columns;
+    if (rehash || slice == 0) {
+      const SketchHash::Key &key = slice_key(column - slice);
+      const SketchHash::Key *keys = &column_key(column - slice);
+      for (size_t u = 0; u < num_updates; u++) {
+        uint64_t slice_hash = SketchHash::hash(updates[u], key);
+        packed_depths[u] = Bucket_Boruvka::get_sliced_depths(updates[u], slice_hash, keys,
+                                                             max_depth);
+      }
+    }
+    for (size_t u = 0; u < num_updates; u++)
+      depths[u] = (packed_depths[u] >> (slice * slice_bits)) & ((1 << slice_bits) - 1);
+  }
+
+  // call visit on every bucket that the id recorded by update_batch() stands for
+  template <class Visitor>
+  inline void visit_touched(bucket_id_t bucket_id, Visitor visit) const {
+    // CubeSketch updates every bucket of the column up to the recorded depth
+    if (params->algorithm == CUBE_SKETCH && bucket_id != deterministic_bucket()) {
+      size_t column = bucket_column(bucket_id);
+      for (size_t depth = 0; depth <= bucket_depth(bucket_id); depth++)
+        visit(bucket_index(column, depth));
+      return;
+    }
+    visit(bucket_id);
+  }
+
+  // XOR the buckets [other_first, other_first + n_buckets) of other into the buckets
+  // [first_bucket, first_bucket + n_buckets) of this sketch
+  void merge_bucket_range(const Sketch &other, size_t first_bucket, size_t other_first,
+                          size_t n_buckets);
+
+  // ranges of fewer buckets than this are merged inline rather than by the merge kernel
+  static constexpr size_t min_kernel_buckets = 8;
+
+  // accessors of the buckets of a sketch whose bucket storage holds bucket_t
+#ifdef SOA_BUCKETS
+  template <class bucket_t>
+  inline decltype(bucket_t::alpha) *alpha_array() const {
+    return (decltype(bucket_t::alpha) *)bucket_alphas;
+  }
+  template <class bucket_t>
+  inline vec_t bucket_alpha_as(size_t bucket_id) const {
+    return alpha_array<bucket_t>()[bucket_id];
+  }
+  template <class bucket_t>
+  inline vec_hash_t bucket_gamma_as(size_t bucket_id) const { return bucket_gammas[bucket_id]; }
+  template <class bucket_t>
+  inline void set_bucket_as(size_t bucket_id, const Bucket &bucket) {
+    alpha_array<bucket_t>()[bucket_id] = bucket.alpha;
+    bucket_gammas[bucket_id] = bucket.gamma;
+  }
+  template <class bucket_t>
+  inline void update_bucket_as(size_t bucket_id, vec_t update_idx, vec_hash_t update_hash) {
+    alpha_array<bucket_t>()[bucket_id] ^= update_idx;
+    bucket_gammas[bucket_id] ^= update_hash;
+  }
+
+  // the alpha of bucket_id, in bytes
+  inline char *alpha_ptr(size_t bucket_id) const {
+    return (char *)bucket_alphas + bucket_id * params->alpha_bytes();
+  }
+#else
+  template <class bucket_t>
+  inline vec_t bucket_alpha_as(size_t bucket_id) const {
+    return ((bucket_t *)buckets)[bucket_id].alpha;
+  }
+  template <class bucket_t>
+  inline vec_hash_t bucket_gamma_as(size_t bucket_id) const {
+    return ((bucket_t *)buckets)[bucket_id].gamma;
+  }
+  template <class bucket_t>
+  inline void set_bucket_as(size_t bucket_id, const Bucket &bucket) {
+    ((bucket_t *)buckets)[bucket_id] = {decltype(bucket_t::alpha)(bucket.alpha), bucket.gamma};
+  }
+  template <class bucket_t>
+  inline void update_bucket_as(size_t bucket_id, vec_t update_idx, vec_hash_t update_hash) {
+    ((bucket_t *)buckets)[bucket_id].alpha ^= update_idx;
+    ((bucket_t *)buckets)[bucket_id].gamma ^= update_hash;
+  }
+
+  // the bucket bucket_id, in bytes
+  inline char *bucket_ptr(size_t bucket_id) const {
+    return (char *)buckets + bucket_id * params->bucket_bytes();
+  }
+#endif
+
+  // accessors for code that is not specialized on the bucket type
+  inline bool narrow_index() const { return params->index_width == NARROW_INDEX; }
+  inline vec_t bucket_alpha(size_t bucket_id) const {
+    return narrow_index() ? bucket_alpha_as<NarrowBucket>(bucket_id)
+                          : bucket_alpha_as<Bucket>(bucket_id);
+  }
+  inline vec_hash_t bucket_gamma(size_t bucket_id) const {
+    return narrow_index() ? bucket_gamma_as<NarrowBucket>(bucket_id)
+                          : bucket_gamma_as<Bucket>(bucket_id);
+  }
+  inline Bucket get_bucket(size_t bucket_id) const {
+    return {bucket_alpha(bucket_id), bucket_gamma(bucket_id)};
+  }
+  inline void set_bucket(size_t bucket_id, const Bucket &bucket) {
+    if (narrow_index()) set_bucket_as<NarrowBucket>(bucket_id, bucket);
+    else set_bucket_as<Bucket>(bucket_id, bucket);
+  }
+  inline void update_bucket(size_t bucket_id, vec_t update_idx, vec_hash_t update_hash) {
+    if (narrow_index()) update_bucket_as<NarrowBucket>(bucket_id, update_idx, update_hash);
+    else update_bucket_as<Bucket>(bucket_id, update_idx, update_hash);
+  }
 
  public:
   /**
@@ -71,8 +462,17 @@ class Sketch {
    * @param f              Multiplicative sample factor
    * @return               The number of samples
    */
-  static size_t calc_cc_samples(node_id_t num_vertices, double f) {
-    return std::max(size_t(18), (size_t) ceil(f * log2(num_vertices) / num_samples_div));
+  static size_t calc_cc_samples(node_id_t num_vertices, double f,
+                                SketchAlgorithm algorithm = default_sketch_algorithm) {
+    double samples_div = algorithm == CUBE_SKETCH ? cube_samples_div : cameo_samples_div;
+    return std::max(size_t(18), (size_t) ceil(f * log2(num_vertices) / samples_div));
+  }
+
+  /**
+   * The number of columns a sample of a sketch using the given algorithm should use.
+   */
+  static constexpr size_t calc_cols_per_sample(SketchAlgorithm algorithm) {
+    return algorithm == CUBE_SKETCH ? cube_cols_per_sample : cameo_cols_per_sample;
   }
 
   /**
@@ -81,9 +481,14 @@ class Sketch {
    * @param seed             Random seed of the sketch
    * @param num_samples      [Optional] Number of samples this sketch supports (default = 1)
    * @param cols_per_sample  [Optional] Number of sketch columns for each sample (default = 1)
+   * @param algorithm        [Optional] Sketching algorithm (default = default_sketch_algorithm)
+   * @param index_width      [Optional] Width of the indices in the buckets (default = 64 bits)
+   * @param depth_hashing    [Optional] How the depths of updates are hashed (default = per column)
    */
   Sketch(vec_t vector_len, uint64_t seed, size_t num_samples = 1,
-         size_t cols_per_sample = default_cols_per_sample);
+         size_t cols_per_sample = default_cols_per_sample,
+         SketchAlgorithm algorithm = default_sketch_algorithm,
+         IndexWidth index_width = WIDE_INDEX, DepthHashing depth_hashing = COLUMN_DEPTHS);
 
   /**
    * Construct a sketch from a serialized stream
@@ -92,16 +497,53 @@ class Sketch {
    * @param binary_in        Stream holding serialized sketch object
    * @param num_samples      [Optional] Number of samples this sketch supports (default = 1)
    * @param cols_per_sample  [Optional] Number of sketch columns for each sample (default = 1)
+   * @param algorithm        [Optional] Sketching algorithm (default = default_sketch_algorithm)
+   * @param index_width      [Optional] Width of the indices in the buckets (default = 64 bits)
+   * @param depth_hashing    [Optional] How the depths of updates are hashed (default = per column)
    */
   Sketch(vec_t vector_len, uint64_t seed, std::istream& binary_in, size_t num_samples = 1,
-         size_t cols_per_sample = default_cols_per_sample);
+         size_t cols_per_sample = default_cols_per_sample,
+         SketchAlgorithm algorithm = default_sketch_algorithm,
+         IndexWidth index_width = WIDE_INDEX, DepthHashing depth_hashing = COLUMN_DEPTHS);
 
   /**
-   * Sketch copy constructor
+   * Construct a sketch from a stream serialized in the given format. The other parameters are
+   * those of the constructor above.
+   * @param type             Format the sketch was serialized in
+   */
+  Sketch(vec_t vector_len, uint64_t seed, std::istream& binary_in, SerialType type,
+         size_t num_samples = 1, size_t cols_per_sample = default_cols_per_sample,
+         SketchAlgorithm algorithm = default_sketch_algorithm,
+         IndexWidth index_width = WIDE_INDEX, DepthHashing depth_hashing = COLUMN_DEPTHS);
+
+  /**
+   * Construct an empty sketch with the same shape as another, such as the sketches of a
+   * SketchArena. The sketch always owns its memory.
+   * @param shape   Parameters of the sketch to construct.
+   */
+  explicit Sketch(const SketchParams &shape);
+
+  /**
+   * Sketch copy constructor. The copy always owns its memory.
    * @param s  The sketch to copy.
    */
   Sketch(const Sketch& s);
 
+  // sketches are not assigned: the buckets of a sketch may belong to a SketchArena, and a copy of
+  // its pointers would free them twice. merge() into a zeroed sketch of the same shape instead
+  Sketch &operator=(const Sketch &) = delete;
+
+  /**
+   * Construct a sketch over memory owned by someone else, such as a SketchArena. The sketch
+   * uses the memory as is, so it must already hold valid buckets (zero for an empty sketch).
+   * @param shared_params   Parameters of the sketch. Must outlive the sketch.
+   * @param bucket_memory   shared_params->bucket_memory_bytes() bytes of cache line aligned
+   *                        memory for the buckets. Must outlive the sketch. With
+   *                        ROUND_MAJOR_BUCKETS the buckets are spread over the memory of a
+   *                        SketchArena as given by shared_params->column_stride.
+   */
+  Sketch(const SketchParams *shared_params, void *bucket_memory);
+
   ~Sketch();
 
   /**
@@ -110,6 +552,43 @@ class Sketch {
    */
   void update(const vec_t update);
 
+  /**
+   * Update a sketch with a batch of indices. Equivalent to calling update() on each index but
+   * iterates column by column over the whole batch so that all hashes sharing a seed are
+   * computed together.
+   * @param updates      the point updates.
+   * @param num_updates  the number of updates in the batch.
+   */
+  void update_batch(const vec_t *updates, size_t num_updates);
+
+  /**
+   * update_batch() that also records the id of every bucket it updates, so that the batch can be
+   * merged into another sketch with merge_touched(). An id may be recorded more than once. With
+   * CubeSketch an id stands for its bucket and every bucket below it in the same column.
+   * @param updates      the point updates.
+   * @param num_updates  the number of updates in the batch.
+   * @param touched      buffer of at least max_touched(num_updates) ids to write to.
+   * @return             the number of ids written to touched.
+   */
+  size_t update_batch(const vec_t *updates, size_t num_updates, bucket_id_t *touched);
+
+  /**
+   * Update only the deterministic bucket and the columns of some samples with a batch of indices.
+   * The sketch then matches, within those samples, a sketch updated with the whole batch. Like
+   * range_merge(), this should only be used if you know what you're doing.
+   * @param updates       the point updates.
+   * @param num_updates   the number of updates in the batch.
+   * @param start_sample  Index of first sample to update
+   * @param n_samples     Number of samples to update
+   */
+  void range_update_batch(const vec_t *updates, size_t num_updates, size_t start_sample,
+                          size_t n_samples);
+
+  // the most bucket ids update_batch() may record for a batch of num_updates updates
+  inline size_t max_touched(size_t num_updates) const {
+    return num_updates * params->num_columns + 1;
+  }
+
   /**
    * Function to sample from the sketch.
    * cols_per_sample determines the number of columns we allocate to this query
@@ -123,8 +602,6 @@ class Sketch {
    */
   ExhaustiveSketchSample exhaustive_sample();
 
-  std::mutex mutex; // lock the sketch for applying updates in multithreaded processing
-
   /**
    * In-place merge function.
    * @param other  Sketch to merge into caller
@@ -149,6 +626,44 @@ class Sketch {
    */
   void merge_raw_bucket_buffer(const Bucket *raw_buckets);
 
+  /**
+   * Merge only the touched buckets of delta into the caller and zero them in delta. When delta
+   * was zero before the update_batch() that produced touched, this is equivalent to merge()
+   * followed by delta.zero_contents(), but costs O(num_touched) rather than O(sketch size).
+   * @param delta        Sketch of the same shape to merge into the caller and clear
+   * @param touched      Bucket ids recorded by update_batch()
+   * @param num_touched  Number of ids in touched
+   */
+  void merge_touched(Sketch &delta, const bucket_id_t *touched, size_t num_touched);
+
+#ifdef SOA_BUCKETS
+  /**
+   * In-place merge that is safe to run concurrently with other atomic merges into the caller.
+   * Every non-zero word of other is XORed into the caller with an atomic fetch_xor, so no lock
+   * is needed. Requires the SOA_BUCKETS layout so that alphas and gammas are aligned words.
+   * @param other  Sketch to merge into caller
+   */
+  void atomic_merge(const Sketch &other);
+
+  /**
+   * Atomic version of merge_raw_bucket_buffer(). See atomic_merge().
+   * @param raw_bucket    Raw bucket data to merge into this sketch
+   */
+  void atomic_merge_raw_bucket_buffer(const Bucket *raw_buckets);
+
+  /**
+   * Atomic version of merge_touched(). See atomic_merge().
+   */
+  void atomic_merge_touched(Sketch &delta, const bucket_id_t *touched, size_t num_touched);
+#endif
+
+  /**
+   * Copy the buckets of this sketch into a raw bucket buffer, regardless of how the sketch
+   * stores them internally. This is the format consumed by merge_raw_bucket_buffer().
+   * @param raw_buckets   Buffer of at least get_buckets() Buckets to write to
+   */
+  void copy_to_raw_bucket_buffer(Bucket *raw_buckets) const;
+
   /**
    * Zero out all the buckets of a sketch.
    */
@@ -160,34 +675,121 @@ class Sketch {
   /**
    * Serialize the sketch to a binary output stream.
    * @param binary_out   the stream to write to.
+   * @param type         [Optional] the format to write (default = FULL). RANGE writes the
+   *                     samples that have not been sampled yet.
+   */
+  void serialize(std::ostream& binary_out, SerialType type = FULL) const;
+
+  /**
+   * Serialize the deterministic bucket and the columns of some samples in the RANGE format.
+   * Deserializing it gives a sketch that matches this one within those samples, and whose next
+   * sample is start_sample.
+   * @param binary_out    the stream to write to.
+   * @param start_sample  Index of first sample to write
+   * @param n_samples     Number of samples to write
    */
-  void serialize(std::ostream& binary_out) const;
+  void serialize_range(std::ostream& binary_out, size_t start_sample, size_t n_samples) const;
+
+  /**
+   * Replace the contents of the sketch with a serialized sketch of the same shape. Sets the
+   * failbit of binary_in if the stream ends early or does not hold a sketch of the format.
+   * @param binary_in   the stream to read from.
+   * @param type        [Optional] the format of the stream (default = FULL)
+   */
+  void deserialize(std::istream& binary_in, SerialType type = FULL);
 
   inline void reset_sample_state() {
     sample_idx = 0;
   }
 
   // return the size of the sketching datastructure in bytes (just the buckets, not the metadata)
-  inline size_t bucket_array_bytes() const { return num_buckets * sizeof(Bucket); }
+  inline size_t bucket_array_bytes() const {
+    return params->num_buckets * params->bucket_bytes();
+  }
+
+  // return the size of the sketch serialized in the given format in bytes. FULL is always an
+  // array of 64 bit index Buckets
+  inline size_t serialized_bytes(SerialType type = FULL) const {
+    switch (type) {
+      case RANGE: return range_serialized_bytes(params->num_samples - sample_idx);
+      case SPARSE: return sparse_serialized_bytes();
+      default: return params->num_buckets * sizeof(Bucket);
+    }
+  }
+
+  // return the size of n_samples samples serialized in the RANGE format in bytes
+  inline size_t range_serialized_bytes(size_t n_samples) const {
+    size_t sample_buckets = params->cols_per_sample * params->bkt_per_col;
+    return 2 * sizeof(size_t) + (1 + n_samples * sample_buckets) * sizeof(Bucket);
+  }
+
+  // the number of buckets of the sketch that are not zero
+  size_t nonzero_buckets() const;
+
+  // return the size of the sketch serialized in the SPARSE format in bytes
+  inline size_t sparse_serialized_bytes() const {
+    return sizeof(uint32_t) + nonzero_buckets() * (sizeof(uint32_t) + sizeof(Bucket));
+  }
 
+#ifndef SOA_BUCKETS
+  // the buckets, which are NarrowBuckets rather than Buckets if the sketch has NARROW_INDEX
   inline const Bucket* get_readonly_bucket_ptr() const { return (const Bucket*) buckets; }
-  inline uint64_t get_seed() const { return seed; }
-  inline size_t column_seed(size_t column_idx) const { return seed + column_idx * 5; }
-  inline size_t checksum_seed() const { return seed; }
-  inline size_t get_columns() const { return num_columns; }
-  inline size_t get_buckets() const { return num_buckets; }
-  inline size_t get_num_samples() const { return num_samples; }
+#endif
+  inline uint64_t get_seed() const { return params->seed; }
+  inline size_t column_seed(size_t column_idx) const {
+    return params->seed + column_idx * column_seed_stride;
+  }
+  inline size_t checksum_seed() const { return params->seed; }
+  // the cached hash keys of the seeds above
+  inline const SketchHash::Key &column_key(size_t column_idx) const {
+    return params->column_keys[column_idx];
+  }
+  inline const XXH3Hash::Key &checksum_key() const { return params->checksum_key; }
+  inline size_t get_columns() const { return params->num_columns; }
+  inline size_t get_buckets() const { return params->num_buckets; }
+  inline size_t get_num_samples() const { return params->num_samples; }
+  inline const SketchParams &get_params() const { return *params; }
+  inline SketchAlgorithm get_algorithm() const { return params->algorithm; }
+  inline IndexWidth get_index_width() const { return params->index_width; }
+  inline DepthHashing get_depth_hashing() const { return params->depth_hashing; }
+  // seed of the hash sliced into the depths of the columns [first_column, first_column +
+  // depth_slice_columns) with SLICED_DEPTHS. Never equal to a column or checksum seed
+  inline size_t depth_slice_seed(size_t first_column) const {
+    return column_seed(first_column) + 1;
+  }
+  inline const SketchHash::Key &slice_key(size_t first_column) const {
+    return params->slice_keys[first_column / Bucket_Boruvka::depth_slice_columns];
+  }
 
   static size_t calc_bkt_per_col(size_t n) { return ceil(log2(n)) + 1; }
 
-#ifdef L0_SAMPLING
-  static constexpr size_t default_cols_per_sample = 7;
+  // difference between the seeds of consecutive columns
+  static constexpr size_t column_seed_stride = 5;
+
+  // number of updates update_batch() hashes together before moving to the next column
+  static constexpr size_t update_batch_chunk = 256;
+
+  // alignment of the bucket memory of every sketch
+  static constexpr size_t bucket_alignment = 64;
+
+  // range of buckets per column with specialized kernels. Covers graphs of 2^8 to 2^24 vertices
+  static constexpr size_t min_kernel_depth = 16;
+  static constexpr size_t max_kernel_depth = 48;
+
+  /**
+   * Whether new sketch shapes use the kernels specialized for their shape, or the generic
+   * kernels. Sketches constructed before the call are unaffected. For testing and benchmarking.
+   */
+  static void use_specialized_kernels(bool specialized);
+
   // NOTE: can improve this but leaving for comparison purposes
-  static constexpr double num_samples_div = log2(3) - 1;
-#else
-  static constexpr size_t default_cols_per_sample = 1;
-  static constexpr double num_samples_div = 1 - log2(2 - 0.8);
-#endif
+  static constexpr size_t cube_cols_per_sample = 7;
+  static constexpr double cube_samples_div = log2(3) - 1;
+  static constexpr size_t cameo_cols_per_sample = 1;
+  static constexpr double cameo_samples_div = 1 - log2(2 - 0.8);
+
+  static constexpr size_t default_cols_per_sample =
+      default_sketch_algorithm == CUBE_SKETCH ? cube_cols_per_sample : cameo_cols_per_sample;
 };
 
 class OutOfSamplesException : public std::exception {
@@ -0,0 +1,103 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+#include "sketch.h"
+
+// How a SketchArena asks the kernel to back its memory with huge pages
+enum HugePageMode {
+  NO_HUGE_PAGES,           // regular pages
+  TRANSPARENT_HUGE_PAGES,  // madvise(MADV_HUGEPAGE) so THP may back the slab
+  EXPLICIT_HUGE_PAGES,     // MAP_HUGETLB from the reserved pool, falls back to THP if unavailable
+};
+
+/**
+ * Holds many sketches of identical shape, such as the sketches of every vertex of a graph.
+ * The buckets of all the sketches are placed back to back in a single mmap'd slab and the
+ * sketches share one SketchParams. This replaces one heap allocation per sketch with a single
+ * mapping. The slab starts out zero and pages are only populated once their sketches are touched.
+ * With ROUND_MAJOR_BUCKETS the slab is instead divided into one region per column, holding that
+ * column of every sketch, so that a Boruvka round reads a single region.
+ *
+ * An arena may instead map its slab from a file holding the slab of another arena of the same
+ * shape (see snapshot.h). The mapping is private, so the sketches are used in place, pages are
+ * read from the file only when first touched and updates never reach the file. Or the mapping is
+ * shared, as for a POSIX shared memory segment (see shared_store.h): updates are then written to
+ * the file and seen by every process that maps it.
+ */
+class SketchArena {
+ private:
+  SketchParams params;
+  size_t num_sketches;
+  size_t sketch_bytes;     // bytes from the bucket memory of one sketch to the next
+  size_t data_bytes;       // bytes of the slab holding buckets
+  size_t slab_bytes;       // bytes mapped for the slab (a multiple of the page size)
+  char *slab;
+  Sketch *sketches;
+  HugePageMode huge_pages;  // the mode actually in use
+
+  // set sketch_bytes and data_bytes (and the column stride of ROUND_MAJOR_BUCKETS)
+  void init_layout();
+
+  // map a zeroed slab of data_bytes bytes
+  void map_slab(HugePageMode mode);
+
+  // map a slab of data_bytes bytes from offset of the file fd, privately unless shared
+  void map_file(int fd, size_t offset, bool shared);
+
+  // construct the sketches over the slab
+  void create_sketches();
+
+ public:
+  /**
+   * @param num_sketches     Number of sketches to hold
+   * @param vector_len       Length of the vector each sketch sketches
+   * @param seed             Random seed shared by all the sketches
+   * @param num_samples      Number of samples each sketch supports
+   * @param cols_per_sample  Number of sketch columns for each sample
+   * @param mode             Whether to back the slab with huge pages
+   * @param algorithm        Sketching algorithm of the sketches
+   * @param index_width      Width of the indices in the buckets of the sketches
+   * @param depth_hashing    How the sketches hash the depths of updates
+   */
+  SketchArena(size_t num_sketches, vec_t vector_len, uint64_t seed, size_t num_samples,
+              size_t cols_per_sample = Sketch::default_cols_per_sample,
+              HugePageMode mode = TRANSPARENT_HUGE_PAGES,
+              SketchAlgorithm algorithm = default_sketch_algorithm,
+              IndexWidth index_width = WIDE_INDEX,
+              DepthHashing depth_hashing = COLUMN_DEPTHS);
+
+  /**
+   * Construct an arena over a slab stored in a file. The slab must have been written from
+   * get_slab() of an arena of the same shape, built with the same bucket layout. The other
+   * parameters are those of the constructor above. Throws std::system_error if the file
+   * cannot be mapped.
+   * @param fd               File holding the slab. May be closed once the arena is constructed
+   * @param offset           Offset of the slab in the file. A multiple of the page size
+   * @param shared           Whether updates to the sketches are written to the file. The file
+   *                         may then be extended to hold the slab after it is mapped, as long as
+   *                         no sketch is touched before
+   */
+  SketchArena(int fd, size_t offset, size_t num_sketches, vec_t vector_len, uint64_t seed,
+              size_t num_samples, size_t cols_per_sample, SketchAlgorithm algorithm,
+              IndexWidth index_width, DepthHashing depth_hashing, bool shared = false);
+  ~SketchArena();
+
+  // the sketches refer to the memory of the arena so it cannot be copied or moved
+  SketchArena(const SketchArena &) = delete;
+  SketchArena &operator=(const SketchArena &) = delete;
+
+  inline Sketch &operator[](size_t i) { return sketches[i]; }
+  inline const Sketch &operator[](size_t i) const { return sketches[i]; }
+
+  inline size_t size() const { return num_sketches; }
+  inline const SketchParams &get_params() const { return params; }
+  inline size_t get_slab_bytes() const { return slab_bytes; }
+  // the bytes of the slab that hold the buckets of the sketches
+  inline const char *get_slab() const { return slab; }
+  inline size_t get_data_bytes() const { return data_bytes; }
+  inline size_t get_sketch_bytes() const { return sketch_bytes; }
+  inline HugePageMode get_huge_page_mode() const { return huge_pages; }
+
+  static constexpr size_t huge_page_size = 2 << 20;
+};
@@ -0,0 +1,110 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <string>
+
+#include "sketch_arena.h"
+
+/*
+ * Snapshot file format of the connected components sketches (see CCSketchAlg::write_snapshot).
+ * Unlike CCSketchAlg::write_binary, a snapshot stores the slab of the SketchArena exactly as it
+ * is laid out in memory, so that a SketchArena can map it from the file and use it in place.
+ *
+ *   SnapshotHeader
+ *   vertex section: for every vertex a uint32_t, the size of its edge set or dense_vertex,
+ *                   followed by the indices of its edge set (vec_ts)
+ *   padding up to slab_alignment
+ *   slab section:   SketchArena::get_slab(). Pages that are zero are left as holes
+ *
+ * Each section carries its XXH3 checksum. The header records the shape and bucket layout of the
+ * sketches, so a snapshot is only loaded by builds that lay out their buckets the same way.
+ */
+
+// the location and checksum of a section of a snapshot
+struct SnapshotSection {
+  uint64_t offset;    // bytes from the start of the file
+  uint64_t bytes;
+  uint64_t checksum;  // XXH3_64bits of the section
+};
+
+struct SnapshotHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t header_bytes;
+
+  // the graph
+  uint64_t seed;
+  uint64_t num_vertices;
+  double sketches_factor;
+
+  // the shape of the vertex sketches and the layout of their buckets
+  uint64_t num_samples;
+  uint64_t cols_per_sample;
+  uint64_t bkt_per_col;
+  uint64_t num_buckets;
+  uint64_t sketch_bytes;
+  uint32_t algorithm;
+  uint32_t index_width;
+  uint32_t depth_hashing;
+  uint32_t bucket_layout;
+  uint32_t hash_policy;
+  uint32_t padding;
+
+  SnapshotSection vertices;
+  SnapshotSection slab;
+  uint64_t header_checksum;  // of every byte before this field
+};
+
+class SnapshotException : public std::exception {
+ private:
+  std::string err_msg;
+ public:
+  SnapshotException(const std::string &file, const std::string &reason)
+      : err_msg("Snapshot " + file + ": " + reason) {}
+  virtual const char* what() const throw() {
+    return err_msg.c_str();
+  }
+};
+
+namespace Snapshot {
+  constexpr char magic[8] = {'G', 'Z', 'S', 'N', 'A', 'P', 'C', 'C'};
+  constexpr uint32_t version = 1;
+
+  // marks a vertex whose edges are held by its sketch in the vertex section
+  constexpr uint32_t dense_vertex = UINT32_MAX;
+
+  // the slab is aligned for any page size up to a huge page, so it may be mapped anywhere
+  constexpr size_t slab_alignment = SketchArena::huge_page_size;
+
+  uint64_t checksum(const void *data, size_t bytes);
+
+  // fill in the magic, version and description of the sketches of arena
+  void describe(SnapshotHeader &header, const SketchArena &arena);
+
+  // set header_checksum to the checksum of the rest of the header
+  void seal(SnapshotHeader &header);
+
+  /**
+   * Check that header is a valid header of this version whose sketches this build lays out the
+   * same way. Throws SnapshotException otherwise.
+   * @param header   the header read from the start of file
+   * @param file     the name of the snapshot, for error messages
+   */
+  void validate(const SnapshotHeader &header, const std::string &file);
+
+  // write or read bytes bytes at offset of the file fd. Throws SnapshotException on failure
+  void write_at(int fd, const void *data, size_t bytes, size_t offset, const std::string &file);
+  void read_at(int fd, void *data, size_t bytes, size_t offset, const std::string &file);
+
+  /**
+   * Write the slab of arena at section.offset of the file fd, leaving holes where its pages are
+   * zero, and set the size and checksum of section.
+   */
+  void write_slab(int fd, const SketchArena &arena, SnapshotSection &section,
+                  const std::string &file);
+
+  // check that arena was constructed with the shape described by header
+  void validate_arena(const SnapshotHeader &header, const SketchArena &arena,
+                      const std::string &file);
+}  // namespace Snapshot
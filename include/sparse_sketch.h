@@ -0,0 +1,44 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "sketch.h"
+
+/**
+ * Exact stand-in for the Sketch of a vector with few non-zero entries. Holds the set of indices
+ * that have been updated an odd number of times, so each update toggles one index. Since sketches
+ * are linear, a Sketch updated with this set is identical to one updated with the whole stream,
+ * which gives identical samples. Once the set grows too large the indices are moved into a full
+ * Sketch and the SparseSketch only records that it is dense.
+ */
+class SparseSketch {
+ private:
+  std::vector<vec_t> idxs;          // sorted set of the non-zero indices
+  std::atomic<bool> dense{false};   // true once the indices have been moved into a Sketch
+
+ public:
+  SparseSketch() = default;
+
+  /**
+   * Toggle a batch of indices in the set.
+   * @param updates      the point updates.
+   * @param num_updates  the number of updates in the batch.
+   */
+  void update_batch(const vec_t *updates, size_t num_updates);
+
+  /**
+   * Move the indices into a Sketch and mark this sketch dense. Further updates must be applied to
+   * the Sketch. The Sketch is written before it is marked dense, so a thread that observes
+   * is_dense() may update the Sketch without synchronizing with this one.
+   * @param sketch   Sketch of the vector. Must hold no updates that are not in the set
+   */
+  void densify(Sketch &sketch);
+
+  inline bool is_dense() const { return dense.load(std::memory_order_acquire); }
+  inline size_t size() const { return idxs.size(); }
+  inline const vec_t *data() const { return idxs.data(); }
+
+  // bytes of heap memory held by the set
+  inline size_t memory_bytes() const { return idxs.capacity() * sizeof(vec_t); }
+};
@@ -5,8 +5,6 @@
 #include <graph_stream.h>
 
 typedef uint64_t col_hash_t;
-static const auto& vec_hash = XXH3_64bits_withSeed;
-static const auto& col_hash = XXH3_64bits_withSeed;
 
 // Graph Stream Updates are parsed into the GraphUpdate type for more convinient processing
 struct GraphUpdate {
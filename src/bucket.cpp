@@ -0,0 +1,479 @@
+#include "bucket.h"
+
+#include <immintrin.h>
+
+#include <algorithm>
+#include <cstring>
+
+// The multi-lane kernels in this file compute XXH3Hash for several indices or seeds at once.
+// Because the results are identical to the scalar hash, sketches built with any kernel are
+// interchangeable.
+namespace {
+constexpr uint64_t xxh3_secret_bitflip = XXH3Hash::secret_bitflip;
+constexpr uint64_t xxh3_prime_mx2 = XXH3Hash::prime_mx2;
+constexpr uint64_t xxh3_input_len = XXH3Hash::input_len;
+
+// number of 64 bit lanes processed by one iteration of each vector kernel
+constexpr size_t avx2_lanes = 4;
+constexpr size_t avx512_lanes = 8;
+
+inline uint64_t xxh3_seed_bitflip(uint64_t seed) { return XXH3Hash::make_key(seed).keyed_secret; }
+
+/*
+ * Scalar kernels. These simply loop over the single index functions.
+ */
+void depths_by_seed_scalar(const vec_t update_idx, const uint64_t first_seed,
+                           const uint64_t seed_stride, const size_t num_seeds,
+                           const vec_hash_t max_depth, col_hash_t *depths) {
+  for (size_t i = 0; i < num_seeds; i++)
+    depths[i] = Bucket_Boruvka::get_index_depth(update_idx, first_seed + i * seed_stride,
+                                                max_depth);
+}
+
+void depths_by_idx_scalar(const vec_t *update_idxs, const size_t num_idxs, const uint64_t seed,
+                          const vec_hash_t max_depth, col_hash_t *depths) {
+  for (size_t i = 0; i < num_idxs; i++)
+    depths[i] = Bucket_Boruvka::get_index_depth(update_idxs[i], seed, max_depth);
+}
+
+void hashes_by_idx_scalar(const vec_t *idxs, const size_t num_idxs, const uint64_t seed,
+                          vec_hash_t *hashes) {
+  for (size_t i = 0; i < num_idxs; i++)
+    hashes[i] = Bucket_Boruvka::get_index_hash(idxs[i], seed);
+}
+
+/*
+ * AVX2 kernels. AVX2 has neither a 64 bit multiply nor a 64 bit count zeros instruction so
+ * the multiply is built from 32 bit products and the depth is extracted per lane.
+ */
+__attribute__((target("avx2"))) inline __m256i mul64_avx2(__m256i a, __m256i b) {
+  __m256i lo = _mm256_mul_epu32(a, b);
+  __m256i a_hi_b_lo = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), b);
+  __m256i a_lo_b_hi = _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32));
+  __m256i cross = _mm256_slli_epi64(_mm256_add_epi64(a_hi_b_lo, a_lo_b_hi), 32);
+  return _mm256_add_epi64(lo, cross);
+}
+
+__attribute__((target("avx2"))) inline __m256i rotl64_avx2(__m256i x, int r) {
+  return _mm256_or_si256(_mm256_slli_epi64(x, r), _mm256_srli_epi64(x, 64 - r));
+}
+
+__attribute__((target("avx2"))) inline __m256i seed_bitflip_avx2(__m256i seeds) {
+  // move bswap32 of the low half of each seed into the high half
+  const __m256i bswap_lo_to_hi = _mm256_setr_epi8(
+      -1, -1, -1, -1, 3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8,
+      -1, -1, -1, -1, 3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8);
+  seeds = _mm256_xor_si256(seeds, _mm256_shuffle_epi8(seeds, bswap_lo_to_hi));
+  return _mm256_sub_epi64(_mm256_set1_epi64x(xxh3_secret_bitflip), seeds);
+}
+
+__attribute__((target("avx2"))) inline __m256i xxh3_avx2(__m256i keys, __m256i bitflips) {
+  const __m256i mx2 = _mm256_set1_epi64x(xxh3_prime_mx2);
+  __m256i h = _mm256_xor_si256(_mm256_shuffle_epi32(keys, 0xB1), bitflips);  // rotl 32
+  h = _mm256_xor_si256(h, _mm256_xor_si256(rotl64_avx2(h, 49), rotl64_avx2(h, 24)));
+  h = mul64_avx2(h, mx2);
+  h = _mm256_xor_si256(
+      h, _mm256_add_epi64(_mm256_srli_epi64(h, 35), _mm256_set1_epi64x(xxh3_input_len)));
+  h = mul64_avx2(h, mx2);
+  return _mm256_xor_si256(h, _mm256_srli_epi64(h, 28));
+}
+
+__attribute__((target("avx2"))) inline void store_depths_avx2(__m256i h, const __m256i cap,
+                                                              col_hash_t *depths) {
+  alignas(32) uint64_t lanes[avx2_lanes];
+  _mm256_store_si256((__m256i *)lanes, _mm256_or_si256(h, cap));
+  for (size_t l = 0; l < avx2_lanes; l++) depths[l] = __builtin_ctzll(lanes[l]);
+}
+
+__attribute__((target("avx2")))
+void depths_by_seed_avx2(const vec_t update_idx, const uint64_t first_seed,
+                         const uint64_t seed_stride, const size_t num_seeds,
+                         const vec_hash_t max_depth, col_hash_t *depths) {
+  const __m256i key = _mm256_set1_epi64x(update_idx);
+  const __m256i cap = _mm256_set1_epi64x(1ull << max_depth);
+  const __m256i seed_step = _mm256_set1_epi64x(avx2_lanes * seed_stride);
+  __m256i seeds = _mm256_add_epi64(
+      _mm256_set1_epi64x(first_seed),
+      mul64_avx2(_mm256_setr_epi64x(0, 1, 2, 3), _mm256_set1_epi64x(seed_stride)));
+
+  size_t i = 0;
+  for (; i + avx2_lanes <= num_seeds; i += avx2_lanes) {
+    store_depths_avx2(xxh3_avx2(key, seed_bitflip_avx2(seeds)), cap, depths + i);
+    seeds = _mm256_add_epi64(seeds, seed_step);
+  }
+  depths_by_seed_scalar(update_idx, first_seed + i * seed_stride, seed_stride, num_seeds - i,
+                        max_depth, depths + i);
+}
+
+__attribute__((target("avx2")))
+void depths_by_idx_avx2(const vec_t *update_idxs, const size_t num_idxs, const uint64_t seed,
+                        const vec_hash_t max_depth, col_hash_t *depths) {
+  const __m256i bitflip = _mm256_set1_epi64x(xxh3_seed_bitflip(seed));
+  const __m256i cap = _mm256_set1_epi64x(1ull << max_depth);
+
+  size_t i = 0;
+  for (; i + avx2_lanes <= num_idxs; i += avx2_lanes) {
+    __m256i keys = _mm256_loadu_si256((const __m256i *)(update_idxs + i));
+    store_depths_avx2(xxh3_avx2(keys, bitflip), cap, depths + i);
+  }
+  depths_by_idx_scalar(update_idxs + i, num_idxs - i, seed, max_depth, depths + i);
+}
+
+__attribute__((target("avx2")))
+void hashes_by_idx_avx2(const vec_t *idxs, const size_t num_idxs, const uint64_t seed,
+                        vec_hash_t *hashes) {
+  const __m256i bitflip = _mm256_set1_epi64x(xxh3_seed_bitflip(seed));
+  alignas(32) uint64_t lanes[avx2_lanes];
+
+  size_t i = 0;
+  for (; i + avx2_lanes <= num_idxs; i += avx2_lanes) {
+    __m256i keys = _mm256_loadu_si256((const __m256i *)(idxs + i));
+    _mm256_store_si256((__m256i *)lanes, xxh3_avx2(keys, bitflip));
+    for (size_t l = 0; l < avx2_lanes; l++) hashes[i + l] = lanes[l];
+  }
+  hashes_by_idx_scalar(idxs + i, num_idxs - i, seed, hashes + i);
+}
+
+/*
+ * AVX-512 kernels. Uses the native 64 bit multiply (DQ), rotates (F), byte shuffle (BW), and
+ * computes depths as count trailing zeros through the leading zero count instruction (CD).
+ */
+#define AVX512_TARGET __attribute__((target("avx512f,avx512dq,avx512bw,avx512cd")))
+
+// GCC flags the _mm512_undefined_epi32() used inside its own intrinsic headers
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+AVX512_TARGET inline __m512i seed_bitflip_avx512(__m512i seeds) {
+  const __m512i bswap_lo_to_hi = _mm512_broadcast_i32x4(
+      _mm_setr_epi8(-1, -1, -1, -1, 3, 2, 1, 0, -1, -1, -1, -1, 11, 10, 9, 8));
+  seeds = _mm512_xor_si512(seeds, _mm512_shuffle_epi8(seeds, bswap_lo_to_hi));
+  return _mm512_sub_epi64(_mm512_set1_epi64(xxh3_secret_bitflip), seeds);
+}
+
+AVX512_TARGET inline __m512i xxh3_avx512(__m512i keys, __m512i bitflips) {
+  const __m512i mx2 = _mm512_set1_epi64(xxh3_prime_mx2);
+  __m512i h = _mm512_xor_si512(_mm512_rol_epi64(keys, 32), bitflips);
+  h = _mm512_ternarylogic_epi64(h, _mm512_rol_epi64(h, 49), _mm512_rol_epi64(h, 24), 0x96);
+  h = _mm512_mullo_epi64(h, mx2);
+  h = _mm512_xor_si512(
+      h, _mm512_add_epi64(_mm512_srli_epi64(h, 35), _mm512_set1_epi64(xxh3_input_len)));
+  h = _mm512_mullo_epi64(h, mx2);
+  return _mm512_xor_si512(h, _mm512_srli_epi64(h, 28));
+}
+
+// count trailing zeros of each lane: 63 - lzcnt(lowest set bit). Lanes are never zero.
+AVX512_TARGET inline __m512i depths_avx512(__m512i h, const __m512i cap) {
+  h = _mm512_or_si512(h, cap);
+  __m512i lowest = _mm512_and_si512(h, _mm512_sub_epi64(_mm512_setzero_si512(), h));
+  return _mm512_sub_epi64(_mm512_set1_epi64(63), _mm512_lzcnt_epi64(lowest));
+}
+
+AVX512_TARGET
+void depths_by_seed_avx512(const vec_t update_idx, const uint64_t first_seed,
+                           const uint64_t seed_stride, const size_t num_seeds,
+                           const vec_hash_t max_depth, col_hash_t *depths) {
+  const __m512i key = _mm512_set1_epi64(update_idx);
+  const __m512i cap = _mm512_set1_epi64(1ull << max_depth);
+  const __m512i seed_step = _mm512_set1_epi64(avx512_lanes * seed_stride);
+  __m512i seeds = _mm512_add_epi64(
+      _mm512_set1_epi64(first_seed),
+      _mm512_mullo_epi64(_mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7),
+                         _mm512_set1_epi64(seed_stride)));
+
+  size_t i = 0;
+  for (; i + avx512_lanes <= num_seeds; i += avx512_lanes) {
+    __m512i h = xxh3_avx512(key, seed_bitflip_avx512(seeds));
+    _mm512_storeu_si512(depths + i, depths_avx512(h, cap));
+    seeds = _mm512_add_epi64(seeds, seed_step);
+  }
+  depths_by_seed_scalar(update_idx, first_seed + i * seed_stride, seed_stride, num_seeds - i,
+                        max_depth, depths + i);
+}
+
+AVX512_TARGET
+void depths_by_idx_avx512(const vec_t *update_idxs, const size_t num_idxs, const uint64_t seed,
+                          const vec_hash_t max_depth, col_hash_t *depths) {
+  const __m512i bitflip = _mm512_set1_epi64(xxh3_seed_bitflip(seed));
+  const __m512i cap = _mm512_set1_epi64(1ull << max_depth);
+
+  size_t i = 0;
+  for (; i + avx512_lanes <= num_idxs; i += avx512_lanes) {
+    __m512i keys = _mm512_loadu_si512(update_idxs + i);
+    _mm512_storeu_si512(depths + i, depths_avx512(xxh3_avx512(keys, bitflip), cap));
+  }
+  depths_by_idx_scalar(update_idxs + i, num_idxs - i, seed, max_depth, depths + i);
+}
+
+AVX512_TARGET
+void hashes_by_idx_avx512(const vec_t *idxs, const size_t num_idxs, const uint64_t seed,
+                          vec_hash_t *hashes) {
+  const __m512i bitflip = _mm512_set1_epi64(xxh3_seed_bitflip(seed));
+  alignas(64) uint64_t lanes[avx512_lanes];
+
+  size_t i = 0;
+  for (; i + avx512_lanes <= num_idxs; i += avx512_lanes) {
+    __m512i keys = _mm512_loadu_si512(idxs + i);
+    _mm512_store_si512(lanes, xxh3_avx512(keys, bitflip));
+    for (size_t l = 0; l < avx512_lanes; l++) hashes[i + l] = lanes[l];
+  }
+  hashes_by_idx_scalar(idxs + i, num_idxs - i, seed, hashes + i);
+}
+
+#pragma GCC diagnostic pop
+#undef AVX512_TARGET
+
+struct HashKernelTable {
+  Bucket_Boruvka::HashKernel kernel;
+  decltype(&depths_by_seed_scalar) depths_by_seed;
+  decltype(&depths_by_idx_scalar) depths_by_idx;
+  decltype(&hashes_by_idx_scalar) hashes_by_idx;
+};
+
+constexpr HashKernelTable scalar_table = {Bucket_Boruvka::SCALAR_HASH, depths_by_seed_scalar,
+                                          depths_by_idx_scalar, hashes_by_idx_scalar};
+constexpr HashKernelTable avx2_table = {Bucket_Boruvka::AVX2_HASH, depths_by_seed_avx2,
+                                        depths_by_idx_avx2, hashes_by_idx_avx2};
+constexpr HashKernelTable avx512_table = {Bucket_Boruvka::AVX512_HASH, depths_by_seed_avx512,
+                                          depths_by_idx_avx512, hashes_by_idx_avx512};
+
+// Start with the scalar kernels (constant initialized so they are usable during static
+// initialization) and switch to the best kernel the CPU supports once it has been detected.
+HashKernelTable active_kernel = scalar_table;
+
+bool select_best_kernel() {
+  __builtin_cpu_init();
+  return Bucket_Boruvka::set_hash_kernel(Bucket_Boruvka::AVX512_HASH) ||
+         Bucket_Boruvka::set_hash_kernel(Bucket_Boruvka::AVX2_HASH);
+}
+const bool kernel_selected = select_best_kernel();
+}  // namespace
+
+bool Bucket_Boruvka::hash_kernel_supported(HashKernel kernel) {
+  switch (kernel) {
+    case SCALAR_HASH:
+      return true;
+    case AVX2_HASH:
+      return __builtin_cpu_supports("avx2");
+    case AVX512_HASH:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+             __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512cd");
+  }
+  return false;
+}
+
+bool Bucket_Boruvka::set_hash_kernel(HashKernel kernel) {
+  if (!hash_kernel_supported(kernel)) return false;
+
+  switch (kernel) {
+    case SCALAR_HASH: active_kernel = scalar_table; break;
+    case AVX2_HASH: active_kernel = avx2_table; break;
+    case AVX512_HASH: active_kernel = avx512_table; break;
+  }
+  return true;
+}
+
+Bucket_Boruvka::HashKernel Bucket_Boruvka::get_hash_kernel() { return active_kernel.kernel; }
+
+void Bucket_Boruvka::get_index_depths_kernel(const vec_t update_idx, const uint64_t first_seed,
+                                             const uint64_t seed_stride, const size_t num_seeds,
+                                             const vec_hash_t max_depth, col_hash_t *depths) {
+  active_kernel.depths_by_seed(update_idx, first_seed, seed_stride, num_seeds, max_depth, depths);
+}
+
+void Bucket_Boruvka::get_batch_depths_kernel(const vec_t *update_idxs, const size_t num_idxs,
+                                             const uint64_t seed_and_col,
+                                             const vec_hash_t max_depth, col_hash_t *depths) {
+  active_kernel.depths_by_idx(update_idxs, num_idxs, seed_and_col, max_depth, depths);
+}
+
+void Bucket_Boruvka::get_batch_hashes_kernel(const vec_t *idxs, const size_t num_idxs,
+                                             const uint64_t sketch_seed, vec_hash_t *hashes) {
+  active_kernel.hashes_by_idx(idxs, num_idxs, sketch_seed, hashes);
+}
+
+/*
+ * Bucket memory kernels. XORing two bucket arrays is the same as XORing their bytes, whatever
+ * the layout of the buckets, so merging and zeroing operate on raw byte ranges.
+ */
+namespace {
+/*
+ * Scalar kernels. These are the plain loops Sketch used before the vector kernels.
+ */
+void xor_bytes_scalar(void *dst, const void *src, size_t bytes) {
+  char *d = (char *)dst;
+  const char *s = (const char *)src;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t dw, sw;
+    memcpy(&dw, d + i, sizeof(uint64_t));
+    memcpy(&sw, s + i, sizeof(uint64_t));
+    dw ^= sw;
+    memcpy(d + i, &dw, sizeof(uint64_t));
+  }
+  for (; i < bytes; i++) d[i] ^= s[i];
+}
+
+// memset is already vectorized (or uses rep stosb) and beats an explicit store loop at every size
+// we measured, so all kernels share it for zeroing that should stay in cache.
+void zero_bytes_scalar(void *dst, size_t bytes) { memset(dst, 0, bytes); }
+
+/*
+ * AVX2 kernels. Process 4 vectors (128 bytes) per iteration to keep several loads in flight.
+ * The non-temporal zero writes aligned 32 byte vectors that bypass the cache.
+ */
+__attribute__((target("avx2")))
+void xor_bytes_avx2(void *dst, const void *src, size_t bytes) {
+  char *d = (char *)dst;
+  const char *s = (const char *)src;
+  size_t i = 0;
+  for (; i + 4 * sizeof(__m256i) <= bytes; i += 4 * sizeof(__m256i)) {
+    __m256i *dv = (__m256i *)(d + i);
+    const __m256i *sv = (const __m256i *)(s + i);
+    __m256i x0 = _mm256_xor_si256(_mm256_loadu_si256(dv + 0), _mm256_loadu_si256(sv + 0));
+    __m256i x1 = _mm256_xor_si256(_mm256_loadu_si256(dv + 1), _mm256_loadu_si256(sv + 1));
+    __m256i x2 = _mm256_xor_si256(_mm256_loadu_si256(dv + 2), _mm256_loadu_si256(sv + 2));
+    __m256i x3 = _mm256_xor_si256(_mm256_loadu_si256(dv + 3), _mm256_loadu_si256(sv + 3));
+    _mm256_storeu_si256(dv + 0, x0);
+    _mm256_storeu_si256(dv + 1, x1);
+    _mm256_storeu_si256(dv + 2, x2);
+    _mm256_storeu_si256(dv + 3, x3);
+  }
+  for (; i + sizeof(__m256i) <= bytes; i += sizeof(__m256i)) {
+    __m256i *dv = (__m256i *)(d + i);
+    _mm256_storeu_si256(
+        dv, _mm256_xor_si256(_mm256_loadu_si256(dv), _mm256_loadu_si256((const __m256i *)(s + i))));
+  }
+  xor_bytes_scalar(d + i, s + i, bytes - i);
+}
+
+__attribute__((target("avx2")))
+void zero_bytes_nt_avx2(void *dst, size_t bytes) {
+  char *d = (char *)dst;
+  size_t head = std::min(bytes, -uintptr_t(d) % sizeof(__m256i));
+  memset(d, 0, head);
+
+  const __m256i zero = _mm256_setzero_si256();
+  size_t i = head;
+  for (; i + sizeof(__m256i) <= bytes; i += sizeof(__m256i))
+    _mm256_stream_si256((__m256i *)(d + i), zero);
+  _mm_sfence();
+  memset(d + i, 0, bytes - i);
+}
+
+/*
+ * AVX-512 kernels. Ranges shorter than a vector are handled with masked loads and stores.
+ */
+#define AVX512_TARGET __attribute__((target("avx512f,avx512bw,bmi2")))
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+AVX512_TARGET
+void xor_bytes_avx512(void *dst, const void *src, size_t bytes) {
+  char *d = (char *)dst;
+  const char *s = (const char *)src;
+  size_t i = 0;
+  for (; i + 4 * sizeof(__m512i) <= bytes; i += 4 * sizeof(__m512i)) {
+    char *dv = d + i;
+    const char *sv = s + i;
+    __m512i x0 = _mm512_xor_si512(_mm512_loadu_si512(dv), _mm512_loadu_si512(sv));
+    __m512i x1 = _mm512_xor_si512(_mm512_loadu_si512(dv + 64), _mm512_loadu_si512(sv + 64));
+    __m512i x2 = _mm512_xor_si512(_mm512_loadu_si512(dv + 128), _mm512_loadu_si512(sv + 128));
+    __m512i x3 = _mm512_xor_si512(_mm512_loadu_si512(dv + 192), _mm512_loadu_si512(sv + 192));
+    _mm512_storeu_si512(dv, x0);
+    _mm512_storeu_si512(dv + 64, x1);
+    _mm512_storeu_si512(dv + 128, x2);
+    _mm512_storeu_si512(dv + 192, x3);
+  }
+  for (; i + sizeof(__m512i) <= bytes; i += sizeof(__m512i)) {
+    _mm512_storeu_si512(d + i,
+                        _mm512_xor_si512(_mm512_loadu_si512(d + i), _mm512_loadu_si512(s + i)));
+  }
+  if (i < bytes) {
+    __mmask64 tail = _bzhi_u64(~0ull, bytes - i);
+    __m512i x = _mm512_xor_si512(_mm512_maskz_loadu_epi8(tail, d + i),
+                                 _mm512_maskz_loadu_epi8(tail, s + i));
+    _mm512_mask_storeu_epi8(d + i, tail, x);
+  }
+}
+
+AVX512_TARGET
+void zero_bytes_nt_avx512(void *dst, size_t bytes) {
+  char *d = (char *)dst;
+  const __m512i zero = _mm512_setzero_si512();
+  size_t head = std::min(bytes, -uintptr_t(d) % sizeof(__m512i));
+  if (head > 0) _mm512_mask_storeu_epi8(d, _bzhi_u64(~0ull, head), zero);
+
+  size_t i = head;
+  for (; i + sizeof(__m512i) <= bytes; i += sizeof(__m512i))
+    _mm512_stream_si512((__m512i *)(d + i), zero);
+  _mm_sfence();
+  if (i < bytes) _mm512_mask_storeu_epi8(d + i, _bzhi_u64(~0ull, bytes - i), zero);
+}
+
+#pragma GCC diagnostic pop
+#undef AVX512_TARGET
+
+struct MergeKernelTable {
+  Bucket_Boruvka::MergeKernel kernel;
+  decltype(&xor_bytes_scalar) xor_bytes;
+  decltype(&zero_bytes_scalar) zero_bytes;
+  decltype(&zero_bytes_scalar) zero_bytes_nt;
+};
+
+constexpr MergeKernelTable scalar_merge_table = {Bucket_Boruvka::SCALAR_MERGE, xor_bytes_scalar,
+                                                 zero_bytes_scalar, zero_bytes_scalar};
+constexpr MergeKernelTable avx2_merge_table = {Bucket_Boruvka::AVX2_MERGE, xor_bytes_avx2,
+                                               zero_bytes_scalar, zero_bytes_nt_avx2};
+constexpr MergeKernelTable avx512_merge_table = {Bucket_Boruvka::AVX512_MERGE, xor_bytes_avx512,
+                                                 zero_bytes_scalar, zero_bytes_nt_avx512};
+
+MergeKernelTable active_merge_kernel = scalar_merge_table;
+
+bool select_best_merge_kernel() {
+  __builtin_cpu_init();
+  return Bucket_Boruvka::set_merge_kernel(Bucket_Boruvka::AVX512_MERGE) ||
+         Bucket_Boruvka::set_merge_kernel(Bucket_Boruvka::AVX2_MERGE);
+}
+const bool merge_kernel_selected = select_best_merge_kernel();
+}  // namespace
+
+bool Bucket_Boruvka::merge_kernel_supported(MergeKernel kernel) {
+  switch (kernel) {
+    case SCALAR_MERGE:
+      return true;
+    case AVX2_MERGE:
+      return __builtin_cpu_supports("avx2");
+    case AVX512_MERGE:
+      return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") &&
+             __builtin_cpu_supports("bmi2");
+  }
+  return false;
+}
+
+bool Bucket_Boruvka::set_merge_kernel(MergeKernel kernel) {
+  if (!merge_kernel_supported(kernel)) return false;
+
+  switch (kernel) {
+    case SCALAR_MERGE: active_merge_kernel = scalar_merge_table; break;
+    case AVX2_MERGE: active_merge_kernel = avx2_merge_table; break;
+    case AVX512_MERGE: active_merge_kernel = avx512_merge_table; break;
+  }
+  return true;
+}
+
+Bucket_Boruvka::MergeKernel Bucket_Boruvka::get_merge_kernel() {
+  return active_merge_kernel.kernel;
+}
+
+void Bucket_Boruvka::xor_bucket_memory(void *dst, const void *src, size_t bytes) {
+  active_merge_kernel.xor_bytes(dst, src, bytes);
+}
+
+void Bucket_Boruvka::zero_bucket_memory(void *dst, size_t bytes) {
+  if (bytes >= nontemporal_zero_bytes)
+    active_merge_kernel.zero_bytes_nt(dst, bytes);
+  else
+    active_merge_kernel.zero_bytes(dst, bytes);
+}
@@ -27,20 +27,79 @@ CCAlgConfiguration& CCAlgConfiguration::batch_factor(double factor) {
   return *this;
 }
 
+CCAlgConfiguration& CCAlgConfiguration::huge_pages(HugePageMode mode) {
+  _huge_pages = mode;
+  return *this;
+}
+
+CCAlgConfiguration& CCAlgConfiguration::sparse_sketch_factor(double factor) {
+  _sparse_sketch_factor = factor;
+  if (_sparse_sketch_factor < 0 || _sparse_sketch_factor > 1) {
+    std::cout << "sparse_sketch_factor=" << _sparse_sketch_factor << " is out of bounds. [0, 1]"
+              << "Defaulting to 0.125." << std::endl;
+    _sparse_sketch_factor = 0.125;
+  }
+  return *this;
+}
+
+CCAlgConfiguration& CCAlgConfiguration::sketch_algorithm(SketchAlgorithm algorithm) {
+  _sketch_algorithm = algorithm;
+  return *this;
+}
+
+CCAlgConfiguration& CCAlgConfiguration::narrow_indices(bool narrow) {
+  _narrow_indices = narrow;
+  return *this;
+}
+
+CCAlgConfiguration& CCAlgConfiguration::sliced_depths(bool sliced) {
+  _sliced_depths = sliced;
+  return *this;
+}
+
+CCAlgConfiguration& CCAlgConfiguration::direct_io(bool direct) {
+  _direct_io = direct;
+  return *this;
+}
+
 std::ostream& operator<< (std::ostream &out, const CCAlgConfiguration &conf) {
     out << "Connected Components Algorithm Configuration:" << std::endl;
-#ifdef L0_SAMPLING
-    out << " Sketching algorithm   = CubeSketch" << std::endl;
-#else
-    out << " Sketching algorithm   = CameoSketch" << std::endl;
-#endif
+    out << " Sketching algorithm   = "
+        << (conf._sketch_algorithm == CUBE_SKETCH ? "CubeSketch" : "CameoSketch") << std::endl;
 #ifdef NO_EAGER_DSU
     out << " Using Eager DSU       = False" << std::endl;
 #else
     out << " Using Eager DSU       = True" << std::endl;
+#endif
+#ifdef SOA_BUCKETS
+    out << " Bucket layout         = Structure of arrays";
+#else
+    out << " Bucket layout         = Array of structures";
+#endif
+#ifdef DEPTH_MAJOR_BUCKETS
+    out << ", depth-major" << std::endl;
+#elif defined(ROUND_MAJOR_BUCKETS)
+    out << ", round-major" << std::endl;
+#else
+    out << ", column-major" << std::endl;
+#endif
+#ifdef ATOMIC_MERGE
+    out << " Sketch merging        = Atomic XOR" << std::endl;
+#else
+    out << " Sketch merging        = Locked" << std::endl;
 #endif
     out << " Num sketches factor   = " << conf._sketches_factor << std::endl;
     out << " Batch size factor     = " << conf._batch_factor << std::endl;
+    out << " Sketch huge pages     = ";
+    switch (conf._huge_pages) {
+      case NO_HUGE_PAGES: out << "None" << std::endl; break;
+      case TRANSPARENT_HUGE_PAGES: out << "Transparent" << std::endl; break;
+      case EXPLICIT_HUGE_PAGES: out << "Explicit" << std::endl; break;
+    }
+    out << " Sparse sketch factor  = " << conf._sparse_sketch_factor << std::endl;
+    out << " Narrow bucket indices = " << (conf._narrow_indices ? "True" : "False") << std::endl;
+    out << " Sliced column depths  = " << (conf._sliced_depths ? "True" : "False") << std::endl;
+    out << " Direct checkpoint IO  = " << (conf._direct_io ? "True" : "False") << std::endl;
     out << " On disk data location = " << conf._disk_dir;
     return out;
   }
@@ -1,125 +1,729 @@
 #include "cc_sketch_alg.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <cstring>
 #include <iostream>
 #include <map>
 #include <random>
 #include <omp.h>
 #include <unordered_map>
+#include <unordered_set>
+
+constexpr size_t CCSketchAlg::num_sketch_mtx;
+constexpr node_id_t CCSketchAlg::forest_repair_factor;
+constexpr size_t CCSketchAlg::serial_chunk_bytes;
+constexpr char CCSketchAlg::delta_magic[8];
 
 CCSketchAlg::CCSketchAlg(node_id_t num_vertices, size_t seed, CCAlgConfiguration config)
-    : num_vertices(num_vertices), seed(seed), dsu(num_vertices), config(config) {
-  representatives = new std::set<node_id_t>();
-  sketches = new Sketch *[num_vertices];
+    : num_vertices(num_vertices),
+      seed(seed),
+      sketches(num_vertices, Sketch::calc_vector_length(num_vertices), seed,
+               Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor(),
+                                       config.get_sketch_algorithm()),
+               Sketch::calc_cols_per_sample(config.get_sketch_algorithm()),
+               config.get_huge_pages(), config.get_sketch_algorithm(),
+               calc_index_width(num_vertices, config),
+               config.get_sliced_depths() ? SLICED_DEPTHS : COLUMN_DEPTHS),
+      dsu(num_vertices),
+      spanning_forest(num_vertices),
+      config(config) {
+  sketch_mtx = new StoreMutex[num_sketch_mtx];
+  for (size_t i = 0; i < num_sketch_mtx; i++) sketch_mtx[i].init(false);
+
+  // a vertex keeps its exact edge set while it is smaller than a fraction of a sketch
+  max_sparse_size = config.get_sparse_sketch_factor() * sketches[0].bucket_array_bytes() /
+                    sizeof(vec_t);
+  sparse_sketches = new SparseSketch[num_vertices];
+
+  dirty_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
+  changed_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
+  dsu_valid = true;
+  shared_dsu_valid = true;
+}
 
-  vec_t sketch_vec_len = Sketch::calc_vector_length(num_vertices);
-  size_t sketch_num_samples = Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor());
+IndexWidth CCSketchAlg::calc_index_width(node_id_t num_vertices, CCAlgConfiguration config) {
+  // the largest vertex id is num_vertices - 1
+  if (config.get_narrow_indices() && num_vertices <= node_id_t(1) << narrow_endpoint_bits)
+    return NARROW_INDEX;
+  return WIDE_INDEX;
+}
 
-  for (node_id_t i = 0; i < num_vertices; ++i) {
-    representatives->insert(i);
-    sketches[i] = new Sketch(sketch_vec_len, seed, sketch_num_samples);
+const Sketch &CCSketchAlg::vertex_sketch(node_id_t v, std::unique_ptr<Sketch> &scratch) const {
+  if (!is_sparse(v)) return sketches[v];
+  if (scratch == nullptr) scratch.reset(new Sketch(sketches.get_params()));
+  scratch->zero_contents();
+  scratch->update_batch(sparse_sketches[v].data(), sparse_sketches[v].size());
+  return *scratch;
+}
+
+void CCSketchAlg::clear_dirty() {
+  for (node_id_t w = 0; w < (num_vertices + 63) / 64; w++)
+    dirty_vertices[w].store(0, std::memory_order_relaxed);
+}
+
+void CCSketchAlg::clear_changed() {
+  for (node_id_t w = 0; w < (num_vertices + 63) / 64; w++)
+    changed_vertices[w].store(0, std::memory_order_relaxed);
+}
+
+void CCSketchAlg::set_checkpoint_base(const std::string &file, uint64_t header_bytes,
+                                      uint64_t header_checksum,
+                                      const std::vector<node_id_t> &vertices,
+                                      const std::vector<SerializedChunk> &chunks) {
+  checkpoint_base.reset(new CheckpointBase());
+  checkpoint_base->file = file;
+  checkpoint_base->header_bytes = header_bytes;
+  checkpoint_base->header_checksum = header_checksum;
+  checkpoint_base->offsets.assign(num_vertices, 0);
+  checkpoint_base->num_deltas = 0;
+  size_t sketch_bytes = sketches[0].serialized_bytes();
+  for (size_t c = 0; c + 1 < chunks.size(); c++) {
+    for (size_t i = chunks[c].first_vertex; i < chunks[c + 1].first_vertex; i++)
+      checkpoint_base->offsets[vertices[i]] =
+          chunks[c].offset + (i - chunks[c].first_vertex) * sketch_bytes;
   }
+  clear_dirty();
+}
 
-  spanning_forest = new std::unordered_set<node_id_t>[num_vertices];
-  spanning_forest_mtx = new std::mutex[num_vertices];
-  dsu_valid = true;
-  shared_dsu_valid = true;
+// read the list of vertices and the chunk table that follow the header of a file of chunked
+// sketches, checking that they are well formed
+static void read_chunk_table(std::istream &binary_in, node_id_t num_vertices,
+                             const std::string &input_file, std::vector<node_id_t> &vertices,
+                             std::vector<SerializedChunk> &chunks) {
+  node_id_t num_serialized = 0;
+  binary_in.read((char *)&num_serialized, sizeof(num_serialized));
+  if (!binary_in || num_serialized > num_vertices)
+    throw FileIOException(input_file, "malformed header");
+  vertices.resize(num_serialized);
+  binary_in.read((char *)vertices.data(), num_serialized * sizeof(node_id_t));
+  node_id_t num_chunks = 0;
+  binary_in.read((char *)&num_chunks, sizeof(num_chunks));
+  if (!binary_in || num_chunks > num_serialized)
+    throw FileIOException(input_file, "malformed header");
+  chunks.resize(num_chunks + 1);
+  binary_in.read((char *)chunks.data(), chunks.size() * sizeof(SerializedChunk));
+  if (!binary_in) throw FileIOException(input_file, "malformed header");
+
+  for (node_id_t v : vertices) {
+    if (v >= num_vertices) throw FileIOException(input_file, "malformed vertices");
+  }
+  for (size_t c = 0; c + 1 < chunks.size(); c++) {
+    if (chunks[c].first_vertex > chunks[c + 1].first_vertex ||
+        chunks[c].offset > chunks[c + 1].offset)
+      throw FileIOException(input_file, "malformed chunks");
+  }
+  if (chunks.back().first_vertex != vertices.size())
+    throw FileIOException(input_file, "malformed chunks");
+}
+
+// the files of write_binary start with these. The version changes with their format
+static constexpr char serial_magic[8] = {'G', 'Z', 'S', 'K', 'E', 'T', 'C', 'H'};
+static constexpr uint32_t serial_version = 1;
+
+// the header of a file written by write_binary
+struct SerializedHeader {
+  char magic[8] = {};
+  uint32_t version = 0;
+  size_t seed = 0;
+  node_id_t num_vertices = 0;
+  double sketches_factor = 0;
+  SerialType serial_type = FULL;
+  uint32_t algorithm = CAMEO_SKETCH;
+  uint32_t index_width = WIDE_INDEX;
+  uint32_t depth_hashing = COLUMN_DEPTHS;
+  uint32_t hash_policy = 0;
+};
+
+// throw FileIOException if the sketches of file, described by header, are not of the shape of
+// params or were hashed under another policy. Such sketches would be read without error but
+// could not be sampled
+template <class Header>
+static void check_sketch_params(const Header &header, const SketchParams &params,
+                                const std::string &file) {
+  if (header.algorithm != params.algorithm)
+    throw FileIOException(file, "written with a different sketch algorithm");
+  if (header.index_width != params.index_width)
+    throw FileIOException(file, "written with a different index width");
+  if (header.depth_hashing != params.depth_hashing)
+    throw FileIOException(file, "written with a different depth hashing");
+  if (header.hash_policy != sketch_hash_policy)
+    throw FileIOException(file, "written by a build with a different hash policy");
+}
+
+// read the header of the file written by write_binary open as fd, and the list of the vertices
+// it holds sketches of and the chunks of those sketches
+static void read_serialized_header(int fd, const std::string &input_file,
+                                   SerializedHeader &header, std::vector<node_id_t> &vertices,
+                                   std::vector<SerializedChunk> &chunks) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) throw FileIOException(input_file, std::strerror(errno));
+  FileChunkReader header_chunk(fd, -1, 0, file_stat.st_size);
+  std::istream binary_in(&header_chunk);
+  binary_in.read(header.magic, sizeof(header.magic));
+  binary_in.read((char *)&header.version, sizeof(header.version));
+  if (!binary_in || std::memcmp(header.magic, serial_magic, sizeof(serial_magic)) != 0)
+    throw FileIOException(input_file, "not written by write_binary");
+  if (header.version != serial_version)
+    throw FileIOException(input_file, "unsupported version " + std::to_string(header.version));
+  binary_in.read((char *)&header.seed, sizeof(header.seed));
+  binary_in.read((char *)&header.num_vertices, sizeof(header.num_vertices));
+  binary_in.read((char *)&header.sketches_factor, sizeof(header.sketches_factor));
+  binary_in.read((char *)&header.serial_type, sizeof(header.serial_type));
+  if (!binary_in || (header.serial_type != FULL && header.serial_type != RANGE &&
+                     header.serial_type != SPARSE))
+    throw FileIOException(input_file, "unknown serial type");
+  binary_in.read((char *)&header.algorithm, sizeof(header.algorithm));
+  binary_in.read((char *)&header.index_width, sizeof(header.index_width));
+  binary_in.read((char *)&header.depth_hashing, sizeof(header.depth_hashing));
+  binary_in.read((char *)&header.hash_policy, sizeof(header.hash_policy));
+
+  // only the vertices that were not null are serialized, in chunks
+  read_chunk_table(binary_in, header.num_vertices, input_file, vertices, chunks);
+}
+
+template <class ReadVertex>
+void CCSketchAlg::read_sketch_chunks(int fd, int direct_fd, const std::string &input_file,
+                                     const std::vector<node_id_t> &vertices,
+                                     const std::vector<SerializedChunk> &chunks,
+                                     ReadVertex &&read_vertex) {
+  int error = 0;
+  bool corrupt = false;
+#pragma omp parallel
+  {
+    std::unique_ptr<Sketch> scratch(new Sketch(sketches.get_params()));
+#pragma omp for schedule(dynamic, 1)
+    for (size_t c = 0; c < chunks.size() - 1; c++) {
+      FileChunkReader chunk(fd, direct_fd, chunks[c].offset, chunks[c + 1].offset);
+      std::istream binary_in(&chunk);
+      // a sketch read from a stream that failed would be garbage, not merely empty
+      for (size_t i = chunks[c].first_vertex; i < chunks[c + 1].first_vertex && binary_in; i++)
+        read_vertex(vertices[i], binary_in, *scratch);
+      if (!binary_in) {
+#pragma omp critical
+        {
+          if (chunk.error() != 0) error = chunk.error();
+          else corrupt = true;
+        }
+      }
+    }
+  }
+  if (error != 0) throw FileIOException(input_file, std::strerror(error));
+  if (corrupt) throw FileIOException(input_file, "truncated or corrupt");
 }
 
 CCSketchAlg *CCSketchAlg::construct_from_serialized_data(const std::string &input_file,
                                                         CCAlgConfiguration config) {
-  double sketches_factor;
-  auto binary_in = std::ifstream(input_file, std::ios::binary);
-  size_t seed;
-  node_id_t num_vertices;
-  binary_in.read((char *)&seed, sizeof(seed));
-  binary_in.read((char *)&num_vertices, sizeof(num_vertices));
-  binary_in.read((char *)&sketches_factor, sizeof(sketches_factor));
+  int fd = open(input_file.c_str(), O_RDONLY);
+  if (fd < 0) throw FileIOException(input_file, std::strerror(errno));
+  int direct_fd = config.get_direct_io() ? ChunkedFile::open_direct(input_file, O_RDONLY) : -1;
+
+  CCSketchAlg *alg = nullptr;
+  try {
+    SerializedHeader header;
+    std::vector<node_id_t> materialized;
+    std::vector<SerializedChunk> chunks;
+    read_serialized_header(fd, input_file, header, materialized, chunks);
+    size_t seed = header.seed;
+    node_id_t num_vertices = header.num_vertices;
+    double sketches_factor = header.sketches_factor;
+    SerialType serial_type = header.serial_type;
+
+    config.sketches_factor(sketches_factor);
+    alg = new CCSketchAlg(num_vertices, seed, config);
+    check_sketch_params(header, alg->sketches.get_params(), input_file);
+    alg->read_sketch_chunks(fd, direct_fd, input_file, materialized, chunks,
+                            [&](node_id_t v, std::istream &sketch_in, Sketch &) {
+                              alg->sketches[v].deserialize(sketch_in, serial_type);
+                              alg->sparse_sketches[v].densify(alg->sketches[v]);
+                            });
+    alg->dsu_valid = false;
+    alg->shared_dsu_valid = false;
+    alg->warm_start_valid = false;
+
+    if (serial_type == FULL) {
+      // the sketches of a FULL file may be found without reading it
+      std::vector<char> header(chunks[0].offset);
+      int error = ChunkedFile::read_at(fd, header.data(), header.size(), 0);
+      if (error != 0) throw FileIOException(input_file, std::strerror(error));
+      alg->set_checkpoint_base(input_file, header.size(),
+                               Snapshot::checksum(header.data(), header.size()), materialized,
+                               chunks);
+    }
+  } catch (...) {
+    delete alg;
+    close(fd);
+    if (direct_fd >= 0) close(direct_fd);
+    throw;
+  }
+  close(fd);
+  if (direct_fd >= 0) close(direct_fd);
+  return alg;
+}
 
-  config.sketches_factor(sketches_factor);
+CCSketchAlg *CCSketchAlg::construct_from_checkpoints(const std::string &base_file,
+                                                     const std::vector<std::string> &delta_files,
+                                                     CCAlgConfiguration config) {
+  CCSketchAlg *alg = construct_from_serialized_data(base_file, config);
+  try {
+    if (alg->checkpoint_base == nullptr && !delta_files.empty())
+      throw FileIOException(base_file, "deltas are written against FULL checkpoints");
+
+    // the newest delta of a vertex holds its sketch, so read the newest delta first
+    std::vector<bool> restored(alg->num_vertices, false);
+    for (size_t d = delta_files.size(); d-- > 0;)
+      alg->apply_delta(delta_files[d], d + 1, restored);
+    if (alg->checkpoint_base != nullptr) alg->checkpoint_base->num_deltas = delta_files.size();
+  } catch (...) {
+    delete alg;
+    throw;
+  }
+  return alg;
+}
 
-  return new CCSketchAlg(num_vertices, seed, binary_in, config);
+void CCSketchAlg::apply_delta(const std::string &delta_file, uint64_t sequence,
+                              std::vector<bool> &restored) {
+  int fd = open(delta_file.c_str(), O_RDONLY);
+  if (fd < 0) throw FileIOException(delta_file, std::strerror(errno));
+  int direct_fd = config._direct_io ? ChunkedFile::open_direct(delta_file, O_RDONLY) : -1;
+
+  try {
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) throw FileIOException(delta_file, std::strerror(errno));
+    FileChunkReader header_chunk(fd, -1, 0, file_stat.st_size);
+    std::istream binary_in(&header_chunk);
+    DeltaHeader header;
+    binary_in.read((char *)&header, sizeof(header));
+    if (!binary_in || std::memcmp(header.magic, delta_magic, sizeof(delta_magic)) != 0)
+      throw FileIOException(delta_file, "not a delta checkpoint");
+    if (header.seed != seed || header.num_vertices != num_vertices ||
+        header.base_header_bytes != checkpoint_base->header_bytes ||
+        header.base_checksum != checkpoint_base->header_checksum)
+      throw FileIOException(delta_file, "written against a different base");
+    if (header.sequence != sequence)
+      throw FileIOException(delta_file, "is delta " + std::to_string(header.sequence) +
+                                            " of its base, not " + std::to_string(sequence));
+    check_sketch_params(header, sketches.get_params(), delta_file);
+
+    std::vector<node_id_t> vertices;
+    std::vector<SerializedChunk> chunks;
+    read_chunk_table(binary_in, num_vertices, delta_file, vertices, chunks);
+    read_sketch_chunks(fd, direct_fd, delta_file, vertices, chunks,
+                       [&](node_id_t v, std::istream &delta_in, Sketch &delta) {
+                         delta.deserialize(delta_in, SPARSE);
+                         if (!delta_in || restored[v]) return;
+                         // the vertex holds its sketch in the base
+                         if (is_sparse(v)) sparse_sketches[v].densify(sketches[v]);
+                         sketches[v].merge(delta);
+                       });
+    for (node_id_t v : vertices) restored[v] = true;
+  } catch (...) {
+    close(fd);
+    if (direct_fd >= 0) close(direct_fd);
+    throw;
+  }
+  close(fd);
+  if (direct_fd >= 0) close(direct_fd);
 }
 
-CCSketchAlg::CCSketchAlg(node_id_t num_vertices, size_t seed, std::ifstream &binary_stream,
+void CCSketchAlg::merge_serialized_data(const std::string &input_file) {
+  if (update_locked) throw UpdateLockedException();
+  int fd = open(input_file.c_str(), O_RDONLY);
+  if (fd < 0) throw FileIOException(input_file, std::strerror(errno));
+  int direct_fd = config._direct_io ? ChunkedFile::open_direct(input_file, O_RDONLY) : -1;
+
+  try {
+    SerializedHeader header;
+    std::vector<node_id_t> vertices;
+    std::vector<SerializedChunk> chunks;
+    read_serialized_header(fd, input_file, header, vertices, chunks);
+    if (header.seed != seed || header.num_vertices != num_vertices ||
+        header.sketches_factor != config._sketches_factor)
+      throw FileIOException(input_file, "holds the sketches of a different graph");
+    check_sketch_params(header, sketches.get_params(), input_file);
+
+    // every vertex is in one chunk, so the threads merge into different sketches
+    read_sketch_chunks(fd, direct_fd, input_file, vertices, chunks,
+                       [&](node_id_t v, std::istream &sketch_in, Sketch &sketch) {
+                         sketch.deserialize(sketch_in, header.serial_type);
+                         if (!sketch_in) return;
+                         mark_dirty(v);
+                         sparse_sketches[v].densify(sketches[v]);
+                         sketches[v].merge(sketch);
+                       });
+  } catch (...) {
+    close(fd);
+    if (direct_fd >= 0) close(direct_fd);
+    throw;
+  }
+  close(fd);
+  if (direct_fd >= 0) close(direct_fd);
+  dsu_valid = false;
+  shared_dsu_valid = false;
+  warm_start_valid = false;
+}
+
+void CCSketchAlg::merge_serialized_files(const std::vector<std::string> &input_files,
+                                         const std::string &output_file, SerialType type,
+                                         CCAlgConfiguration config) {
+  if (input_files.empty()) throw FileIOException(output_file, "no files to merge");
+  std::unique_ptr<CCSketchAlg> alg(construct_from_serialized_data(input_files[0], config));
+  for (size_t i = 1; i < input_files.size(); i++) alg->merge_serialized_data(input_files[i]);
+  alg->write_binary(output_file, type);
+}
+
+CCSketchAlg *CCSketchAlg::construct_from_snapshot(const std::string &snapshot_file,
+                                                 CCAlgConfiguration config, bool verify_buckets) {
+  int fd = open(snapshot_file.c_str(), O_RDONLY);
+  if (fd < 0) throw SnapshotException(snapshot_file, std::strerror(errno));
+
+  CCSketchAlg *alg = nullptr;
+  try {
+    SnapshotHeader header;
+    Snapshot::read_at(fd, &header, sizeof(header), 0, snapshot_file);
+    Snapshot::validate(header, snapshot_file);
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 ||
+        size_t(file_stat.st_size) < header.slab.offset + header.slab.bytes)
+      throw SnapshotException(snapshot_file, "truncated");
+
+    // the sketches must have the shape they were written with
+    config.sketches_factor(header.sketches_factor)
+        .sketch_algorithm((SketchAlgorithm)header.algorithm)
+        .narrow_indices(header.index_width == NARROW_INDEX)
+        .sliced_depths(header.depth_hashing == SLICED_DEPTHS);
+    alg = new CCSketchAlg(header, fd, snapshot_file, config);
+
+    if (verify_buckets && Snapshot::checksum(alg->sketches.get_slab(), header.slab.bytes) !=
+                              header.slab.checksum)
+      throw SnapshotException(snapshot_file, "sketch checksum mismatch");
+  } catch (...) {
+    delete alg;
+    close(fd);
+    throw;
+  }
+  // the mapping holds its own reference to the file
+  close(fd);
+  return alg;
+}
+
+CCSketchAlg::CCSketchAlg(const SnapshotHeader &header, int fd, const std::string &snapshot_file,
                          CCAlgConfiguration config)
-    : num_vertices(num_vertices), seed(seed), dsu(num_vertices), config(config) {
-  representatives = new std::set<node_id_t>();
-  sketches = new Sketch *[num_vertices];
+    : num_vertices(header.num_vertices),
+      seed(header.seed),
+      sketches(fd, header.slab.offset, header.num_vertices,
+               Sketch::calc_vector_length(header.num_vertices), header.seed, header.num_samples,
+               header.cols_per_sample, config.get_sketch_algorithm(),
+               calc_index_width(header.num_vertices, config),
+               config.get_sliced_depths() ? SLICED_DEPTHS : COLUMN_DEPTHS),
+      dsu(header.num_vertices),
+      spanning_forest(header.num_vertices),
+      config(config) {
+  Snapshot::validate_arena(header, sketches, snapshot_file);
+
+  // read and check the edge sets of the sparse vertices before allocating anything
+  std::vector<char> vertex_data(header.vertices.bytes);
+  Snapshot::read_at(fd, vertex_data.data(), vertex_data.size(), header.vertices.offset,
+                    snapshot_file);
+  if (Snapshot::checksum(vertex_data.data(), vertex_data.size()) != header.vertices.checksum)
+    throw SnapshotException(snapshot_file, "vertex checksum mismatch");
+  size_t pos = 0;
+  for (node_id_t v = 0; v < num_vertices; ++v) {
+    uint32_t set_size = Snapshot::dense_vertex;
+    if (pos + sizeof(set_size) <= vertex_data.size())
+      std::memcpy(&set_size, &vertex_data[pos], sizeof(set_size));
+    pos += sizeof(set_size) + (set_size == Snapshot::dense_vertex ? 0 : set_size * sizeof(vec_t));
+  }
+  if (pos != vertex_data.size()) throw SnapshotException(snapshot_file, "malformed vertices");
+
+  sketch_mtx = new StoreMutex[num_sketch_mtx];
+  for (size_t i = 0; i < num_sketch_mtx; i++) sketch_mtx[i].init(false);
+  max_sparse_size = config.get_sparse_sketch_factor() * sketches[0].bucket_array_bytes() /
+                    sizeof(vec_t);
+  sparse_sketches = new SparseSketch[num_vertices];
+
+  // dense vertices are held by the mapped sketches, the sketches of the others are zero
+  pos = 0;
+  std::vector<vec_t> idxs;
+  for (node_id_t v = 0; v < num_vertices; ++v) {
+    uint32_t set_size;
+    std::memcpy(&set_size, &vertex_data[pos], sizeof(set_size));
+    pos += sizeof(set_size);
+    if (set_size == Snapshot::dense_vertex) {
+      sparse_sketches[v].densify(sketches[v]);
+      continue;
+    }
+    idxs.resize(set_size);
+    std::memcpy(idxs.data(), &vertex_data[pos], set_size * sizeof(vec_t));
+    pos += set_size * sizeof(vec_t);
+    sparse_sketches[v].update_batch(idxs.data(), set_size);
+  }
 
-  vec_t sketch_vec_len = Sketch::calc_vector_length(num_vertices);
-  size_t sketch_num_samples = Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor());
+  dirty_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
+  changed_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
+  dsu_valid = false;
+  shared_dsu_valid = false;
+  warm_start_valid = false;
+}
 
-  for (node_id_t i = 0; i < num_vertices; ++i) {
-    representatives->insert(i);
-    sketches[i] = new Sketch(sketch_vec_len, seed, binary_stream, sketch_num_samples);
+// the locks of a shared store follow its header, aligned to a cache line
+static size_t shared_locks_offset() { return (sizeof(SharedStoreHeader) + 63) / 64 * 64; }
+
+CCSketchAlg::CCSketchAlg(node_id_t num_vertices, size_t seed, size_t num_samples,
+                         size_t cols_per_sample, int fd, SharedStoreHeader *store,
+                         const std::string &store_name, bool create, CCAlgConfiguration config)
+    : num_vertices(num_vertices),
+      seed(seed),
+      sketches(fd, SharedStore::slab_offset, num_vertices,
+               Sketch::calc_vector_length(num_vertices), seed, num_samples, cols_per_sample,
+               config.get_sketch_algorithm(), calc_index_width(num_vertices, config),
+               config.get_sliced_depths() ? SLICED_DEPTHS : COLUMN_DEPTHS, true),
+      shared_store(store),
+      dsu(num_vertices),
+      spanning_forest(num_vertices),
+      config(config) {
+  static_assert(sizeof(SharedStoreHeader) + 63 + num_sketch_mtx * sizeof(StoreMutex) <=
+                    SharedStore::slab_offset,
+                "the header and locks of a shared store precede its slab");
+  SharedStoreHeader &header = *shared_store;
+  if (create) {
+    // the arena mapped the slab before the segment could hold it, but touched none of it
+    if (ftruncate(fd, SharedStore::slab_offset + sketches.get_data_bytes()) != 0)
+      throw SharedStoreException(store_name, std::strerror(errno));
+    std::memcpy(header.magic, SharedStore::magic, sizeof(header.magic));
+    header.version = SharedStore::version;
+    header.num_locks = num_sketch_mtx;
+    header.locks_offset = shared_locks_offset();
+    Snapshot::describe(header.sketches, sketches);
+    header.sketches.seed = seed;
+    header.sketches.num_vertices = num_vertices;
+    header.sketches.sketches_factor = config._sketches_factor;
+    header.sketches.vertices = {0, 0, Snapshot::checksum(nullptr, 0)};
+    header.sketches.slab = {SharedStore::slab_offset, sketches.get_data_bytes(), 0};
+    Snapshot::seal(header.sketches);
+    for (size_t i = 0; i < num_sketch_mtx; i++) SharedStore::locks(shared_store)[i].init(true);
+  } else {
+    try {
+      Snapshot::validate_arena(header.sketches, sketches, store_name);
+    } catch (const SnapshotException &e) {
+      throw SharedStoreException(store_name, e.what());
+    }
+    if (header.num_locks != num_sketch_mtx || header.locks_offset != shared_locks_offset())
+      throw SharedStoreException(store_name, "locks do not match");
   }
-  binary_stream.close();
+  sketch_mtx = SharedStore::locks(shared_store);
+
+  // every vertex of a store holds its sketch, the other processes cannot see an edge set
+  max_sparse_size = 0;
+  sparse_sketches = new SparseSketch[num_vertices];
+  for (node_id_t v = 0; v < num_vertices; ++v) sparse_sketches[v].densify(sketches[v]);
 
-  spanning_forest = new std::unordered_set<node_id_t>[num_vertices];
-  spanning_forest_mtx = new std::mutex[num_vertices];
+  dirty_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
+  changed_vertices = new std::atomic<uint64_t>[(num_vertices + 63) / 64]();
   dsu_valid = false;
   shared_dsu_valid = false;
+  warm_start_valid = false;
+  if (create) header.ready.store(1, std::memory_order_release);
+}
+
+CCSketchAlg *CCSketchAlg::create_shared_store(const std::string &store_name,
+                                              node_id_t num_vertices, size_t seed,
+                                              CCAlgConfiguration config) {
+  int fd = SharedStore::open(store_name, true);
+  SharedStoreHeader *store = nullptr;
+  CCSketchAlg *alg = nullptr;
+  try {
+    store = SharedStore::map_header(fd, store_name);
+    alg = new CCSketchAlg(
+        num_vertices, seed,
+        Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor(),
+                                config.get_sketch_algorithm()),
+        Sketch::calc_cols_per_sample(config.get_sketch_algorithm()), fd, store, store_name, true,
+        config);
+  } catch (...) {
+    if (store != nullptr) SharedStore::unmap_header(store);
+    close(fd);
+    shm_unlink(store_name.c_str());
+    throw;
+  }
+  close(fd);
+  return alg;
+}
+
+CCSketchAlg *CCSketchAlg::attach_shared_store(const std::string &store_name,
+                                              CCAlgConfiguration config) {
+  int fd = SharedStore::open(store_name, false);
+  SharedStoreHeader *store = nullptr;
+  CCSketchAlg *alg = nullptr;
+  try {
+    store = SharedStore::map_header(fd, store_name);
+    SharedStore::validate(*store, fd, store_name);
+
+    // the sketches must have the shape they were created with
+    const SnapshotHeader &header = store->sketches;
+    config.sketches_factor(header.sketches_factor)
+        .sketch_algorithm((SketchAlgorithm)header.algorithm)
+        .narrow_indices(header.index_width == NARROW_INDEX)
+        .sliced_depths(header.depth_hashing == SLICED_DEPTHS);
+    alg = new CCSketchAlg(header.num_vertices, header.seed, header.num_samples,
+                          header.cols_per_sample, fd, store, store_name, false, config);
+  } catch (...) {
+    if (store != nullptr) SharedStore::unmap_header(store);
+    close(fd);
+    throw;
+  }
+  close(fd);
+  return alg;
 }
 
 CCSketchAlg::~CCSketchAlg() {
-  for (size_t i = 0; i < num_vertices; ++i) delete sketches[i];
-  delete[] sketches;
+  if (shared_store != nullptr) {
+    // the locks belong to the store
+    SharedStore::unmap_header(shared_store);
+  } else {
+    for (size_t i = 0; i < num_sketch_mtx; i++) sketch_mtx[i].destroy();
+    delete[] sketch_mtx;
+  }
+  delete[] sparse_sketches;
   if (delta_sketches != nullptr) {
-    for (size_t i = 0; i < num_delta_sketches; i++) delete delta_sketches[i];
+    for (size_t i = 0; i < num_delta_sketches; i++) {
+      delete delta_sketches[i];
+      delete[] delta_touched[i];
+    }
     delete[] delta_sketches;
+    delete[] delta_touched;
   }
 
-  delete representatives;
-  delete[] spanning_forest;
-  delete[] spanning_forest_mtx;
+  delete[] dirty_vertices;
+  delete[] changed_vertices;
 }
 
 void CCSketchAlg::pre_insert(GraphUpdate upd, int /* thr_id */) {
 #ifdef NO_EAGER_DSU
-  (void)upd;
   // reason we have an if statement: avoiding cache coherency issues
   unlikely_if(dsu_valid) {
     dsu_valid = false;
     shared_dsu_valid = false;
   }
+  // the next query starts Boruvka from the trees of the spanning forest, which must only hold
+  // edges of the graph
+  if (warm_start_valid) spanning_forest.erase(upd.edge);
 #else
   if (dsu_valid) {
-    Edge edge = upd.edge;
-    auto src = std::min(edge.src, edge.dst);
-    auto dst = std::max(edge.src, edge.dst);
-    std::lock_guard<std::mutex> sflock(spanning_forest_mtx[src]);
-    if (dsu.merge(src, dst).merged) {
-      // this edge adds new connectivity information so add to spanning forest
-      spanning_forest[src].insert(dst);
-    }
-    else if (spanning_forest[src].find(dst) != spanning_forest[src].end()) {
-      // this update deletes one of our spanning forest edges so mark dsu invalid
-      dsu_valid = false;
+    Edge edge = {std::min(upd.edge.src, upd.edge.dst), std::max(upd.edge.src, upd.edge.dst)};
+    // the edge is put in the forest before the merge can be seen, so that a deletion of it that
+    // finds its endpoints connected also finds it in the forest. If the forest already holds the
+    // edge, a deletion of it is racing with its insertion
+    if (dsu.find_root(edge.src) != dsu.find_root(edge.dst) && spanning_forest.insert(edge)) {
+      // unless another update connected the endpoints first, this edge adds new connectivity
+      // information and stays in the spanning forest
+      if (!dsu.merge(edge.src, edge.dst).merged) spanning_forest.erase(edge);
+    }
+    else if (spanning_forest.erase(edge)) {
+      // this update deletes one of our spanning forest edges. The next query looks for edges to
+      // replace the deleted ones, unless there are too many of them to be worth it
+      std::lock_guard<std::mutex> lk(deleted_forest_mtx);
+      if (deleted_forest_edges.size() < num_vertices / forest_repair_factor)
+        deleted_forest_edges.push_back(edge);
+      else
+        dsu_valid = false;
       shared_dsu_valid = false;
     }
   }
+  else if (warm_start_valid) {
+    // the next query starts Boruvka from the trees of the spanning forest, which must only hold
+    // edges of the graph
+    spanning_forest.erase(upd.edge);
+  }
 #endif  // NO_EAGER_DSU
 }
 
+bool CCSketchAlg::sparse_update_batch(node_id_t src_vertex,
+                                      const std::vector<node_id_t> &dst_vertices) {
+  std::lock_guard<StoreMutex> lk(sketch_mtx[src_vertex % num_sketch_mtx]);
+  SparseSketch &sparse = sparse_sketches[src_vertex];
+  if (sparse.is_dense()) return false;
+  if (sparse.size() + dst_vertices.size() > max_sparse_size) {
+    sparse.densify(sketches[src_vertex]);
+    return false;
+  }
+
+  vec_t edge_idxs[Sketch::update_batch_chunk];
+  for (size_t base = 0; base < dst_vertices.size(); base += Sketch::update_batch_chunk) {
+    size_t chunk_size = std::min(Sketch::update_batch_chunk, dst_vertices.size() - base);
+    for (size_t i = 0; i < chunk_size; i++) {
+      edge_idxs[i] = edge_index(src_vertex, dst_vertices[base + i]);
+    }
+    sparse.update_batch(edge_idxs, chunk_size);
+  }
+  return true;
+}
+
 void CCSketchAlg::apply_update_batch(int thr_id, node_id_t src_vertex,
                                      const std::vector<node_id_t> &dst_vertices) {
   if (update_locked) throw UpdateLockedException();
+  mark_dirty(src_vertex);
+  if (is_sparse(src_vertex) && sparse_update_batch(src_vertex, dst_vertices)) return;
   Sketch &delta_sketch = *delta_sketches[thr_id];
-  delta_sketch.zero_contents();
+  vec_t edge_idxs[Sketch::update_batch_chunk];
 
-  for (const auto &dst : dst_vertices) {
-    delta_sketch.update(static_cast<vec_t>(concat_pairing_fn(src_vertex, dst)));
+  // small batches touch few buckets of the delta so merge only those buckets
+  if (dst_vertices.size() <= sparse_batch_limit) {
+    for (size_t i = 0; i < dst_vertices.size(); i++) {
+      edge_idxs[i] = edge_index(src_vertex, dst_vertices[i]);
+    }
+    bucket_id_t *touched = delta_touched[thr_id];
+    size_t num_touched = delta_sketch.update_batch(edge_idxs, dst_vertices.size(), touched);
+
+#ifdef ATOMIC_MERGE
+    sketches[src_vertex].atomic_merge_touched(delta_sketch, touched, num_touched);
+#else
+    std::lock_guard<StoreMutex> lk(sketch_mtx[src_vertex % num_sketch_mtx]);
+    sketches[src_vertex].merge_touched(delta_sketch, touched, num_touched);
+#endif
+    return;
+  }
+
+  // translate the destinations into edge indices and apply them to the delta in chunks
+  for (size_t base = 0; base < dst_vertices.size(); base += Sketch::update_batch_chunk) {
+    size_t chunk_size = std::min(Sketch::update_batch_chunk, dst_vertices.size() - base);
+    for (size_t i = 0; i < chunk_size; i++) {
+      edge_idxs[i] = edge_index(src_vertex, dst_vertices[base + i]);
+    }
+    delta_sketch.update_batch(edge_idxs, chunk_size);
   }
 
-  std::lock_guard<std::mutex> lk(sketches[src_vertex]->mutex);
-  sketches[src_vertex]->merge(delta_sketch);
+#ifdef ATOMIC_MERGE
+  sketches[src_vertex].atomic_merge(delta_sketch);
+#else
+  {
+    std::lock_guard<StoreMutex> lk(sketch_mtx[src_vertex % num_sketch_mtx]);
+    sketches[src_vertex].merge(delta_sketch);
+  }
+#endif
+  delta_sketch.zero_contents();
 }
 
 void CCSketchAlg::apply_raw_buckets_update(node_id_t src_vertex, Bucket *raw_buckets) {
-  std::lock_guard<std::mutex> lk(sketches[src_vertex]->mutex);
-  sketches[src_vertex]->merge_raw_bucket_buffer(raw_buckets);
+  mark_dirty(src_vertex);
+  if (is_sparse(src_vertex)) {
+    // the delta is already a sketch so the vertex needs its sketch too
+    std::lock_guard<StoreMutex> lk(sketch_mtx[src_vertex % num_sketch_mtx]);
+    if (!sparse_sketches[src_vertex].is_dense())
+      sparse_sketches[src_vertex].densify(sketches[src_vertex]);
+  }
+#ifdef ATOMIC_MERGE
+  sketches[src_vertex].atomic_merge_raw_bucket_buffer(raw_buckets);
+#else
+  std::lock_guard<StoreMutex> lk(sketch_mtx[src_vertex % num_sketch_mtx]);
+  sketches[src_vertex].merge_raw_bucket_buffer(raw_buckets);
+#endif
 }
 
 // Note: for performance reasons route updates through the driver instead of calling this function
@@ -128,8 +732,68 @@ void CCSketchAlg::update(GraphUpdate upd) {
   pre_insert(upd, 0);
   Edge edge = upd.edge;
 
-  sketches[edge.src]->update(static_cast<vec_t>(concat_pairing_fn(edge.src, edge.dst)));
-  sketches[edge.dst]->update(static_cast<vec_t>(concat_pairing_fn(edge.src, edge.dst)));
+  vec_t edge_idx = edge_index(edge.src, edge.dst);
+  for (node_id_t v : {edge.src, edge.dst}) {
+    mark_dirty(v);
+    if (is_sparse(v)) {
+      if (sparse_sketches[v].size() < max_sparse_size) {
+        sparse_sketches[v].update_batch(&edge_idx, 1);
+        continue;
+      }
+      sparse_sketches[v].densify(sketches[v]);
+    }
+    sketches[v].update(edge_idx);
+  }
+}
+
+void CCSketchAlg::merge(const CCSketchAlg &other) {
+  if (update_locked) throw UpdateLockedException();
+  if (&other == this) throw MergeException("an algorithm cannot be merged into itself");
+  if (other.num_vertices != num_vertices || other.seed != seed)
+    throw MergeException("the algorithms have different vertices or seeds");
+  const SketchParams &params = sketches.get_params();
+  const SketchParams &other_params = other.sketches.get_params();
+  if (other_params.num_samples != params.num_samples ||
+      other_params.cols_per_sample != params.cols_per_sample ||
+      other_params.bkt_per_col != params.bkt_per_col ||
+      other_params.algorithm != params.algorithm ||
+      other_params.index_width != params.index_width ||
+      other_params.depth_hashing != params.depth_hashing)
+    throw MergeException("the sketches have different shapes");
+
+  // each vertex is merged by one thread, with the vectorized XOR of Sketch::merge() unless the
+  // vertex of other is sparse
+#pragma omp parallel for schedule(dynamic, 64)
+  for (node_id_t v = 0; v < num_vertices; v++) {
+    if (other.is_null(v)) continue;
+    mark_dirty(v);
+    if (!other.is_sparse(v)) {
+      sparse_sketches[v].densify(sketches[v]);
+      sketches[v].merge(other.sketches[v]);
+      continue;
+    }
+    // the edge sets of sparse vertices are toggled, as updates would
+    const SparseSketch &edges = other.sparse_sketches[v];
+    if (is_sparse(v) && sparse_sketches[v].size() + edges.size() <= max_sparse_size) {
+      sparse_sketches[v].update_batch(edges.data(), edges.size());
+      continue;
+    }
+    sparse_sketches[v].densify(sketches[v]);
+    sketches[v].update_batch(edges.data(), edges.size());
+  }
+  dsu_valid = false;
+  shared_dsu_valid = false;
+  warm_start_valid = false;
+}
+
+inline bool CCSketchAlg::add_sampled_edge(Edge e) {
+  if (!dsu.merge(e.src, e.dst).merged) return false;
+#ifdef VERIFY_SAMPLES_F
+  verifier->verify_edge(e);
+#endif
+  // Update spanning forest
+  spanning_forest.insert(e);
+  return true;
 }
 
 // sample from a sketch that represents a supernode of vertices
@@ -138,7 +802,7 @@ inline bool CCSketchAlg::sample_supernode(Sketch &skt) {
   bool modified = false;
   SketchSample sample = skt.sample();
 
-  Edge e = inv_concat_pairing_fn(sample.idx);
+  Edge e = index_edge(sample.idx);
   SampleResult result_type = sample.result;
 
   // std::cout << " " << result_type << " e:" << e.src << " " << e.dst << std::endl;
@@ -146,25 +810,41 @@ inline bool CCSketchAlg::sample_supernode(Sketch &skt) {
   if (result_type == FAIL) {
     modified = true;
   } else if (result_type == GOOD) {
-    DSUMergeRet<node_id_t> m_ret = dsu.merge(e.src, e.dst);
-    if (m_ret.merged) {
-#ifdef VERIFY_SAMPLES_F
-      verifier->verify_edge(e);
-#endif
-      modified = true;
-      // Update spanning forest
-      auto src = std::min(e.src, e.dst);
-      auto dst = std::max(e.src, e.dst);
-      {
-        std::lock_guard<std::mutex> lk(spanning_forest_mtx[src]);
-        spanning_forest[src].insert(dst);
-      }
-    }
+    modified = add_sampled_edge(e);
   }
 
   return modified;
 }
 
+inline bool CCSketchAlg::sample_sparse_supernode(node_id_t v, Sketch &scratch) {
+  const SparseSketch &sparse = sparse_sketches[v];
+  if (sparse.size() == 0) return false;  // null vertex, the sample is ZERO
+
+  // sample 0 only needs the deterministic bucket and the columns of sample 0
+  scratch.range_update_batch(sparse.data(), sparse.size(), 0, 1);
+  bool modified = sample_supernode(scratch);
+  // updating again cancels the indices, which is cheaper than zeroing the whole scratch sketch
+  scratch.range_update_batch(sparse.data(), sparse.size(), 0, 1);
+  scratch.reset_sample_state();
+  return modified;
+}
+
+/*
+ * Returns the root of the supernode with the most vertices in merge_instr.
+ */
+static node_id_t largest_supernode(const std::vector<MergeInstr> &merge_instr) {
+  node_id_t largest = merge_instr[0].root;
+  size_t largest_size = 0;
+  for (size_t i = 0, run = 0; i < merge_instr.size(); i++) {
+    run = i > 0 && merge_instr[i].root == merge_instr[i - 1].root ? run + 1 : 1;
+    if (run > largest_size) {
+      largest = merge_instr[i].root;
+      largest_size = run;
+    }
+  }
+  return largest;
+}
+
 /*
  * Returns the ith half-open range in the division of [0, length] into divisions segments.
  */
@@ -224,15 +904,22 @@ inline bool CCSketchAlg::run_round_zero() {
   bool modified = false;
   bool except = false;
   std::exception_ptr err;
-#pragma omp parallel for
-  for (node_id_t i = 0; i < num_vertices; i++) {
-    try {
-      // num_query += 1;
-      if (sample_supernode(*sketches[i]) && !modified) modified = true;
-    } catch (...) {
-      except = true;
+#pragma omp parallel
+  {
+    // sparse vertices are sampled by building the part of their sketch that the sample reads
+    Sketch scratch(sketches.get_params());
+#pragma omp for
+    for (node_id_t i = 0; i < num_vertices; i++) {
+      try {
+        // num_query += 1;
+        bool vertex_modified = is_sparse(i) ? sample_sparse_supernode(i, scratch)
+                                            : sample_supernode(sketches[i]);
+        if (vertex_modified && !modified) modified = true;
+      } catch (...) {
+        except = true;
 #pragma omp critical
-      err = std::current_exception();
+        err = std::current_exception();
+      }
     }
   }
   if (except) {
@@ -245,11 +932,8 @@ inline bool CCSketchAlg::run_round_zero() {
 
 bool CCSketchAlg::perform_boruvka_round(const size_t cur_round,
                                         const std::vector<MergeInstr> &merge_instr,
-                                        std::vector<GlobalMergeData> &global_merges) {
-  if (cur_round == 0) {
-    return run_round_zero();
-  }
-
+                                        std::vector<GlobalMergeData> &global_merges,
+                                        node_id_t skip_root) {
   bool modified = false;
   bool except = false;
   std::exception_ptr err;
@@ -262,8 +946,7 @@ bool CCSketchAlg::perform_boruvka_round(const size_t cur_round,
 #pragma omp parallel default(shared)
   {
     // some thread local variables
-    Sketch local_sketch(Sketch::calc_vector_length(num_vertices), seed,
-                        Sketch::calc_cc_samples(num_vertices, config.get_sketches_factor()));
+    Sketch local_sketch(sketches.get_params());
 
     size_t thr_id = omp_get_thread_num();
     size_t num_threads = omp_get_num_threads();
@@ -327,7 +1010,14 @@ bool CCSketchAlg::perform_boruvka_round(const size_t cur_round,
       }
 
       // std::cout << " " << child;
-      local_sketch.range_merge(*sketches[child], cur_round, 1);
+      if (is_null(child) || root == skip_root) {
+        // nothing to merge. The sketch of a skipped supernode stays empty and samples ZERO
+      } else if (is_sparse(child)) {
+        const SparseSketch &sparse = sparse_sketches[child];
+        local_sketch.range_update_batch(sparse.data(), sparse.size(), cur_round, 1);
+      } else {
+        local_sketch.range_merge(sketches[child], cur_round, 1);
+      }
     }
 
     if (root_exits_right || root_from_left) {
@@ -461,7 +1151,20 @@ inline void CCSketchAlg::create_merge_instructions(std::vector<MergeInstr> &merg
   }
 }
 
-void CCSketchAlg::boruvka_emulation() {
+size_t CCSketchAlg::rebuild_dsu_from_forest() {
+  // the forest is inserted again as well, which drops the slots of the erased edges
+  std::vector<Edge> forest_edges = spanning_forest.get_edges();
+  dsu.reset();
+  spanning_forest.clear();
+#pragma omp parallel for
+  for (size_t i = 0; i < forest_edges.size(); i++) {
+    dsu.merge(forest_edges[i].src, forest_edges[i].dst);
+    spanning_forest.insert(forest_edges[i]);
+  }
+  return forest_edges.size();
+}
+
+void CCSketchAlg::boruvka_emulation(bool warm_start) {
   // auto start = std::chrono::steady_clock::now();
   update_locked = true;
 
@@ -472,14 +1175,21 @@ void CCSketchAlg::boruvka_emulation() {
   std::vector<GlobalMergeData> global_merges;
   global_merges.reserve(num_threads);
   for (size_t i = 0; i < num_threads; i++) {
-    global_merges.emplace_back(num_vertices, seed, config.get_sketches_factor());
+    global_merges.emplace_back(sketches.get_params());
   }
 
-  dsu.reset();
+  // without forest edges every tree is a single vertex, which run_round_zero() samples faster
+  if (warm_start) warm_start = rebuild_dsu_from_forest() > 0;
+  if (!warm_start) {
+    dsu.reset();
+    spanning_forest.clear();
+  }
+  deleted_forest_edges.clear();
   for (node_id_t i = 0; i < num_vertices; ++i) {
     merge_instr[i] = {i, i};
-    spanning_forest[i].clear();
   }
+  // a warm start begins from the trees of the forest
+  if (warm_start) create_merge_instructions(merge_instr);
   size_t round_num = 0;
   bool modified = true;
   // std::cout << std::endl;
@@ -490,7 +1200,12 @@ void CCSketchAlg::boruvka_emulation() {
   while (true) {
     // std::cout << "   Round: " << round_num << std::endl;
     // start = std::chrono::steady_clock::now();
-    modified = perform_boruvka_round(round_num, merge_instr, global_merges);
+    // a warm start begins with the large trees of the forest, of which the largest supernode
+    // often holds most vertices. Its edges lead to the other supernodes, which are all sampled
+    node_id_t skip_root = warm_start ? largest_supernode(merge_instr) : num_vertices;
+    modified = round_num == 0 && !warm_start
+                   ? run_round_zero()
+                   : perform_boruvka_round(round_num, merge_instr, global_merges, skip_root);
     // std::cout << "     perform_boruvka_round = "
     //           << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
     //           << std::endl;
@@ -506,10 +1221,155 @@ void CCSketchAlg::boruvka_emulation() {
     ++round_num;
   }
   last_query_rounds = round_num;
+  last_query_repaired = false;
+
+  // other processes may update the sketches of a shared store at any time, so the answer holds
+  // only for this query
+  dsu_valid = shared_store == nullptr;
+  shared_dsu_valid = dsu_valid;
+  warm_start_valid = dsu_valid;
+  clear_changed();
+  update_locked = false;
+}
+
+bool CCSketchAlg::repair_spanning_forest() {
+  // the vertices whose pieces may have changed, each with the tree it was in. The tree of a
+  // deleted edge is identified by its root in the DSU before the deletions
+  bool by_tree = dsu_valid;
+  std::vector<std::pair<node_id_t, node_id_t>> changed;
+  if (by_tree) {
+    for (Edge edge : deleted_forest_edges) {
+      node_id_t tree = dsu.find_root(edge.src);
+      changed.push_back({edge.src, tree});
+      changed.push_back({edge.dst, tree});
+    }
+  } else {
+    for (node_id_t w = 0; w < (num_vertices + 63) / 64; w++) {
+      for (uint64_t bits = changed_vertices[w].load(std::memory_order_relaxed); bits != 0;
+           bits &= bits - 1)
+        changed.push_back({w * 64 + __builtin_ctzll(bits), 0});
+      if (changed.size() > num_vertices / forest_repair_factor) return false;
+    }
+  }
+  update_locked = true;
+  deleted_forest_edges.clear();
+
+  rebuild_dsu_from_forest();
+
+  // the pieces that may have changed, and the vertices of each. Every piece of a tree that lost
+  // edges holds an endpoint of one of them, and that endpoint was updated. The other pieces are
+  // components of the last query whose sketches, which had nothing to sample, are unchanged
+  std::unordered_map<node_id_t, node_id_t> piece_tree;
+  for (auto &v : changed) piece_tree[dsu.find_root(v.first)] = v.second;
+  std::unordered_map<node_id_t, std::vector<node_id_t>> piece_vertices;
+  size_t num_piece_vertices = 0;
+  for (node_id_t v = 0; v < num_vertices; v++) {
+    auto it = piece_tree.find(dsu.find_root(v));
+    if (it != piece_tree.end()) {
+      piece_vertices[it->first].push_back(v);
+      ++num_piece_vertices;
+    }
+  }
+  // without the trees, a component is sampled until it is finished. Past a fraction of the
+  // vertices, the rounds of boruvka_emulation() over all of them are faster
+  if (!by_tree && num_piece_vertices > num_vertices / forest_repair_factor) {
+    update_locked = false;
+    return false;
+  }
+
+  // The pieces of components with nothing to sample. While the DSU is valid, edges of the graph
+  // only join pieces of the same tree, since the edges between trees were merged into the DSU as
+  // they were inserted
+  std::unordered_set<node_id_t> finished;
+  size_t round = 0;
+  for (; ; round++) {
+    // the open components of each tree, and the pieces and number of vertices of each of them
+    std::unordered_map<node_id_t, std::vector<node_id_t>> tree_components;
+    std::unordered_map<node_id_t, std::vector<node_id_t>> component_pieces;
+    std::unordered_map<node_id_t, size_t> component_size;
+    for (auto &piece : piece_tree) {
+      if (finished.count(piece.first)) continue;
+      node_id_t root = dsu.find_root(piece.first);
+      auto &pieces = component_pieces[root];
+      if (pieces.empty()) tree_components[piece.second].push_back(root);
+      pieces.push_back(piece.first);
+      component_size[root] += piece_vertices[piece.first].size();
+    }
+
+    // a sample of a component finds an edge to another component of its tree. So the largest
+    // component of a tree need not be sampled, and once it is the only one it is finished
+    std::vector<node_id_t> to_sample;
+    for (auto &tree : tree_components) {
+      std::vector<node_id_t> &components = tree.second;
+      if (!by_tree) {
+        to_sample.insert(to_sample.end(), components.begin(), components.end());
+        continue;
+      }
+      node_id_t largest = *std::max_element(components.begin(), components.end(),
+                                            [&](node_id_t a, node_id_t b) {
+                                              return component_size[a] < component_size[b];
+                                            });
+      for (node_id_t root : components)
+        if (root != largest) to_sample.push_back(root);
+      if (components.size() == 1)
+        for (node_id_t piece : component_pieces[largest]) finished.insert(piece);
+    }
+    if (to_sample.empty()) break;
+    if (round >= max_rounds()) {
+      update_locked = false;
+      return false;
+    }
+
+    std::vector<char> zero(to_sample.size());
+    bool except = false;
+    std::exception_ptr err;
+#pragma omp parallel
+    {
+      Sketch scratch(sketches.get_params());
+#pragma omp for schedule(dynamic)
+      for (size_t i = 0; i < to_sample.size(); i++) {
+        try {
+          scratch.zero_contents();
+          for (node_id_t piece : component_pieces.at(to_sample[i])) {
+            for (node_id_t v : piece_vertices.at(piece)) {
+              if (is_null(v)) continue;
+              if (is_sparse(v))
+                scratch.range_update_batch(sparse_sketches[v].data(), sparse_sketches[v].size(),
+                                           round, 1);
+              else
+                scratch.range_merge(sketches[v], round, 1);
+            }
+          }
+          // unlike sample_supernode(), tell a sample of ZERO from an edge to a component that
+          // was just merged with this one
+          SketchSample sample = scratch.sample();
+          zero[i] = sample.result == ZERO;
+          if (sample.result == GOOD) add_sampled_edge(index_edge(sample.idx));
+        } catch (...) {
+          except = true;
+#pragma omp critical
+          err = std::current_exception();
+        }
+      }
+    }
+    if (except) {
+      update_locked = false;
+      std::rethrow_exception(err);
+    }
+
+    // a sample of ZERO finds a component with no edges out of it
+    for (size_t i = 0; i < to_sample.size(); i++)
+      if (zero[i])
+        for (node_id_t piece : component_pieces[to_sample[i]]) finished.insert(piece);
+  }
+  last_query_rounds = round;
+  last_query_repaired = true;
 
   dsu_valid = true;
   shared_dsu_valid = true;
+  clear_changed();
   update_locked = false;
+  return true;
 }
 
 ConnectedComponents CCSketchAlg::connected_components() {
@@ -518,11 +1378,7 @@ ConnectedComponents CCSketchAlg::connected_components() {
   // if the DSU holds the answer, use that
   if (shared_dsu_valid) {
 #ifdef VERIFY_SAMPLES_F
-    for (node_id_t src = 0; src < num_vertices; ++src) {
-      for (const auto &dst : spanning_forest[src]) {
-        verifier->verify_edge({src, dst});
-      }
-    }
+    spanning_forest.for_each([&](Edge edge) { verifier->verify_edge(edge); });
 #endif
   }
   // The DSU does not hold the answer, make it so
@@ -531,7 +1387,7 @@ ConnectedComponents CCSketchAlg::connected_components() {
     std::exception_ptr err;
     try {
       // auto start = std::chrono::steady_clock::now();
-      boruvka_emulation();
+      if (!warm_start_valid || !repair_spanning_forest()) boruvka_emulation(warm_start_valid);
       // std::cout << " boruvka's algorithm = "
       //         << std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count()
       //         << std::endl;
@@ -542,7 +1398,7 @@ ConnectedComponents CCSketchAlg::connected_components() {
 
     // get ready for ingesting more from the stream by resetting the sketches sample state
     for (node_id_t i = 0; i < num_vertices; i++) {
-      sketches[i]->reset_sample_state();
+      sketches[i].reset_sample_state();
     }
 
     if (except) std::rethrow_exception(err);
@@ -571,13 +1427,9 @@ bool CCSketchAlg::point_query(node_id_t a, node_id_t b) {
   cc_alg_start = std::chrono::steady_clock::now();
 
   // if the DSU holds the answer, use that
-  if (dsu_valid) {
+  if (shared_dsu_valid) {
 #ifdef VERIFY_SAMPLES_F
-    for (node_id_t src = 0; src < num_vertices; ++src) {
-      for (const auto &dst : spanning_forest[src]) {
-        verifier->verify_edge({src, dst});
-      }
-    }
+    spanning_forest.for_each([&](Edge edge) { verifier->verify_edge(edge); });
 #endif
   } 
   // The DSU does not hold the answer, make it so
@@ -585,7 +1437,7 @@ bool CCSketchAlg::point_query(node_id_t a, node_id_t b) {
     bool except = false;
     std::exception_ptr err;
     try {
-      boruvka_emulation();
+      if (!warm_start_valid || !repair_spanning_forest()) boruvka_emulation(warm_start_valid);
     } catch (...) {
       except = true;
       err = std::current_exception();
@@ -594,7 +1446,7 @@ bool CCSketchAlg::point_query(node_id_t a, node_id_t b) {
     // get ready for ingesting more from the stream
     // reset dsu and resume graph workers
     for (node_id_t i = 0; i < num_vertices; i++) {
-      sketches[i]->reset_sample_state();
+      sketches[i].reset_sample_state();
     }
 
     // check if boruvka errored
@@ -611,13 +1463,212 @@ bool CCSketchAlg::point_query(node_id_t a, node_id_t b) {
   return retval;
 }
 
-void CCSketchAlg::write_binary(const std::string &filename) {
-  auto binary_out = std::fstream(filename, std::ios::out | std::ios::binary);
-  binary_out.write((char *)&seed, sizeof(seed));
-  binary_out.write((char *)&num_vertices, sizeof(num_vertices));
-  binary_out.write((char *)&config._sketches_factor, sizeof(config._sketches_factor));
+template <class SketchOf>
+std::vector<SerializedChunk> CCSketchAlg::write_sketch_chunks(
+    const std::string &filename, std::vector<char> &header, const std::vector<node_id_t> &vertices,
+    SerialType serial_type, SketchOf &&sketch_of) {
+  node_id_t num_serialized = vertices.size();
+
+  // the offset of each sketch from the first. Only FULL sketches all have the same size, and
+  // sizing a SPARSE sketch scans it, so this is parallel too
+  std::vector<size_t> sketch_offsets(num_serialized + 1, 0);
+  size_t full_bytes = sketches[0].serialized_bytes();
+#pragma omp parallel
+  {
+    std::unique_ptr<Sketch> scratch;
+#pragma omp for schedule(dynamic, 64)
+    for (node_id_t i = 0; i < num_serialized; i++) {
+      sketch_offsets[i + 1] = serial_type == FULL
+                                  ? full_bytes
+                                  : sketch_of(vertices[i], scratch).serialized_bytes(serial_type);
+    }
+  }
+  for (node_id_t i = 0; i < num_serialized; i++) sketch_offsets[i + 1] += sketch_offsets[i];
+
+  // split the sketches into chunks of about serial_chunk_bytes
+  std::vector<SerializedChunk> chunks;
+  for (node_id_t i = 0; i < num_serialized; i++) {
+    if (chunks.empty() || sketch_offsets[i] - chunks.back().offset >= serial_chunk_bytes)
+      chunks.push_back({i, sketch_offsets[i]});
+  }
+  chunks.push_back({num_serialized, sketch_offsets[num_serialized]});
+  node_id_t num_chunks = chunks.size() - 1;
+
+  auto append = [&](const void *data, size_t bytes) {
+    header.insert(header.end(), (const char *)data, (const char *)data + bytes);
+  };
+  append(&num_serialized, sizeof(num_serialized));
+  append(vertices.data(), num_serialized * sizeof(node_id_t));
+  append(&num_chunks, sizeof(num_chunks));
+  size_t sketches_offset = header.size() + chunks.size() * sizeof(SerializedChunk);
+  for (auto &chunk : chunks) chunk.offset += sketches_offset;
+  append(chunks.data(), chunks.size() * sizeof(SerializedChunk));
+
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw FileIOException(filename, std::strerror(errno));
+  int direct_fd = config._direct_io ? ChunkedFile::open_direct(filename, O_WRONLY) : -1;
+
+  FileChunkWriter header_chunk(fd, -1, 0);
+  header_chunk.sputn(header.data(), header.size());
+  int error = header_chunk.finish();
+
+  // each thread serializes whole chunks and writes them at their offsets
+#pragma omp parallel
+  {
+    std::unique_ptr<Sketch> scratch;
+#pragma omp for schedule(dynamic, 1)
+    for (node_id_t c = 0; c < num_chunks; c++) {
+      FileChunkWriter chunk(fd, direct_fd, chunks[c].offset);
+      std::ostream binary_out(&chunk);
+      for (size_t i = chunks[c].first_vertex; i < chunks[c + 1].first_vertex; i++)
+        sketch_of(vertices[i], scratch).serialize(binary_out, serial_type);
+      assert(chunk.tell() == chunks[c + 1].offset);
+      int chunk_error = chunk.finish();
+      if (chunk_error != 0) {
+#pragma omp critical
+        error = chunk_error;
+      }
+    }
+  }
+  close(fd);
+  if (direct_fd >= 0) close(direct_fd);
+  if (error != 0) throw FileIOException(filename, std::strerror(error));
+  return chunks;
+}
+
+void CCSketchAlg::write_binary(const std::string &filename, SerialType type) {
+  // write only the vertices that are not null
+  std::vector<node_id_t> materialized;
   for (node_id_t i = 0; i < num_vertices; ++i) {
-    sketches[i]->serialize(binary_out);
+    if (!is_null(i)) materialized.push_back(i);
+  }
+
+  std::vector<char> header;
+  auto append = [&](const void *data, size_t bytes) {
+    header.insert(header.end(), (const char *)data, (const char *)data + bytes);
+  };
+  append(serial_magic, sizeof(serial_magic));
+  append(&serial_version, sizeof(serial_version));
+  append(&seed, sizeof(seed));
+  append(&num_vertices, sizeof(num_vertices));
+  append(&config._sketches_factor, sizeof(config._sketches_factor));
+  append(&type, sizeof(type));
+  uint32_t algorithm = sketches.get_params().algorithm;
+  append(&algorithm, sizeof(algorithm));
+  uint32_t index_width = sketches.get_params().index_width;
+  append(&index_width, sizeof(index_width));
+  uint32_t depth_hashing = sketches.get_params().depth_hashing;
+  append(&depth_hashing, sizeof(depth_hashing));
+  append(&sketch_hash_policy, sizeof(sketch_hash_policy));
+  std::vector<SerializedChunk> chunks = write_sketch_chunks(
+      filename, header, materialized, type,
+      [&](node_id_t v, std::unique_ptr<Sketch> &scratch) -> const Sketch & {
+        return vertex_sketch(v, scratch);
+      });
+
+  if (type == FULL)
+    set_checkpoint_base(filename, header.size(), Snapshot::checksum(header.data(), header.size()),
+                        materialized, chunks);
+}
+
+void CCSketchAlg::write_delta(const std::string &filename) {
+  if (checkpoint_base == nullptr)
+    throw FileIOException(filename, "no FULL checkpoint to write a delta against");
+  const CheckpointBase &base = *checkpoint_base;
+  int base_fd = open(base.file.c_str(), O_RDONLY);
+  if (base_fd < 0) throw FileIOException(base.file, std::strerror(errno));
+
+  std::vector<node_id_t> dirty;
+  for (node_id_t w = 0; w < (num_vertices + 63) / 64; w++) {
+    for (uint64_t bits = dirty_vertices[w].load(std::memory_order_relaxed); bits != 0;
+         bits &= bits - 1)
+      dirty.push_back(w * 64 + __builtin_ctzll(bits));
+  }
+
+  DeltaHeader delta_header;
+  std::memset(&delta_header, 0, sizeof(delta_header));
+  std::memcpy(delta_header.magic, delta_magic, sizeof(delta_magic));
+  delta_header.seed = seed;
+  delta_header.num_vertices = num_vertices;
+  delta_header.sequence = base.num_deltas + 1;
+  delta_header.base_header_bytes = base.header_bytes;
+  delta_header.base_checksum = base.header_checksum;
+  delta_header.algorithm = sketches.get_params().algorithm;
+  delta_header.index_width = sketches.get_params().index_width;
+  delta_header.depth_hashing = sketches.get_params().depth_hashing;
+  delta_header.hash_policy = sketch_hash_policy;
+  std::vector<char> header((char *)&delta_header, (char *)&delta_header + sizeof(delta_header));
+
+  // the sketch of a vertex XORed with its sketch in the base, read from the base as raw buckets
+  std::atomic<int> base_error{0};
+  size_t num_buckets = sketches.get_params().num_buckets;
+  auto delta_sketch = [&](node_id_t v, std::unique_ptr<Sketch> &scratch) -> const Sketch & {
+    if (!is_sparse(v)) {
+      if (scratch == nullptr) scratch.reset(new Sketch(sketches.get_params()));
+      scratch->zero_contents();
+      scratch->merge(sketches[v]);
+    } else {
+      vertex_sketch(v, scratch);
+    }
+    if (base.offsets[v] != 0) {
+      std::unique_ptr<Bucket[]> base_buckets(new Bucket[num_buckets]);
+      int error = ChunkedFile::read_at(base_fd, base_buckets.get(), num_buckets * sizeof(Bucket),
+                                       base.offsets[v]);
+      if (error != 0) base_error = error;
+      else scratch->merge_raw_bucket_buffer(base_buckets.get());
+    }
+    return *scratch;
+  };
+  try {
+    write_sketch_chunks(filename, header, dirty, SPARSE, delta_sketch);
+  } catch (...) {
+    close(base_fd);
+    throw;
+  }
+  close(base_fd);
+  if (base_error != 0) throw FileIOException(base.file, std::strerror(base_error));
+
+  ++checkpoint_base->num_deltas;
+  clear_dirty();
+}
+
+void CCSketchAlg::write_snapshot(const std::string &filename) {
+  int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) throw SnapshotException(filename, std::strerror(errno));
+
+  SnapshotHeader header;
+  std::memset(&header, 0, sizeof(header));
+  Snapshot::describe(header, sketches);
+  header.seed = seed;
+  header.num_vertices = num_vertices;
+  header.sketches_factor = config._sketches_factor;
+
+  // the edge sets of the sparse vertices. Their sketches are zero
+  std::vector<char> vertex_data;
+  for (node_id_t v = 0; v < num_vertices; ++v) {
+    uint32_t set_size = is_sparse(v) ? sparse_sketches[v].size() : Snapshot::dense_vertex;
+    const char *set_size_bytes = (const char *)&set_size;
+    vertex_data.insert(vertex_data.end(), set_size_bytes, set_size_bytes + sizeof(set_size));
+    if (!is_sparse(v)) continue;
+    const char *idx_bytes = (const char *)sparse_sketches[v].data();
+    vertex_data.insert(vertex_data.end(), idx_bytes, idx_bytes + set_size * sizeof(vec_t));
+  }
+  header.vertices.offset = sizeof(header);
+  header.vertices.bytes = vertex_data.size();
+  header.vertices.checksum = Snapshot::checksum(vertex_data.data(), vertex_data.size());
+  size_t vertices_end = header.vertices.offset + header.vertices.bytes;
+  header.slab.offset = (vertices_end + Snapshot::slab_alignment - 1) / Snapshot::slab_alignment *
+                       Snapshot::slab_alignment;
+
+  try {
+    Snapshot::write_slab(fd, sketches, header.slab, filename);
+    Snapshot::write_at(fd, vertex_data.data(), vertex_data.size(), header.vertices.offset,
+                       filename);
+    Snapshot::seal(header);
+    Snapshot::write_at(fd, &header, sizeof(header), 0, filename);
+  } catch (...) {
+    close(fd);
+    throw;
   }
-  binary_out.close();
+  close(fd);
 }
@@ -0,0 +1,205 @@
+#include "chunked_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+using ChunkedFile::direct_alignment;
+using ChunkedFile::buffer_bytes;
+
+static_assert(buffer_bytes % direct_alignment == 0 && buffer_bytes >= 2 * direct_alignment,
+              "a full buffer always holds a whole block");
+
+static char *alloc_buffer() {
+  void *buffer;
+  if (posix_memalign(&buffer, direct_alignment, buffer_bytes) != 0) throw std::bad_alloc();
+  return (char *)buffer;
+}
+
+int ChunkedFile::open_direct(const std::string &file, int flags) {
+#ifdef O_DIRECT
+  return open(file.c_str(), flags | O_DIRECT);
+#else
+  return -1;
+#endif
+}
+
+int ChunkedFile::read_at(int fd, void *data, size_t bytes, size_t offset) {
+  char *buf = static_cast<char *>(data);
+  while (bytes > 0) {
+    ssize_t num_read = pread(fd, buf, bytes, offset);
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read < 0) return errno;
+    if (num_read == 0) return EIO;
+    buf += num_read;
+    bytes -= num_read;
+    offset += num_read;
+  }
+  return 0;
+}
+
+FileChunkWriter::FileChunkWriter(int fd, int direct_fd, size_t offset)
+    : fd(fd), direct_fd(direct_fd), buffer(alloc_buffer()) {
+  // with direct IO the buffer holds whole blocks, starting with the one the chunk starts in
+  head = direct_fd >= 0 ? offset % direct_alignment : 0;
+  buf_offset = offset - head;
+  setp(buffer, buffer + buffer_bytes);
+  pbump(head);
+}
+
+FileChunkWriter::~FileChunkWriter() { free(buffer); }
+
+void FileChunkWriter::write_out(int to_fd, const char *data, size_t bytes, size_t offset) {
+  while (bytes > 0 && err == 0) {
+    ssize_t written = pwrite(to_fd, data, bytes, offset);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) {
+      err = written < 0 ? errno : EIO;
+      return;
+    }
+    data += written;
+    bytes -= written;
+    offset += written;
+  }
+}
+
+void FileChunkWriter::flush_buffer(bool last) {
+  size_t begin = buf_offset + head;
+  size_t end = tell();
+  size_t kept = 0;
+  if (direct_fd < 0) {
+    write_out(fd, buffer + head, end - begin, begin);
+    buf_offset = end;
+  } else {
+    size_t direct_begin = (begin + direct_alignment - 1) / direct_alignment * direct_alignment;
+    size_t direct_end = end / direct_alignment * direct_alignment;
+    if (direct_begin >= direct_end) {
+      // the chunk ends in the block it starts in
+      assert(last);
+      write_out(fd, buffer + head, end - begin, begin);
+    } else {
+      write_out(fd, buffer + head, direct_begin - begin, begin);
+      write_out(direct_fd, buffer + (direct_begin - buf_offset), direct_end - direct_begin,
+                direct_begin);
+      if (last) {
+        write_out(fd, buffer + (direct_end - buf_offset), end - direct_end, direct_end);
+      } else {
+        // the partial block at the end is completed by the next writes
+        kept = end - direct_end;
+        std::memmove(buffer, buffer + (direct_end - buf_offset), kept);
+        buf_offset = direct_end;
+      }
+    }
+  }
+  head = 0;
+  setp(buffer, buffer + buffer_bytes);
+  pbump(kept);
+}
+
+FileChunkWriter::int_type FileChunkWriter::overflow(int_type ch) {
+  flush_buffer(false);
+  if (err != 0) return traits_type::eof();
+  if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+    *pptr() = traits_type::to_char_type(ch);
+    pbump(1);
+  }
+  return traits_type::not_eof(ch);
+}
+
+std::streamsize FileChunkWriter::xsputn(const char *data, std::streamsize n) {
+  if (direct_fd < 0 && size_t(n) >= buffer_bytes) {
+    // large writes, like whole sketches, skip the buffer
+    flush_buffer(false);
+    write_out(fd, data, n, buf_offset);
+    buf_offset += n;
+    return err == 0 ? n : 0;
+  }
+  std::streamsize written = 0;
+  while (written < n) {
+    if (pptr() == epptr()) {
+      flush_buffer(false);
+      if (err != 0) break;
+    }
+    size_t bytes = std::min(size_t(n - written), size_t(epptr() - pptr()));
+    std::memcpy(pptr(), data + written, bytes);
+    pbump(bytes);
+    written += bytes;
+  }
+  return written;
+}
+
+int FileChunkWriter::finish() {
+  flush_buffer(true);
+  return err;
+}
+
+FileChunkReader::FileChunkReader(int fd, int direct_fd, size_t offset, size_t end)
+    : fd(fd), direct_fd(direct_fd), buffer(alloc_buffer()), offset(offset), end(end) {
+  setg(buffer, buffer, buffer);
+}
+
+FileChunkReader::~FileChunkReader() { free(buffer); }
+
+size_t FileChunkReader::read_in(int from_fd, char *data, size_t bytes, size_t offset) {
+  size_t total = 0;
+  while (total < bytes && err == 0) {
+    ssize_t num_read = pread(from_fd, data + total, bytes - total, offset + total);
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read < 0) err = errno;
+    if (num_read <= 0) break;
+    total += num_read;
+    // a short direct read is the end of the file, the next offset would not be aligned
+    if (from_fd == direct_fd) break;
+  }
+  return total;
+}
+
+FileChunkReader::int_type FileChunkReader::underflow() {
+  if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+  if (offset >= end || err != 0) return traits_type::eof();
+
+  if (direct_fd < 0) {
+    size_t num_read = read_in(fd, buffer, std::min(buffer_bytes, end - offset), offset);
+    setg(buffer, buffer, buffer + num_read);
+  } else {
+    // read whole blocks, starting with the one that holds offset
+    size_t block = offset / direct_alignment * direct_alignment;
+    size_t bytes = (end - block + direct_alignment - 1) / direct_alignment * direct_alignment;
+    size_t num_read = read_in(direct_fd, buffer, std::min(buffer_bytes, bytes), block);
+    num_read = std::min(num_read, end - block);
+    if (num_read <= offset - block) return traits_type::eof();
+    setg(buffer, buffer + (offset - block), buffer + num_read);
+  }
+  if (gptr() == egptr()) return traits_type::eof();
+  offset += egptr() - gptr();
+  return traits_type::to_int_type(*gptr());
+}
+
+std::streamsize FileChunkReader::xsgetn(char *data, std::streamsize n) {
+  std::streamsize num_read = 0;
+  while (num_read < n) {
+    if (gptr() == egptr()) {
+      if (direct_fd < 0 && size_t(n - num_read) >= buffer_bytes) {
+        // large reads skip the buffer
+        size_t bytes = std::min(size_t(n - num_read), offset < end ? end - offset : 0);
+        size_t got = read_in(fd, data + num_read, bytes, offset);
+        offset += got;
+        num_read += got;
+        if (got == 0 || got < bytes) break;
+        continue;
+      }
+      if (traits_type::eq_int_type(underflow(), traits_type::eof())) break;
+    }
+    size_t bytes = std::min(size_t(n - num_read), size_t(egptr() - gptr()));
+    std::memcpy(data + num_read, gptr(), bytes);
+    gbump(bytes);
+    num_read += bytes;
+  }
+  return num_read;
+}
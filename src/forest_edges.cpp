@@ -0,0 +1,67 @@
+#include "forest_edges.h"
+
+#include <cassert>
+
+constexpr uint64_t ForestEdges::empty_slot;
+constexpr uint64_t ForestEdges::erased_slot;
+
+ForestEdges::ForestEdges(node_id_t num_vertices)
+    : num_slots(size_t(num_vertices) + num_vertices / 2 + 1) {
+  slots = new std::atomic<uint64_t>[num_slots];
+  clear();
+}
+
+ForestEdges::~ForestEdges() { delete[] slots; }
+
+bool ForestEdges::insert(Edge edge) {
+  uint64_t key = pack(edge);
+  size_t i = home_slot(key);
+  for (size_t probes = 0; probes < num_slots; probes++) {
+    uint64_t found = slots[i].load(std::memory_order_relaxed);
+    if (found == empty_slot &&
+        slots[i].compare_exchange_strong(found, key, std::memory_order_relaxed))
+      return true;
+    // the slot is taken, possibly by another thread inserting the same edge just now
+    if (found == key) return false;
+    if (++i == num_slots) i = 0;
+  }
+  assert(false);  // the forest holds more edges than a forest can
+  return false;
+}
+
+bool ForestEdges::erase(Edge edge) {
+  uint64_t key = pack(edge);
+  size_t i = home_slot(key);
+  for (size_t probes = 0; probes < num_slots; probes++) {
+    uint64_t found = slots[i].load(std::memory_order_relaxed);
+    // whoever swaps the edge out of its slot erased it
+    if (found == key) return slots[i].compare_exchange_strong(found, erased_slot,
+                                                              std::memory_order_relaxed);
+    if (found == empty_slot) return false;
+    if (++i == num_slots) i = 0;
+  }
+  return false;
+}
+
+bool ForestEdges::contains(Edge edge) const {
+  uint64_t key = pack(edge);
+  size_t i = home_slot(key);
+  for (size_t probes = 0; probes < num_slots; probes++) {
+    uint64_t found = slots[i].load(std::memory_order_relaxed);
+    if (found == key) return true;
+    if (found == empty_slot) return false;
+    if (++i == num_slots) i = 0;
+  }
+  return false;
+}
+
+void ForestEdges::clear() {
+#pragma omp parallel for
+  for (size_t i = 0; i < num_slots; i++) slots[i].store(empty_slot, std::memory_order_relaxed);
+}
+
+std::vector<Edge> ForestEdges::get_edges() const {
+  std::vector<Edge> edges;
+  for_each([&](Edge edge) { edges.push_back(edge); });
+  return edges;
+}
@@ -0,0 +1,32 @@
+#include "hash_policy.h"
+
+constexpr uint64_t XXH3Hash::secret_bitflip;
+constexpr uint64_t XXH3Hash::prime_mx2;
+constexpr uint64_t XXH3Hash::input_len;
+
+// the random key material of a seed is drawn from a SplitMix64 stream starting at the seed
+static uint64_t splitmix64(uint64_t &state) {
+  uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+MultiplyShiftHash::Key MultiplyShiftHash::make_key(const uint64_t seed) {
+  uint64_t state = seed;
+  Key key;
+  key.a_lo = splitmix64(state);
+  key.a_hi = splitmix64(state);
+  key.b_lo = splitmix64(state);
+  key.b_hi = splitmix64(state);
+  return key;
+}
+
+TabulationHash::Key TabulationHash::make_key(const uint64_t seed) {
+  uint64_t state = seed;
+  Key key;
+  for (size_t i = 0; i < num_chars; i++) {
+    for (auto &entry : key.tables[i]) entry = splitmix64(state);
+  }
+  return key;
+}
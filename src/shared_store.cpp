@@ -0,0 +1,69 @@
+#include "shared_store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_standard_layout<SharedStoreHeader>::value,
+              "SharedStoreHeader is shared between processes as is");
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "the ready flag must work between processes");
+
+void StoreMutex::init(bool process_shared) {
+  pthread_mutexattr_t attr;
+  pthread_mutexattr_init(&attr);
+  if (process_shared) {
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+  }
+  pthread_mutex_init(&mtx, &attr);
+  pthread_mutexattr_destroy(&attr);
+}
+
+void StoreMutex::lock() {
+  // the owner died holding the mutex. Whatever it was merging is as far as it got
+  if (pthread_mutex_lock(&mtx) == EOWNERDEAD) pthread_mutex_consistent(&mtx);
+}
+
+int SharedStore::open(const std::string &name, bool create) {
+  int fd = create ? shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600)
+                  : shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) throw SharedStoreException(name, std::strerror(errno));
+  return fd;
+}
+
+SharedStoreHeader *SharedStore::map_header(int fd, const std::string &name) {
+  void *mem = mmap(nullptr, slab_offset, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (mem == MAP_FAILED) throw SharedStoreException(name, std::strerror(errno));
+  return static_cast<SharedStoreHeader *>(mem);
+}
+
+void SharedStore::unmap_header(SharedStoreHeader *header) { munmap(header, slab_offset); }
+
+void SharedStore::validate(const SharedStoreHeader &header, int fd, const std::string &name) {
+  struct stat segment_stat;
+  if (fstat(fd, &segment_stat) != 0) throw SharedStoreException(name, std::strerror(errno));
+  if (size_t(segment_stat.st_size) < slab_offset ||
+      header.ready.load(std::memory_order_acquire) == 0)
+    throw SharedStoreException(name, "not initialized");
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+    throw SharedStoreException(name, "not a shared store");
+  if (header.version != version)
+    throw SharedStoreException(name, "unsupported version " + std::to_string(header.version));
+  try {
+    Snapshot::validate(header.sketches, name);
+  } catch (const SnapshotException &e) {
+    throw SharedStoreException(name, e.what());
+  }
+  if (header.sketches.slab.offset != slab_offset ||
+      size_t(segment_stat.st_size) < header.sketches.slab.offset + header.sketches.slab.bytes)
+    throw SharedStoreException(name, "truncated");
+}
+
+void SharedStore::remove(const std::string &name) {
+  if (shm_unlink(name.c_str()) != 0) throw SharedStoreException(name, std::strerror(errno));
+}
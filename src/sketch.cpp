@@ -1,142 +1,524 @@
 #include "sketch.h"
 
+#include <algorithm>
+#include <cstdlib>
 #include <cstring>
+#include <new>
+#include <type_traits>
 #include <iostream>
 #include <vector>
 #include <cassert>
 
-Sketch::Sketch(vec_t vector_len, uint64_t seed, size_t _samples, size_t _cols) : seed(seed) {
-  num_samples = _samples;
-  cols_per_sample = _cols;
+constexpr size_t Sketch::update_batch_chunk;
+constexpr size_t Sketch::bucket_alignment;
+
+static_assert(!std::is_copy_assignable<Sketch>::value && !std::is_move_assignable<Sketch>::value,
+              "an assigned sketch would share the buckets of another");
+
+// The raw bucket format, used for serialization and raw bucket buffers, is a column-major array
+// of Buckets. Bucket layouts other than the default, and sketches of NarrowBuckets, must convert
+// to and from it.
+#if defined(SOA_BUCKETS) || defined(DEPTH_MAJOR_BUCKETS) || defined(ROUND_MAJOR_BUCKETS)
+#define CONVERT_RAW_BUCKETS
+#endif
+
+// number of buckets converted at once between the raw Bucket format and the sketch layout
+static constexpr size_t raw_bucket_chunk = 256;
+
+// a non-zero bucket of the SPARSE format and its column-major index
+struct SparseBucket {
+  uint32_t position;
+  Bucket bucket;
+};
+static_assert(sizeof(SparseBucket) == sizeof(uint32_t) + sizeof(Bucket),
+              "SparseBucket must not be padded");
+
+// number of columns (or buckets when sampling) hashed together by the multi-lane hash kernels
+static constexpr size_t column_hash_chunk = 64;
+
+static size_t round_up_to_cache_line(size_t bytes) {
+  return (bytes + Sketch::bucket_alignment - 1) / Sketch::bucket_alignment *
+         Sketch::bucket_alignment;
+}
+
+SketchParams::SketchParams(vec_t vector_len, uint64_t seed, size_t num_samples,
+                           size_t cols_per_sample, SketchAlgorithm algorithm,
+                           IndexWidth index_width, DepthHashing depth_hashing)
+    : seed(seed), num_samples(num_samples), cols_per_sample(cols_per_sample),
+      algorithm(algorithm), index_width(index_width), depth_hashing(depth_hashing) {
   num_columns = num_samples * cols_per_sample;
-  bkt_per_col = calc_bkt_per_col(vector_len);
+  bkt_per_col = Sketch::calc_bkt_per_col(vector_len);
   num_buckets = num_columns * bkt_per_col + 1; // plus 1 for deterministic bucket
-  buckets = new Bucket[num_buckets];
+  kernels = Sketch::select_kernels(*this);
+
+  // derive the keys of every seed up front. Columns past the last share a depth slice with it
+  constexpr size_t slice_cols = Bucket_Boruvka::depth_slice_columns;
+  size_t num_slices = (num_columns + slice_cols - 1) / slice_cols;
+  checksum_key = XXH3Hash::make_key(seed);
+  auto keys = std::make_shared<std::vector<SketchHash::Key>>();
+  keys->reserve(num_slices * slice_cols + num_slices);
+  for (size_t c = 0; c < num_slices * slice_cols; c++)
+    keys->push_back(SketchHash::make_key(seed + c * Sketch::column_seed_stride));
+  for (size_t g = 0; g < num_slices; g++)
+    keys->push_back(SketchHash::make_key(seed + g * slice_cols * Sketch::column_seed_stride + 1));
+  column_keys = keys->data();
+  slice_keys = column_keys + num_slices * slice_cols;
+  hash_keys = std::move(keys);
+#ifdef ROUND_MAJOR_BUCKETS
+  column_stride = bkt_per_col;
+#endif
+}
+
+size_t SketchParams::bucket_memory_bytes() const {
+#ifdef SOA_BUCKETS
+  // alphas and gammas each start on their own cache line
+  return round_up_to_cache_line(num_buckets * alpha_bytes()) +
+         round_up_to_cache_line(num_buckets * sizeof(vec_hash_t));
+#else
+  return round_up_to_cache_line(num_buckets * bucket_bytes());
+#endif
+}
+
+Sketch::Sketch(vec_t vector_len, uint64_t seed, size_t _samples, size_t _cols,
+               SketchAlgorithm algorithm, IndexWidth index_width, DepthHashing depth_hashing) {
+  allocate(SketchParams(vector_len, seed, _samples, _cols, algorithm, index_width,
+                        depth_hashing));
 
   // initialize bucket values
-  for (size_t i = 0; i < num_buckets; ++i) {
-    buckets[i].alpha = 0;
-    buckets[i].gamma = 0;
-  }
+  zero_contents();
 }
 
 Sketch::Sketch(vec_t vector_len, uint64_t seed, std::istream &binary_in, size_t _samples,
-               size_t _cols)
-    : seed(seed) {
-  num_samples = _samples;
-  cols_per_sample = _cols;
-  num_columns = num_samples * cols_per_sample;
-  bkt_per_col = calc_bkt_per_col(vector_len);
-  num_buckets = num_columns * bkt_per_col + 1; // plus 1 for deterministic bucket
-  buckets = new Bucket[num_buckets];
+               size_t _cols, SketchAlgorithm algorithm, IndexWidth index_width,
+               DepthHashing depth_hashing) {
+  allocate(SketchParams(vector_len, seed, _samples, _cols, algorithm, index_width,
+                        depth_hashing));
 
   // Read the serialized Sketch contents
-  binary_in.read((char *)buckets, bucket_array_bytes());
+  deserialize(binary_in);
 }
 
-Sketch::Sketch(const Sketch &s) : seed(s.seed) {
-  num_samples = s.num_samples;
-  cols_per_sample = s.cols_per_sample;
-  num_columns = s.num_columns;
-  bkt_per_col = s.bkt_per_col;
-  num_buckets = s.num_buckets;
-  buckets = new Bucket[num_buckets];
+Sketch::Sketch(vec_t vector_len, uint64_t seed, std::istream &binary_in, SerialType type,
+               size_t _samples, size_t _cols, SketchAlgorithm algorithm,
+               IndexWidth index_width, DepthHashing depth_hashing) {
+  allocate(SketchParams(vector_len, seed, _samples, _cols, algorithm, index_width,
+                        depth_hashing));
+  deserialize(binary_in, type);
+}
 
+Sketch::Sketch(const SketchParams &shape) {
+  allocate(shape);
+  zero_contents();
+}
+
+Sketch::Sketch(const Sketch &s) {
+  allocate(*s.params);
+
+#ifdef SOA_BUCKETS
+  std::memcpy(bucket_alphas, s.bucket_alphas, params->num_buckets * params->alpha_bytes());
+  std::memcpy(bucket_gammas, s.bucket_gammas, params->num_buckets * sizeof(vec_hash_t));
+#elif defined(ROUND_MAJOR_BUCKETS)
+  // s may belong to an arena, so copy column by column
+  for (size_t c = 0; c < params->num_columns; c++)
+    std::memcpy(bucket_ptr(bucket_index(c, 0)), s.bucket_ptr(s.bucket_index(c, 0)),
+                params->bkt_per_col * params->bucket_bytes());
+  set_bucket(deterministic_bucket(), s.get_bucket(s.deterministic_bucket()));
+#else
   std::memcpy(buckets, s.buckets, bucket_array_bytes());
+#endif
 }
 
-Sketch::~Sketch() { delete[] buckets; }
+Sketch::Sketch(const SketchParams *shared_params, void *bucket_memory)
+    : params(shared_params), owns_memory(false) {
+  set_bucket_memory((char *)bucket_memory);
+}
 
-#ifdef L0_SAMPLING
-void Sketch::update(const vec_t update_idx) {
-  vec_hash_t checksum = Bucket_Boruvka::get_index_hash(update_idx, checksum_seed());
+void Sketch::allocate(const SketchParams &sketch_params) {
+  // the parameters and buckets of a standalone sketch share a single allocation
+  size_t params_bytes = round_up_to_cache_line(sizeof(SketchParams));
+  char *mem = (char *)aligned_alloc(bucket_alignment,
+                                    params_bytes + sketch_params.bucket_memory_bytes());
+  if (mem == nullptr) throw std::bad_alloc();
+
+  SketchParams *standalone_params = new (mem) SketchParams(sketch_params);
+#ifdef ROUND_MAJOR_BUCKETS
+  // the columns of a standalone sketch are back to back, even if it copies an arena sketch
+  standalone_params->column_stride = standalone_params->bkt_per_col;
+#endif
+  params = standalone_params;
+  owns_memory = true;
+  set_bucket_memory(mem + params_bytes);
+}
 
-  // Update depth 0 bucket
-  Bucket_Boruvka::update(buckets[num_buckets - 1], update_idx, checksum);
+void Sketch::set_bucket_memory(char *bucket_memory) {
+#ifdef SOA_BUCKETS
+  bucket_alphas = bucket_memory;
+  bucket_gammas = (vec_hash_t *)(bucket_memory + round_up_to_cache_line(
+                                                     params->num_buckets * params->alpha_bytes()));
+#else
+  buckets = bucket_memory;
+#endif
+}
 
-  // Update higher depth buckets
-  for (unsigned i = 0; i < num_columns; ++i) {
-    col_hash_t depth = Bucket_Boruvka::get_index_depth(update_idx, column_seed(i), bkt_per_col);
-    likely_if(depth < bkt_per_col) {
-      for (col_hash_t j = 0; j <= depth; ++j) {
-        size_t bucket_id = i * bkt_per_col + j;
-        Bucket_Boruvka::update(buckets[bucket_id], update_idx, checksum);
+Sketch::~Sketch() {
+  if (owns_memory) {
+    params->~SketchParams();
+    free((void *)params);
+  }
+}
+
+void Sketch::deserialize(std::istream &binary_in, SerialType type) {
+  switch (type) {
+    case FULL:
+      reset_sample_state();
+      read_raw_buckets(binary_in, 0, params->num_buckets);
+      break;
+    case RANGE:
+      deserialize_range(binary_in);
+      break;
+    case SPARSE:
+      deserialize_sparse(binary_in);
+      break;
+    default:
+      binary_in.setstate(std::ios::failbit);
+      break;
+  }
+}
+
+void Sketch::read_raw_buckets(std::istream &binary_in, size_t first_bucket, size_t n) {
+#ifndef CONVERT_RAW_BUCKETS
+  if (!narrow_index()) {
+    binary_in.read((char *)buckets + first_bucket * sizeof(Bucket), n * sizeof(Bucket));
+    return;
+  }
+#endif
+  // the serialized format is the raw bucket format. Read it in chunks and convert
+  Bucket raw_chunk[raw_bucket_chunk];
+  for (size_t base = 0; base < n; base += raw_bucket_chunk) {
+    size_t chunk_bkts = std::min(raw_bucket_chunk, n - base);
+    binary_in.read((char *)raw_chunk, chunk_bkts * sizeof(Bucket));
+    for (size_t i = 0; i < chunk_bkts; i++)
+      set_bucket(bucket_position(first_bucket + base + i), raw_chunk[i]);
+  }
+}
+
+void Sketch::deserialize_range(std::istream &binary_in) {
+  size_t start_sample, n_samples;
+  binary_in.read((char *)&start_sample, sizeof(start_sample));
+  binary_in.read((char *)&n_samples, sizeof(n_samples));
+  zero_contents();
+  if (start_sample + n_samples > params->num_samples) {
+    assert(false);
+    sample_idx = params->num_samples; // sketch is in a fail state!
+    return;
+  }
+
+  // the samples before the range are gone
+  sample_idx = start_sample;
+  size_t sample_buckets = params->cols_per_sample * params->bkt_per_col;
+  read_raw_buckets(binary_in, params->num_buckets - 1, 1);
+  read_raw_buckets(binary_in, start_sample * sample_buckets, n_samples * sample_buckets);
+}
+
+void Sketch::deserialize_sparse(std::istream &binary_in) {
+  zero_contents();
+  uint32_t num_nonzero = 0;
+  binary_in.read((char *)&num_nonzero, sizeof(num_nonzero));
+
+  // the positions read from a stream that failed are garbage, so stop at the first failure.
+  // Positions are strictly increasing and within the sketch, or the stream is corrupt
+  SparseBucket sparse_chunk[raw_bucket_chunk];
+  size_t next_position = 0;
+  for (size_t base = 0; base < num_nonzero && binary_in; base += raw_bucket_chunk) {
+    size_t chunk_bkts = std::min(raw_bucket_chunk, num_nonzero - base);
+    binary_in.read((char *)sparse_chunk, chunk_bkts * sizeof(SparseBucket));
+    if (!binary_in) break;
+    for (size_t i = 0; i < chunk_bkts; i++) {
+      size_t position = sparse_chunk[i].position;
+      if (position < next_position || position >= params->num_buckets) {
+        binary_in.setstate(std::ios::failbit);
+        return;
       }
+      set_bucket(bucket_position(position), sparse_chunk[i].bucket);
+      next_position = position + 1;
     }
   }
 }
-#else  // Use support finding algorithm instead. Faster but no guarantee of uniform sample.
-void Sketch::update(const vec_t update_idx) {
-  vec_hash_t checksum = Bucket_Boruvka::get_index_hash(update_idx, checksum_seed());
+
+struct SketchKernels {
+  void (Sketch::*update)(const vec_t);
+  size_t (Sketch::*update_batch)(const vec_t *, size_t, size_t, size_t, bucket_id_t *);
+  size_t (Sketch::*update_batch_touched)(const vec_t *, size_t, size_t, size_t, bucket_id_t *);
+  SketchSample (Sketch::*sample)(size_t);
+};
+
+// cleared to construct sketches with the generic kernels
+static bool specialized_kernels = true;
+
+template <SketchAlgorithm algorithm, class bucket_t, size_t kBktPerCol>
+void Sketch::update_kernel(const vec_t update_idx) {
+  vec_hash_t checksum = Bucket_Boruvka::get_index_hash(update_idx, checksum_key());
+
+  // bucket stores may alias the shared parameters so keep the ones we need in locals
+  const size_t num_columns = params->num_columns;
+  const size_t bkt_per_col = kBktPerCol ? kBktPerCol : params->bkt_per_col;
+  const size_t col_step = packed_columns ? bkt_per_col : column_stride();
+  const size_t depth_step = depth_stride();
+  const size_t det_bucket = deterministic_bucket();
 
   // Update depth 0 bucket
-  Bucket_Boruvka::update(buckets[num_buckets - 1], update_idx, checksum);
+  update_bucket_as<bucket_t>(det_bucket, update_idx, checksum);
 
   // Update higher depth buckets
-  for (unsigned i = 0; i < num_columns; ++i) {
-    col_hash_t depth = Bucket_Boruvka::get_index_depth(update_idx, column_seed(i), bkt_per_col);
-    size_t bucket_id = i * bkt_per_col + depth;
-    likely_if(depth < bkt_per_col) {
-      Bucket_Boruvka::update(buckets[bucket_id], update_idx, checksum);
+  col_hash_t depths[column_hash_chunk];
+  for (size_t c = 0; c < num_columns; c += column_hash_chunk) {
+    size_t chunk_cols = std::min(column_hash_chunk, num_columns - c);
+    get_depths(update_idx, c, chunk_cols, bkt_per_col, depths);
+    for (size_t i = 0; i < chunk_cols; ++i) {
+      col_hash_t depth = depths[i];
+      likely_if(depth < bkt_per_col) {
+        if (algorithm == CUBE_SKETCH) {
+          for (col_hash_t j = 0; j <= depth; ++j) {
+            update_bucket_as<bucket_t>((c + i) * col_step + j * depth_step, update_idx, checksum);
+          }
+        } else {
+          // Use support finding algorithm instead. Faster but no guarantee of uniform sample.
+          update_bucket_as<bucket_t>((c + i) * col_step + depth * depth_step, update_idx,
+                                     checksum);
+        }
+      }
     }
   }
 }
-#endif
 
-void Sketch::zero_contents() {
-  for (size_t i = 0; i < num_buckets; i++) {
-    buckets[i].alpha = 0;
-    buckets[i].gamma = 0;
+template <SketchAlgorithm algorithm, class bucket_t, size_t kBktPerCol, bool track_touched>
+size_t Sketch::update_batch_kernel(const vec_t *updates, size_t num_updates,
+                                   size_t first_column, size_t end_column,
+                                   bucket_id_t *touched) {
+  vec_hash_t checksums[update_batch_chunk];
+  col_hash_t depths[update_batch_chunk];
+  uint64_t packed_depths[update_batch_chunk];  // with SLICED_DEPTHS
+  size_t num_touched = 0;
+
+  // bucket stores may alias the shared parameters so keep the ones we need in locals
+  const size_t bkt_per_col = kBktPerCol ? kBktPerCol : params->bkt_per_col;
+  const size_t col_step = packed_columns ? bkt_per_col : column_stride();
+  const size_t depth_step = depth_stride();
+  const size_t det_bucket = deterministic_bucket();
+
+  for (size_t base = 0; base < num_updates; base += update_batch_chunk) {
+    const vec_t *chunk = updates + base;
+    size_t chunk_size = std::min(update_batch_chunk, num_updates - base);
+
+    // Compute checksums and update depth 0 bucket
+    Bucket_Boruvka::get_batch_hashes(chunk, chunk_size, checksum_seed(), checksums);
+    for (size_t u = 0; u < chunk_size; ++u) {
+      update_bucket_as<bucket_t>(det_bucket, chunk[u], checksums[u]);
+    }
+
+    // Update higher depth buckets
+    for (size_t i = first_column; i < end_column; ++i) {
+      get_batch_depths(chunk, chunk_size, i, bkt_per_col, i == first_column, packed_depths,
+                       depths);
+      for (size_t u = 0; u < chunk_size; ++u) {
+        col_hash_t depth = depths[u];
+        likely_if(depth < bkt_per_col) {
+          size_t bucket_id = i * col_step + depth * depth_step;
+          if (algorithm == CUBE_SKETCH) {
+            for (col_hash_t j = 0; j <= depth; ++j) {
+              update_bucket_as<bucket_t>(i * col_step + j * depth_step, chunk[u], checksums[u]);
+            }
+          } else {
+            update_bucket_as<bucket_t>(bucket_id, chunk[u], checksums[u]);
+          }
+          // CubeSketch records only the deepest bucket, merge_touched() covers the ones below it
+          if (track_touched) touched[num_touched++] = bucket_id;
+        }
+      }
+    }
+  }
+  if (track_touched && num_updates > 0) touched[num_touched++] = det_bucket;
+  return num_touched;
+}
+
+template <class bucket_t, size_t kColsPerSample, size_t kBktPerCol>
+SketchSample Sketch::sample_kernel(size_t first_column) {
+  const size_t bkt_per_col = kBktPerCol ? kBktPerCol : params->bkt_per_col;
+  const size_t cols_per_sample = kColsPerSample ? kColsPerSample : params->cols_per_sample;
+
+  // the buckets of a sample are contiguous. Hash their alphas in chunks and return the first
+  // good bucket
+  vec_t scratch[column_hash_chunk];
+  vec_hash_t hashes[column_hash_chunk];
+  size_t first_bucket = first_column * bkt_per_col;
+  size_t sample_buckets = cols_per_sample * bkt_per_col;
+  for (size_t c = 0; c < sample_buckets; c += column_hash_chunk) {
+    size_t chunk_bkts = std::min(column_hash_chunk, sample_buckets - c);
+    const vec_t *alphas = load_alphas<bucket_t>(first_bucket + c, chunk_bkts, scratch);
+
+    Bucket_Boruvka::get_batch_hashes(alphas, chunk_bkts, checksum_seed(), hashes);
+    for (size_t b = 0; b < chunk_bkts; ++b) {
+      if (bucket_gamma_as<bucket_t>(bucket_position(first_bucket + c + b)) == hashes[b])
+        return {alphas[b], GOOD};
+    }
+  }
+  return {0, FAIL};
+}
+
+template <SketchAlgorithm algorithm, class bucket_t, size_t kColsPerSample, size_t... kDepths>
+const SketchKernels *Sketch::kernel_table(std::index_sequence<kDepths...>) {
+  static const SketchKernels table[] = {
+      {&Sketch::update_kernel<algorithm, bucket_t, min_kernel_depth + kDepths>,
+       &Sketch::update_batch_kernel<algorithm, bucket_t, min_kernel_depth + kDepths, false>,
+       &Sketch::update_batch_kernel<algorithm, bucket_t, min_kernel_depth + kDepths, true>,
+       &Sketch::sample_kernel<bucket_t, kColsPerSample, min_kernel_depth + kDepths>}...};
+  return table;
+}
+
+template <SketchAlgorithm algorithm, class bucket_t>
+const SketchKernels *Sketch::generic_kernels() {
+  static const SketchKernels kernels = {&Sketch::update_kernel<algorithm, bucket_t, 0>,
+                                        &Sketch::update_batch_kernel<algorithm, bucket_t, 0, false>,
+                                        &Sketch::update_batch_kernel<algorithm, bucket_t, 0, true>,
+                                        &Sketch::sample_kernel<bucket_t, 0, 0>};
+  return &kernels;
+}
+
+template <class bucket_t>
+const SketchKernels *Sketch::select_kernels(SketchAlgorithm algorithm, size_t cols_per_sample,
+                                            size_t bkt_per_col) {
+  using kernel_depths = std::make_index_sequence<max_kernel_depth - min_kernel_depth + 1>;
+  bool specialized = specialized_kernels && bkt_per_col >= min_kernel_depth &&
+                     bkt_per_col <= max_kernel_depth;
+  size_t idx = bkt_per_col - min_kernel_depth;
+
+  // the sample kernel is only specialized for the default number of columns per sample
+  if (algorithm == CUBE_SKETCH) {
+    if (!specialized) return generic_kernels<CUBE_SKETCH, bucket_t>();
+    if (cols_per_sample == cube_cols_per_sample)
+      return kernel_table<CUBE_SKETCH, bucket_t, cube_cols_per_sample>(kernel_depths()) + idx;
+    return kernel_table<CUBE_SKETCH, bucket_t, 0>(kernel_depths()) + idx;
+  } else {
+    if (!specialized) return generic_kernels<CAMEO_SKETCH, bucket_t>();
+    if (cols_per_sample == cameo_cols_per_sample)
+      return kernel_table<CAMEO_SKETCH, bucket_t, cameo_cols_per_sample>(kernel_depths()) + idx;
+    return kernel_table<CAMEO_SKETCH, bucket_t, 0>(kernel_depths()) + idx;
+  }
+}
+
+const SketchKernels *Sketch::select_kernels(const SketchParams &shape) {
+  if (shape.index_width == NARROW_INDEX)
+    return select_kernels<NarrowBucket>(shape.algorithm, shape.cols_per_sample,
+                                        shape.bkt_per_col);
+  return select_kernels<Bucket>(shape.algorithm, shape.cols_per_sample, shape.bkt_per_col);
+}
+
+void Sketch::use_specialized_kernels(bool specialized) { specialized_kernels = specialized; }
+
+void Sketch::update(const vec_t update_idx) { (this->*params->kernels->update)(update_idx); }
+
+void Sketch::update_batch(const vec_t *updates, size_t num_updates) {
+  (this->*params->kernels->update_batch)(updates, num_updates, 0, params->num_columns, nullptr);
+}
+
+size_t Sketch::update_batch(const vec_t *updates, size_t num_updates, bucket_id_t *touched) {
+  return (this->*params->kernels->update_batch_touched)(updates, num_updates, 0,
+                                                        params->num_columns, touched);
+}
+
+void Sketch::range_update_batch(const vec_t *updates, size_t num_updates, size_t start_sample,
+                                size_t n_samples) {
+  if (start_sample + n_samples > params->num_samples) {
+    assert(false);
+    sample_idx = params->num_samples; // sketch is in a fail state!
+    return;
   }
+
+  // update sample idx to point at beginning of this range if before it
+  sample_idx = std::max(sample_idx, start_sample);
+  (this->*params->kernels->update_batch)(updates, num_updates,
+                                        start_sample * params->cols_per_sample,
+                                        (start_sample + n_samples) * params->cols_per_sample,
+                                        nullptr);
+}
+
+void Sketch::zero_contents() {
+#ifdef SOA_BUCKETS
+  Bucket_Boruvka::zero_bucket_memory(bucket_alphas, params->num_buckets * params->alpha_bytes());
+  Bucket_Boruvka::zero_bucket_memory(bucket_gammas, params->num_buckets * sizeof(vec_hash_t));
+#elif defined(ROUND_MAJOR_BUCKETS)
+  // the columns of an arena sketch are not adjacent
+  for (size_t c = 0; c < params->num_columns; c++)
+    Bucket_Boruvka::zero_bucket_memory(bucket_ptr(bucket_index(c, 0)),
+                                       params->bkt_per_col * params->bucket_bytes());
+  set_bucket(deterministic_bucket(), {0, 0});
+#else
+  Bucket_Boruvka::zero_bucket_memory(buckets, bucket_array_bytes());
+#endif
   reset_sample_state();
 }
 
+template <class bucket_t>
+const vec_t *Sketch::load_alphas(size_t first_bucket, size_t n, vec_t *scratch) const {
+#if defined(SOA_BUCKETS) && !defined(DEPTH_MAJOR_BUCKETS)
+  if (std::is_same<decltype(bucket_t::alpha), vec_t>::value)
+    return (const vec_t *)bucket_alphas + first_bucket;
+#endif
+  for (size_t b = 0; b < n; ++b)
+    scratch[b] = bucket_alpha_as<bucket_t>(bucket_position(first_bucket + b));
+  return scratch;
+}
+
 SketchSample Sketch::sample() {
-  if (sample_idx >= num_samples) {
-    throw OutOfSamplesException(seed, num_samples, sample_idx);
+  if (sample_idx >= params->num_samples) {
+    throw OutOfSamplesException(params->seed, params->num_samples, sample_idx);
   }
 
   size_t idx = sample_idx++;
-  size_t first_column = idx * cols_per_sample;
+  size_t first_column = idx * params->cols_per_sample;
+  size_t det_bucket = deterministic_bucket();
 
-  if (buckets[num_buckets - 1].alpha == 0 && buckets[num_buckets - 1].gamma == 0)
+  if (bucket_alpha(det_bucket) == 0 && bucket_gamma(det_bucket) == 0)
     return {0, ZERO};  // the "first" bucket is deterministic so if all zero then no edges to return
 
-  if (Bucket_Boruvka::is_good(buckets[num_buckets - 1], checksum_seed()))
-    return {buckets[num_buckets - 1].alpha, GOOD};
+  if (Bucket_Boruvka::is_good(get_bucket(det_bucket), checksum_key()))
+    return {bucket_alpha(det_bucket), GOOD};
 
-  for (size_t i = 0; i < cols_per_sample; ++i) {
-    for (size_t j = 0; j < bkt_per_col; ++j) {
-      size_t bucket_id = (i + first_column) * bkt_per_col + j;
-      if (Bucket_Boruvka::is_good(buckets[bucket_id], checksum_seed()))
-        return {buckets[bucket_id].alpha, GOOD};
-    }
-  }
-  return {0, FAIL};
+  return (this->*params->kernels->sample)(first_column);
 }
 
 ExhaustiveSketchSample Sketch::exhaustive_sample() {
-  if (sample_idx >= num_samples) {
-    throw OutOfSamplesException(seed, num_samples, sample_idx);
+  if (sample_idx >= params->num_samples) {
+    throw OutOfSamplesException(params->seed, params->num_samples, sample_idx);
   }
   std::unordered_set<vec_t> ret;
 
   size_t idx = sample_idx++;
-  size_t first_column = idx * cols_per_sample;
+  size_t first_column = idx * params->cols_per_sample;
+  size_t det_bucket = deterministic_bucket();
 
-  unlikely_if (buckets[num_buckets - 1].alpha == 0 && buckets[num_buckets - 1].gamma == 0)
+  unlikely_if (bucket_alpha(det_bucket) == 0 && bucket_gamma(det_bucket) == 0)
     return {ret, ZERO}; // the "first" bucket is deterministic so if zero then no edges to return
 
-  unlikely_if (Bucket_Boruvka::is_good(buckets[num_buckets - 1], checksum_seed())) {
-    ret.insert(buckets[num_buckets - 1].alpha);
+  unlikely_if (Bucket_Boruvka::is_good(get_bucket(det_bucket), checksum_key())) {
+    ret.insert(bucket_alpha(det_bucket));
     return {ret, GOOD};
   }
 
-  for (size_t i = 0; i < cols_per_sample; ++i) {
-    for (size_t j = 0; j < bkt_per_col; ++j) {
-      size_t bucket_id = (i + first_column) * bkt_per_col + j;
-      unlikely_if (Bucket_Boruvka::is_good(buckets[bucket_id], checksum_seed())) {
-        ret.insert(buckets[bucket_id].alpha);
+  vec_t scratch[column_hash_chunk];
+  vec_hash_t hashes[column_hash_chunk];
+  size_t first_bucket = first_column * params->bkt_per_col;
+  size_t sample_buckets = params->cols_per_sample * params->bkt_per_col;
+  for (size_t c = 0; c < sample_buckets; c += column_hash_chunk) {
+    size_t chunk_bkts = std::min(column_hash_chunk, sample_buckets - c);
+    const vec_t *alphas = narrow_index()
+                              ? load_alphas<NarrowBucket>(first_bucket + c, chunk_bkts, scratch)
+                              : load_alphas<Bucket>(first_bucket + c, chunk_bkts, scratch);
+
+    Bucket_Boruvka::get_batch_hashes(alphas, chunk_bkts, checksum_seed(), hashes);
+    for (size_t b = 0; b < chunk_bkts; ++b) {
+      unlikely_if (bucket_gamma(bucket_position(first_bucket + c + b)) == hashes[b]) {
+        ret.insert(alphas[b]);
       }
     }
   }
@@ -147,16 +529,26 @@ ExhaustiveSketchSample Sketch::exhaustive_sample() {
 }
 
 void Sketch::merge(const Sketch &other) {
-  for (size_t i = 0; i < num_buckets; ++i) {
-    buckets[i].alpha ^= other.buckets[i].alpha;
-    buckets[i].gamma ^= other.buckets[i].gamma;
-  }
+#ifdef SOA_BUCKETS
+  Bucket_Boruvka::xor_bucket_memory(bucket_alphas, other.bucket_alphas,
+                                    params->num_buckets * params->alpha_bytes());
+  Bucket_Boruvka::xor_bucket_memory(bucket_gammas, other.bucket_gammas,
+                                    params->num_buckets * sizeof(vec_hash_t));
+#elif defined(ROUND_MAJOR_BUCKETS)
+  // either sketch may belong to an arena, so merge column by column
+  for (size_t c = 0; c < params->num_columns; c++)
+    merge_bucket_range(other, bucket_index(c, 0), other.bucket_index(c, 0), params->bkt_per_col);
+  update_bucket(deterministic_bucket(), other.bucket_alpha(other.deterministic_bucket()),
+                other.bucket_gamma(other.deterministic_bucket()));
+#else
+  Bucket_Boruvka::xor_bucket_memory(buckets, other.buckets, bucket_array_bytes());
+#endif
 }
 
 void Sketch::range_merge(const Sketch &other, size_t start_sample, size_t n_samples) {
-  if (start_sample + n_samples > num_samples) {
+  if (start_sample + n_samples > params->num_samples) {
     assert(false);
-    sample_idx = num_samples; // sketch is in a fail state!
+    sample_idx = params->num_samples; // sketch is in a fail state!
     return;
   }
 
@@ -164,38 +556,275 @@ void Sketch::range_merge(const Sketch &other, size_t start_sample, size_t n_samp
   sample_idx = std::max(sample_idx, start_sample);
 
   // merge deterministic buffer
-  buckets[num_buckets - 1].alpha ^= other.buckets[num_buckets - 1].alpha;
-  buckets[num_buckets - 1].gamma ^= other.buckets[num_buckets - 1].gamma;
+  update_bucket(deterministic_bucket(), other.bucket_alpha(other.deterministic_bucket()),
+                other.bucket_gamma(other.deterministic_bucket()));
 
   // merge other buckets
-  size_t start_bucket_id = start_sample * cols_per_sample * bkt_per_col;
-  size_t n_buckets = n_samples * cols_per_sample * bkt_per_col;
-
-  for (size_t i = 0; i < n_buckets; i++) {
-    size_t bucket_id = start_bucket_id + i;
-    buckets[bucket_id].alpha ^= other.buckets[bucket_id].alpha;
-    buckets[bucket_id].gamma ^= other.buckets[bucket_id].gamma;
+#ifdef DEPTH_MAJOR_BUCKETS
+  // the buckets of the range are the same columns at every depth
+  size_t start_column = start_sample * params->cols_per_sample;
+  size_t n_columns = n_samples * params->cols_per_sample;
+  for (size_t j = 0; j < params->bkt_per_col; j++) {
+    size_t first = bucket_index(start_column, j);
+    if (n_columns < min_kernel_buckets) {
+      for (size_t i = first; i < first + n_columns; i++)
+        update_bucket(i, other.bucket_alpha(i), other.bucket_gamma(i));
+    } else {
+      merge_bucket_range(other, first, first, n_columns);
+    }
   }
+#elif defined(ROUND_MAJOR_BUCKETS)
+  // the columns of an arena sketch are not adjacent so merge them one at a time
+  size_t start_column = start_sample * params->cols_per_sample;
+  size_t end_column = start_column + n_samples * params->cols_per_sample;
+  for (size_t c = start_column; c < end_column; c++)
+    merge_bucket_range(other, bucket_index(c, 0), other.bucket_index(c, 0), params->bkt_per_col);
+#else
+  size_t start_bucket_id = start_sample * params->cols_per_sample * params->bkt_per_col;
+  size_t n_buckets = n_samples * params->cols_per_sample * params->bkt_per_col;
+  merge_bucket_range(other, start_bucket_id, start_bucket_id, n_buckets);
+#endif
+}
+
+void Sketch::merge_bucket_range(const Sketch &other, size_t first_bucket, size_t other_first,
+                                size_t n_buckets) {
+#ifdef SOA_BUCKETS
+  Bucket_Boruvka::xor_bucket_memory(alpha_ptr(first_bucket), other.alpha_ptr(other_first),
+                                    n_buckets * params->alpha_bytes());
+  Bucket_Boruvka::xor_bucket_memory(bucket_gammas + first_bucket,
+                                    other.bucket_gammas + other_first,
+                                    n_buckets * sizeof(vec_hash_t));
+#else
+  Bucket_Boruvka::xor_bucket_memory(bucket_ptr(first_bucket), other.bucket_ptr(other_first),
+                                    n_buckets * params->bucket_bytes());
+#endif
 }
 
 void Sketch::merge_raw_bucket_buffer(const Bucket *raw_buckets) {
-  for (size_t i = 0; i < num_buckets; i++) {
-    buckets[i].alpha ^= raw_buckets[i].alpha;
-    buckets[i].gamma ^= raw_buckets[i].gamma;
+#if defined(ROUND_MAJOR_BUCKETS)
+  if (!narrow_index()) {
+    // each column is contiguous in both formats
+    for (size_t c = 0; c < params->num_columns; c++)
+      Bucket_Boruvka::xor_bucket_memory(bucket_ptr(bucket_index(c, 0)),
+                                        raw_buckets + c * params->bkt_per_col,
+                                        params->bkt_per_col * sizeof(Bucket));
+    const Bucket &raw_det = raw_buckets[params->num_buckets - 1];
+    update_bucket(deterministic_bucket(), raw_det.alpha, raw_det.gamma);
+    return;
+  }
+#elif !defined(CONVERT_RAW_BUCKETS)
+  if (!narrow_index()) {
+    Bucket_Boruvka::xor_bucket_memory(buckets, raw_buckets, bucket_array_bytes());
+    return;
   }
+#endif
+  for (size_t i = 0; i < params->num_buckets; i++) {
+    update_bucket(bucket_position(i), raw_buckets[i].alpha, raw_buckets[i].gamma);
+  }
+}
+
+void Sketch::merge_touched(Sketch &delta, const bucket_id_t *touched, size_t num_touched) {
+  // a bucket that is visited again is already zero in delta
+  auto merge_bucket = [&](size_t bucket_id) {
+    update_bucket(matching_bucket(delta, bucket_id), delta.bucket_alpha(bucket_id),
+                  delta.bucket_gamma(bucket_id));
+    delta.set_bucket(bucket_id, {0, 0});
+  };
+  for (size_t i = 0; i < num_touched; i++) delta.visit_touched(touched[i], merge_bucket);
+}
+
+#ifdef SOA_BUCKETS
+// a 64 bit word that may be used to access the 32 bit gammas two at a time
+typedef uint64_t __attribute__((may_alias)) bucket_word_t;
+
+template <class T>
+static inline void atomic_xor(T *dst, T val) {
+  if (val != 0) __atomic_fetch_xor(dst, val, __ATOMIC_RELAXED);
+}
+
+// XOR n words of src into dst with atomic XORs
+template <class T>
+static inline void atomic_xor_array(T *dst, const T *src, size_t n) {
+  for (size_t i = 0; i < n; i++) atomic_xor(&dst[i], src[i]);
 }
 
-void Sketch::serialize(std::ostream &binary_out) const {
-  binary_out.write((char*) buckets, bucket_array_bytes());
+void Sketch::atomic_merge(const Sketch &other) {
+  size_t num_buckets = params->num_buckets;
+  if (narrow_index())
+    atomic_xor_array(alpha_array<NarrowBucket>(), other.alpha_array<NarrowBucket>(), num_buckets);
+  else
+    atomic_xor_array(alpha_array<Bucket>(), other.alpha_array<Bucket>(), num_buckets);
+
+  // merge the gammas a word at a time. The gamma array is cache line aligned
+  size_t num_words = num_buckets * sizeof(vec_hash_t) / sizeof(bucket_word_t);
+  bucket_word_t *gamma_words = (bucket_word_t *)bucket_gammas;
+  const bucket_word_t *other_words = (const bucket_word_t *)other.bucket_gammas;
+  for (size_t w = 0; w < num_words; w++) atomic_xor(&gamma_words[w], other_words[w]);
+  for (size_t i = num_words * sizeof(bucket_word_t) / sizeof(vec_hash_t); i < num_buckets; i++)
+    atomic_xor(&bucket_gammas[i], other.bucket_gammas[i]);
+}
+
+void Sketch::atomic_merge_touched(Sketch &delta, const bucket_id_t *touched,
+                                  size_t num_touched) {
+  auto merge_bucket = [&](size_t bucket_id) {
+    if (narrow_index())
+      atomic_xor(&alpha_array<NarrowBucket>()[bucket_id],
+                 delta.alpha_array<NarrowBucket>()[bucket_id]);
+    else
+      atomic_xor(&alpha_array<Bucket>()[bucket_id], delta.alpha_array<Bucket>()[bucket_id]);
+    atomic_xor(&bucket_gammas[bucket_id], delta.bucket_gammas[bucket_id]);
+    delta.set_bucket(bucket_id, {0, 0});
+  };
+  for (size_t i = 0; i < num_touched; i++) delta.visit_touched(touched[i], merge_bucket);
+}
+
+void Sketch::atomic_merge_raw_bucket_buffer(const Bucket *raw_buckets) {
+  for (size_t i = 0; i < params->num_buckets; i++) {
+    size_t bucket_id = bucket_position(i);
+    if (narrow_index())
+      atomic_xor(&alpha_array<NarrowBucket>()[bucket_id], uint32_t(raw_buckets[i].alpha));
+    else
+      atomic_xor(&alpha_array<Bucket>()[bucket_id], raw_buckets[i].alpha);
+    atomic_xor(&bucket_gammas[bucket_id], raw_buckets[i].gamma);
+  }
+}
+#endif
+
+void Sketch::copy_to_raw_bucket_buffer(Bucket *raw_buckets) const {
+#if defined(ROUND_MAJOR_BUCKETS)
+  if (!narrow_index()) {
+    for (size_t c = 0; c < params->num_columns; c++)
+      std::memcpy(raw_buckets + c * params->bkt_per_col, bucket_ptr(bucket_index(c, 0)),
+                  params->bkt_per_col * sizeof(Bucket));
+    raw_buckets[params->num_buckets - 1] = get_bucket(deterministic_bucket());
+    return;
+  }
+#elif !defined(CONVERT_RAW_BUCKETS)
+  if (!narrow_index()) {
+    std::memcpy(raw_buckets, buckets, bucket_array_bytes());
+    return;
+  }
+#endif
+  for (size_t i = 0; i < params->num_buckets; i++) raw_buckets[i] = get_bucket(bucket_position(i));
+}
+
+void Sketch::serialize(std::ostream &binary_out, SerialType type) const {
+  switch (type) {
+    case FULL:
+      write_raw_buckets(binary_out, 0, params->num_buckets);
+      break;
+    case RANGE:
+      serialize_range(binary_out, sample_idx, params->num_samples - sample_idx);
+      break;
+    case SPARSE:
+      serialize_sparse(binary_out);
+      break;
+  }
+}
+
+void Sketch::write_raw_buckets(std::ostream &binary_out, size_t first_bucket, size_t n) const {
+#ifndef CONVERT_RAW_BUCKETS
+  if (!narrow_index()) {
+    binary_out.write((char *)buckets + first_bucket * sizeof(Bucket), n * sizeof(Bucket));
+    return;
+  }
+#endif
+  // serialize in the raw bucket format so the format does not depend upon the layout
+  Bucket raw_chunk[raw_bucket_chunk];
+  for (size_t base = 0; base < n; base += raw_bucket_chunk) {
+    size_t chunk_bkts = std::min(raw_bucket_chunk, n - base);
+    for (size_t i = 0; i < chunk_bkts; i++)
+      raw_chunk[i] = get_bucket(bucket_position(first_bucket + base + i));
+    binary_out.write((char *)raw_chunk, chunk_bkts * sizeof(Bucket));
+  }
+}
+
+// RANGE format: the first sample and number of samples (size_ts), the deterministic bucket and
+// then the raw buckets of the columns of the samples
+void Sketch::serialize_range(std::ostream &binary_out, size_t start_sample,
+                             size_t n_samples) const {
+  assert(start_sample + n_samples <= params->num_samples);
+  binary_out.write((char *)&start_sample, sizeof(start_sample));
+  binary_out.write((char *)&n_samples, sizeof(n_samples));
+
+  size_t sample_buckets = params->cols_per_sample * params->bkt_per_col;
+  write_raw_buckets(binary_out, params->num_buckets - 1, 1);
+  write_raw_buckets(binary_out, start_sample * sample_buckets, n_samples * sample_buckets);
+}
+
+template <class Func>
+void Sketch::for_each_nonzero_bucket(Func &&func) const {
+  if (narrow_index()) for_each_nonzero_bucket_as<NarrowBucket>(func);
+  else for_each_nonzero_bucket_as<Bucket>(func);
+}
+
+template <class bucket_t, class Func>
+void Sketch::for_each_nonzero_bucket_as(Func &&func) const {
+  size_t i = 0;
+#ifndef CONVERT_RAW_BUCKETS
+  // the buckets are stored back to back in column-major order, so test a group of them at once
+  // by ORing their words together. Most buckets of a sparse sketch are zero
+  constexpr size_t group_bkts = 8;
+  constexpr size_t group_words = group_bkts * sizeof(bucket_t) / sizeof(uint64_t);
+  const char *mem = (const char *)buckets;
+  for (; i + group_bkts <= params->num_buckets; i += group_bkts) {
+    const char *group = mem + i * sizeof(bucket_t);
+    uint64_t any = 0;
+    for (size_t w = 0; w < group_words; w++) {
+      uint64_t word;
+      std::memcpy(&word, group + w * sizeof(uint64_t), sizeof(uint64_t));
+      any |= word;
+    }
+    if (any == 0) continue;
+    for (size_t b = i; b < i + group_bkts; b++) {
+      const bucket_t &bkt = ((const bucket_t *)buckets)[b];
+      if (bkt.alpha != 0 || bkt.gamma != 0) func(b, Bucket{bkt.alpha, bkt.gamma});
+    }
+  }
+#endif
+  for (; i < params->num_buckets; i++) {
+    size_t b = bucket_position(i);
+    vec_t alpha = bucket_alpha_as<bucket_t>(b);
+    vec_hash_t gamma = bucket_gamma_as<bucket_t>(b);
+    if (alpha != 0 || gamma != 0) func(i, Bucket{alpha, gamma});
+  }
+}
+
+size_t Sketch::nonzero_buckets() const {
+  size_t num_nonzero = 0;
+  for_each_nonzero_bucket([&](size_t, const Bucket &) { ++num_nonzero; });
+  return num_nonzero;
+}
+
+// SPARSE format: the number of non-zero buckets (a uint32_t) followed by a SparseBucket for each
+// of them in column-major order
+void Sketch::serialize_sparse(std::ostream &binary_out) const {
+  uint32_t num_nonzero = nonzero_buckets();
+  binary_out.write((char *)&num_nonzero, sizeof(num_nonzero));
+
+  SparseBucket sparse_chunk[raw_bucket_chunk];
+  size_t chunk_bkts = 0;
+  for_each_nonzero_bucket([&](size_t i, const Bucket &bkt) {
+    sparse_chunk[chunk_bkts++] = {uint32_t(i), bkt};
+    if (chunk_bkts == raw_bucket_chunk) {
+      binary_out.write((char *)sparse_chunk, chunk_bkts * sizeof(SparseBucket));
+      chunk_bkts = 0;
+    }
+  });
+  binary_out.write((char *)sparse_chunk, chunk_bkts * sizeof(SparseBucket));
 }
 
 bool operator==(const Sketch &sketch1, const Sketch &sketch2) {
-  if (sketch1.num_buckets != sketch2.num_buckets || sketch1.seed != sketch2.seed)
+  if (sketch1.params->num_buckets != sketch2.params->num_buckets ||
+      sketch1.params->seed != sketch2.params->seed)
     return false;
 
-  for (size_t i = 0; i < sketch1.num_buckets; ++i) {
-    if (sketch1.buckets[i].alpha != sketch2.buckets[i].alpha ||
-        sketch1.buckets[i].gamma != sketch2.buckets[i].gamma) {
+  // compare by column-major index, the sketches may be stored with different strides
+  for (size_t i = 0; i < sketch1.params->num_buckets; ++i) {
+    size_t bucket1 = sketch1.bucket_position(i);
+    size_t bucket2 = sketch2.bucket_position(i);
+    if (sketch1.bucket_alpha(bucket1) != sketch2.bucket_alpha(bucket2) ||
+        sketch1.bucket_gamma(bucket1) != sketch2.bucket_gamma(bucket2)) {
       return false;
     }
   }
@@ -204,20 +833,19 @@ bool operator==(const Sketch &sketch1, const Sketch &sketch2) {
 }
 
 std::ostream &operator<<(std::ostream &os, const Sketch &sketch) {
-  Bucket bkt = sketch.buckets[sketch.num_buckets - 1];
-  bool good = Bucket_Boruvka::is_good(bkt, sketch.checksum_seed());
+  Bucket bkt = sketch.get_bucket(sketch.deterministic_bucket());
+  bool good = Bucket_Boruvka::is_good(bkt, sketch.checksum_key());
   vec_t a = bkt.alpha;
   vec_hash_t c = bkt.gamma;
 
   os << " a:" << a << " c:" << c << (good ? " good" : " bad") << std::endl;
 
-  for (unsigned i = 0; i < sketch.num_columns; ++i) {
-    for (unsigned j = 0; j < sketch.bkt_per_col; ++j) {
-      unsigned bucket_id = i * sketch.bkt_per_col + j;
-      Bucket bkt = sketch.buckets[bucket_id];
+  for (unsigned i = 0; i < sketch.params->num_columns; ++i) {
+    for (unsigned j = 0; j < sketch.params->bkt_per_col; ++j) {
+      Bucket bkt = sketch.get_bucket(sketch.bucket_index(i, j));
       vec_t a = bkt.alpha;
       vec_hash_t c = bkt.gamma;
-      bool good = Bucket_Boruvka::is_good(bkt, sketch.checksum_seed());
+      bool good = Bucket_Boruvka::is_good(bkt, sketch.checksum_key());
 
       os << " a:" << a << " c:" << c << (good ? " good" : " bad") << std::endl;
     }
@@ -0,0 +1,101 @@
+#include "sketch_arena.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <new>
+#include <system_error>
+
+constexpr size_t SketchArena::huge_page_size;
+
+static size_t round_up(size_t bytes, size_t multiple) {
+  return (bytes + multiple - 1) / multiple * multiple;
+}
+
+SketchArena::SketchArena(size_t num_sketches, vec_t vector_len, uint64_t seed,
+                         size_t num_samples, size_t cols_per_sample, HugePageMode mode,
+                         SketchAlgorithm algorithm, IndexWidth index_width,
+                         DepthHashing depth_hashing)
+    : params(vector_len, seed, num_samples, cols_per_sample, algorithm, index_width,
+             depth_hashing),
+      num_sketches(num_sketches) {
+  init_layout();
+  map_slab(mode);
+  create_sketches();
+}
+
+SketchArena::SketchArena(int fd, size_t offset, size_t num_sketches, vec_t vector_len,
+                         uint64_t seed, size_t num_samples, size_t cols_per_sample,
+                         SketchAlgorithm algorithm, IndexWidth index_width,
+                         DepthHashing depth_hashing, bool shared)
+    : params(vector_len, seed, num_samples, cols_per_sample, algorithm, index_width,
+             depth_hashing),
+      num_sketches(num_sketches) {
+  init_layout();
+  map_file(fd, offset, shared);
+  create_sketches();
+}
+
+void SketchArena::init_layout() {
+#ifdef ROUND_MAJOR_BUCKETS
+  // column c of sketch i starts at bucket (c * num_sketches + i) * bkt_per_col, so column c of
+  // every sketch forms one region. The deterministic buckets use the region after the last column
+  params.column_stride = num_sketches * params.bkt_per_col;
+  sketch_bytes = params.bkt_per_col * params.bucket_bytes();
+  data_bytes = (params.num_columns + 1) * params.column_stride * params.bucket_bytes();
+#else
+  sketch_bytes = params.bucket_memory_bytes();
+  data_bytes = num_sketches * sketch_bytes;
+#endif
+}
+
+void SketchArena::create_sketches() {
+  // the slab already holds the buckets so the sketches do not need to touch them
+  sketches = static_cast<Sketch *>(::operator new(num_sketches * sizeof(Sketch)));
+  for (size_t i = 0; i < num_sketches; i++) {
+    new (&sketches[i]) Sketch(&params, slab + i * sketch_bytes);
+  }
+}
+
+SketchArena::~SketchArena() {
+  for (size_t i = 0; i < num_sketches; i++) sketches[i].~Sketch();
+  ::operator delete(sketches);
+  munmap(slab, slab_bytes);
+}
+
+void SketchArena::map_slab(HugePageMode mode) {
+  size_t bytes = data_bytes;
+  void *mem = MAP_FAILED;
+
+  if (mode == EXPLICIT_HUGE_PAGES) {
+    slab_bytes = round_up(bytes, huge_page_size);
+    mem = mmap(nullptr, slab_bytes, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    // no huge pages have been reserved. Ask for transparent huge pages instead
+    if (mem == MAP_FAILED) mode = TRANSPARENT_HUGE_PAGES;
+  }
+  if (mem == MAP_FAILED) {
+    slab_bytes = round_up(bytes, mode == TRANSPARENT_HUGE_PAGES ? huge_page_size
+                                                                 : (size_t)sysconf(_SC_PAGESIZE));
+    mem = mmap(nullptr, slab_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) throw std::bad_alloc();
+
+    // THP is a hint, if the kernel does not support it we simply use regular pages
+    if (mode == TRANSPARENT_HUGE_PAGES && madvise(mem, slab_bytes, MADV_HUGEPAGE) != 0)
+      mode = NO_HUGE_PAGES;
+  }
+
+  slab = static_cast<char *>(mem);
+  huge_pages = mode;
+}
+
+void SketchArena::map_file(int fd, size_t offset, bool shared) {
+  slab_bytes = round_up(data_bytes, (size_t)sysconf(_SC_PAGESIZE));
+  void *mem = mmap(nullptr, slab_bytes, PROT_READ | PROT_WRITE, shared ? MAP_SHARED : MAP_PRIVATE,
+                   fd, offset);
+  if (mem == MAP_FAILED) throw std::system_error(errno, std::generic_category(), "mmap");
+
+  slab = static_cast<char *>(mem);
+  huge_pages = NO_HUGE_PAGES;
+}
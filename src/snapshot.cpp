@@ -0,0 +1,145 @@
+#include "snapshot.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#include <xxhash.h>
+
+static_assert(std::is_trivially_copyable<SnapshotHeader>::value,
+              "SnapshotHeader is written to and read from files as is");
+
+// the bucket layout compilation definitions that change the slab of a SketchArena
+static uint32_t bucket_layout() {
+  uint32_t layout = 0;
+#ifdef SOA_BUCKETS
+  layout |= 1 << 0;
+#endif
+#ifdef DEPTH_MAJOR_BUCKETS
+  layout |= 1 << 1;
+#endif
+#ifdef ROUND_MAJOR_BUCKETS
+  layout |= 1 << 2;
+#endif
+  return layout;
+}
+
+uint64_t Snapshot::checksum(const void *data, size_t bytes) { return XXH3_64bits(data, bytes); }
+
+void Snapshot::describe(SnapshotHeader &header, const SketchArena &arena) {
+  const SketchParams &params = arena.get_params();
+  std::memcpy(header.magic, magic, sizeof(magic));
+  header.version = version;
+  header.header_bytes = sizeof(SnapshotHeader);
+  header.num_samples = params.num_samples;
+  header.cols_per_sample = params.cols_per_sample;
+  header.bkt_per_col = params.bkt_per_col;
+  header.num_buckets = params.num_buckets;
+  header.sketch_bytes = arena.get_sketch_bytes();
+  header.algorithm = params.algorithm;
+  header.index_width = params.index_width;
+  header.depth_hashing = params.depth_hashing;
+  header.bucket_layout = bucket_layout();
+  header.hash_policy = sketch_hash_policy;
+  header.padding = 0;
+}
+
+void Snapshot::seal(SnapshotHeader &header) {
+  header.header_checksum = checksum(&header, offsetof(SnapshotHeader, header_checksum));
+}
+
+void Snapshot::validate(const SnapshotHeader &header, const std::string &file) {
+  if (std::memcmp(header.magic, magic, sizeof(magic)) != 0)
+    throw SnapshotException(file, "not a snapshot");
+  if (header.version != version || header.header_bytes != sizeof(SnapshotHeader))
+    throw SnapshotException(file, "unsupported version " + std::to_string(header.version));
+  if (header.header_checksum != checksum(&header, offsetof(SnapshotHeader, header_checksum)))
+    throw SnapshotException(file, "header checksum mismatch");
+  if (header.bucket_layout != bucket_layout())
+    throw SnapshotException(file, "written by a build with a different bucket layout");
+  if (header.hash_policy != sketch_hash_policy)
+    throw SnapshotException(file, "written by a build with a different hash policy");
+  if (header.slab.offset % slab_alignment != 0)
+    throw SnapshotException(file, "slab is not aligned");
+}
+
+void Snapshot::validate_arena(const SnapshotHeader &header, const SketchArena &arena,
+                              const std::string &file) {
+  const SketchParams &params = arena.get_params();
+  if (params.bkt_per_col != header.bkt_per_col || params.num_buckets != header.num_buckets ||
+      arena.get_sketch_bytes() != header.sketch_bytes ||
+      arena.get_data_bytes() != header.slab.bytes)
+    throw SnapshotException(file, "sketch shape does not match the slab");
+}
+
+void Snapshot::write_at(int fd, const void *data, size_t bytes, size_t offset,
+                        const std::string &file) {
+  const char *buf = static_cast<const char *>(data);
+  while (bytes > 0) {
+    ssize_t written = pwrite(fd, buf, bytes, offset);
+    if (written < 0 && errno == EINTR) continue;
+    if (written <= 0) throw SnapshotException(file, std::strerror(errno));
+    buf += written;
+    bytes -= written;
+    offset += written;
+  }
+}
+
+void Snapshot::read_at(int fd, void *data, size_t bytes, size_t offset,
+                       const std::string &file) {
+  char *buf = static_cast<char *>(data);
+  while (bytes > 0) {
+    ssize_t num_read = pread(fd, buf, bytes, offset);
+    if (num_read < 0 && errno == EINTR) continue;
+    if (num_read < 0) throw SnapshotException(file, std::strerror(errno));
+    if (num_read == 0) throw SnapshotException(file, "truncated");
+    buf += num_read;
+    bytes -= num_read;
+    offset += num_read;
+  }
+}
+
+static bool is_zero(const char *data, size_t bytes) {
+  uint64_t any = 0;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= bytes; i += sizeof(uint64_t)) {
+    uint64_t word;
+    std::memcpy(&word, data + i, sizeof(word));
+    any |= word;
+  }
+  for (; i < bytes; i++) any |= data[i];
+  return any == 0;
+}
+
+void Snapshot::write_slab(int fd, const SketchArena &arena, SnapshotSection &section,
+                          const std::string &file) {
+  // the pages of sketches that were never touched are not even populated, so look for them a
+  // page at a time and write each run of non-zero pages at once
+  const size_t page_bytes = sysconf(_SC_PAGESIZE);
+  const char *slab = arena.get_slab();
+  section.bytes = arena.get_data_bytes();
+
+  XXH3_state_t *state = XXH3_createState();
+  XXH3_64bits_reset(state);
+  size_t run_start = 0;
+  for (size_t offset = 0; offset < section.bytes; offset += page_bytes) {
+    size_t bytes = std::min(page_bytes, section.bytes - offset);
+    XXH3_64bits_update(state, slab + offset, bytes);
+    if (!is_zero(slab + offset, bytes)) continue;
+    if (run_start < offset)
+      write_at(fd, slab + run_start, offset - run_start, section.offset + run_start, file);
+    run_start = offset + bytes;
+  }
+  if (run_start < section.bytes)
+    write_at(fd, slab + run_start, section.bytes - run_start, section.offset + run_start, file);
+  section.checksum = XXH3_64bits_digest(state);
+  XXH3_freeState(state);
+
+  // trailing zero pages are holes too
+  if (ftruncate(fd, section.offset + section.bytes) != 0)
+    throw SnapshotException(file, std::strerror(errno));
+}
@@ -0,0 +1,38 @@
+#include "sparse_sketch.h"
+
+#include <algorithm>
+
+void SparseSketch::update_batch(const vec_t *updates, size_t num_updates) {
+  if (num_updates <= idxs.size() / 2) {
+    // a small batch moves the tail of the set once for each index
+    for (size_t u = 0; u < num_updates; u++) {
+      auto it = std::lower_bound(idxs.begin(), idxs.end(), updates[u]);
+      if (it != idxs.end() && *it == updates[u])
+        idxs.erase(it);  // the index is toggled back to zero
+      else
+        idxs.insert(it, updates[u]);
+    }
+    return;
+  }
+
+  // sort a large batch behind the set and merge the two. An index then appears once for each time
+  // it is toggled, so it is kept if its run of copies has odd length
+  size_t old_size = idxs.size();
+  idxs.insert(idxs.end(), updates, updates + num_updates);
+  std::sort(idxs.begin() + old_size, idxs.end());
+  std::inplace_merge(idxs.begin(), idxs.begin() + old_size, idxs.end());
+
+  auto kept = idxs.begin();
+  for (auto run = idxs.begin(); run != idxs.end();) {
+    auto run_end = std::find_if(run, idxs.end(), [&](vec_t idx) { return idx != *run; });
+    if ((run_end - run) % 2 == 1) *kept++ = *run;
+    run = run_end;
+  }
+  idxs.erase(kept, idxs.end());
+}
+
+void SparseSketch::densify(Sketch &sketch) {
+  sketch.update_batch(idxs.data(), idxs.size());
+  std::vector<vec_t>().swap(idxs);  // release the memory of the set
+  dense.store(true, std::memory_order_release);
+}
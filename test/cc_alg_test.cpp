@@ -2,9 +2,15 @@
 #include <binary_file_stream.h>
 #include <dynamic_erdos_generator.h>
 #include <gtest/gtest.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <cstddef>
+#include <cstring>
 #include <fstream>
+#include <random>
+#include <set>
 
 #include "cc_sketch_alg.h"
 #include "graph_sketch_driver.h"
@@ -17,6 +23,12 @@ static size_t get_seed() {
   return s;
 }
 
+// the contents of a file, such as those the algorithms serialize to
+static std::string file_bytes(const std::string &file) {
+  std::ifstream in(file, std::ios::binary);
+  return std::string{std::istreambuf_iterator<char>(in), {}};
+}
+
 // helper function to generate a dynamic binary stream and its cumulative insert only stream
 void generate_stream(size_t seed, node_id_t num_vertices, double density, double delete_portion,
                      double adtl_portion, size_t rounds, std::string stream_name,
@@ -262,6 +274,137 @@ TEST(CCAlgTest, EagerDSUTest) {
   cc_alg.connected_components();
 }
 
+TEST(CCAlgTest, EagerDSUConcurrentUpdates) {
+#ifdef NO_EAGER_DSU
+  GTEST_SKIP() << "built without the eager DSU";
+#endif
+  node_id_t num_vertices = 1 << 12;
+  CCSketchAlg cc_alg{num_vertices, get_seed()};
+  GraphVerifier verify(num_vertices);
+  std::mt19937_64 gen(get_seed());
+
+  std::set<std::pair<node_id_t, node_id_t>> edge_set;
+  for (node_id_t i = 0; i < num_vertices; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) edge_set.insert({std::min(src, dst), std::max(src, dst)});
+  }
+  std::vector<Edge> edges;
+  for (auto &edge : edge_set) edges.push_back({edge.first, edge.second});
+
+  // many stream threads keep the eager DSU at once
+#pragma omp parallel for num_threads(8)
+  for (size_t i = 0; i < edges.size(); i++) cc_alg.pre_insert({edges[i], INSERT}, 0);
+  ASSERT_TRUE(cc_alg.has_cached_query(CONNECTIVITY));
+  for (Edge edge : edges) verify.edge_update(edge);
+  cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+  std::vector<Edge> forest_edges = cc_alg.calc_spanning_forest().get_edges();
+
+  // deleting the edges outside of the spanning forest keeps the DSU valid
+  std::set<std::pair<node_id_t, node_id_t>> in_forest;
+  for (Edge edge : forest_edges) in_forest.insert({edge.src, edge.dst});
+  std::vector<Edge> deletions;
+  for (Edge edge : edges)
+    if (in_forest.count({edge.src, edge.dst}) == 0) deletions.push_back(edge);
+#pragma omp parallel for num_threads(8)
+  for (size_t i = 0; i < deletions.size(); i++) cc_alg.pre_insert({deletions[i], DELETE}, 0);
+  ASSERT_TRUE(cc_alg.has_cached_query(CONNECTIVITY));
+  for (Edge edge : deletions) verify.edge_update(edge);
+  cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+  ASSERT_EQ(cc_alg.calc_spanning_forest().get_edges().size(), forest_edges.size());
+
+  // deleting a spanning forest edge does not
+  cc_alg.pre_insert({forest_edges[0], DELETE}, 0);
+  ASSERT_FALSE(cc_alg.has_cached_query(CONNECTIVITY));
+}
+
+TEST(CCAlgTest, SpanningForestRepair) {
+  node_id_t num_vertices = 1 << 10;
+  CCSketchAlg cc_alg{num_vertices, get_seed()};
+  GraphVerifier verify(num_vertices);
+  std::mt19937_64 gen(get_seed());
+
+  std::set<std::pair<node_id_t, node_id_t>> edges;
+  auto toggle = [&](node_id_t src, node_id_t dst) {
+    std::pair<node_id_t, node_id_t> edge = {std::min(src, dst), std::max(src, dst)};
+    UpdateType type = edges.erase(edge) ? DELETE : INSERT;
+    if (type == INSERT) edges.insert(edge);
+    cc_alg.update({{edge.first, edge.second}, type});
+    verify.edge_update({edge.first, edge.second});
+  };
+  for (node_id_t i = 0; i < num_vertices; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) toggle(src, dst);
+  }
+  cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+  cc_alg.connected_components();
+
+  for (size_t q = 0; q < 10; q++) {
+    // delete a few spanning forest edges, some of which split components, and other edges
+    std::vector<Edge> forest = cc_alg.calc_spanning_forest().get_edges();
+    std::shuffle(forest.begin(), forest.end(), gen);
+    for (size_t i = 0; i < 4; i++) toggle(forest[i].src, forest[i].dst);
+    for (size_t i = 0; i < 16; i++) {
+      node_id_t src = gen() % num_vertices;
+      node_id_t dst = gen() % num_vertices;
+      if (src != dst) toggle(src, dst);
+    }
+    ASSERT_FALSE(cc_alg.has_cached_query(CONNECTIVITY));
+
+    // the query replaces the deleted forest edges without rerunning Boruvka on every vertex.
+    // Without the eager DSU it may rerun Boruvka, from the trees of the forest
+    cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+    cc_alg.connected_components();
+#ifndef NO_EAGER_DSU
+    ASSERT_TRUE(cc_alg.last_query_repaired);
+#endif
+    ASSERT_TRUE(cc_alg.has_cached_query(CONNECTIVITY));
+  }
+}
+
+TEST(CCAlgTest, WarmStartQueries) {
+  node_id_t num_vertices = 1 << 10;
+  CCSketchAlg cc_alg{num_vertices, get_seed()};
+  GraphVerifier verify(num_vertices);
+  std::mt19937_64 gen(get_seed());
+
+  std::set<std::pair<node_id_t, node_id_t>> edges;
+  auto toggle = [&](node_id_t src, node_id_t dst) {
+    std::pair<node_id_t, node_id_t> edge = {std::min(src, dst), std::max(src, dst)};
+    UpdateType type = edges.erase(edge) ? DELETE : INSERT;
+    if (type == INSERT) edges.insert(edge);
+    cc_alg.update({{edge.first, edge.second}, type});
+    verify.edge_update({edge.first, edge.second});
+  };
+  auto toggle_random = [&](size_t num_updates) {
+    for (size_t i = 0; i < num_updates; i++) {
+      node_id_t src = gen() % num_vertices;
+      node_id_t dst = gen() % num_vertices;
+      if (src != dst) toggle(src, dst);
+    }
+  };
+  toggle_random(num_vertices / 2);
+  cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+  cc_alg.connected_components();
+
+  for (size_t q = 0; q < 20; q++) {
+    // a few updates, with some forest edges among them, or so many forest edge deletions that
+    // the DSU is not kept up to date
+    std::vector<Edge> forest = cc_alg.calc_spanning_forest().get_edges();
+    std::shuffle(forest.begin(), forest.end(), gen);
+    size_t num_deletions = q % 4 == 3 ? num_vertices / 8 : 2;
+    for (size_t i = 0; i < num_deletions && i < forest.size(); i++)
+      toggle(forest[i].src, forest[i].dst);
+    toggle_random(8);
+
+    // the query starts from the components of the last one
+    cc_alg.set_verifier(std::make_unique<decltype(verify)>(verify));
+    cc_alg.connected_components();
+    ASSERT_TRUE(cc_alg.has_cached_query(CONNECTIVITY));
+  }
+}
+
 TEST(CCAlgTest, SpanningForestExtraction) {
   auto driver_config = DriverConfiguration().gutter_sys(STANDALONE);
   auto cc_config = CCAlgConfiguration();
@@ -348,3 +491,626 @@ TEST(CCAlgTest, MTStreamWithMultipleQueries) {
     cc_alg.connected_components();
   }
 }
+
+TEST(CCAlgTest, SparseSketchesMatchSketches) {
+  // a power law like graph: a few hubs and many vertices of low degree
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  CCSketchAlg sparse_alg{num_nodes, seed};
+  CCSketchAlg dense_alg{num_nodes, seed, CCAlgConfiguration().sparse_sketch_factor(0)};
+  sparse_alg.allocate_worker_memory(1);
+  dense_alg.allocate_worker_memory(1);
+  GraphVerifier verify(num_nodes);
+
+  std::set<std::pair<node_id_t, node_id_t>> edges;
+  std::vector<std::vector<node_id_t>> batches(num_nodes);
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    size_t degree = src < 4 ? 400 : gen() % 4;
+    for (size_t d = 0; d < degree; d++) {
+      node_id_t dst = gen() % num_nodes;
+      if (dst == src) continue;
+      // insert each edge once so that no vertex cancels back to null
+      auto edge = std::make_pair(std::min(src, dst), std::max(src, dst));
+      if (!edges.insert(edge).second) continue;
+      GraphUpdate upd = {{src, dst}, INSERT};
+      verify.edge_update({src, dst});
+      sparse_alg.pre_insert(upd, 0);
+      dense_alg.pre_insert(upd, 0);
+      batches[src].push_back(dst);
+      batches[dst].push_back(src);
+    }
+  }
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    sparse_alg.apply_update_batch(0, src, batches[src]);
+    dense_alg.apply_update_batch(0, src, batches[src]);
+  }
+
+  // the sparse vertices serialize as the sketch they stand in for
+  sparse_alg.write_binary("./sparse_out.txt");
+  dense_alg.write_binary("./dense_out.txt");
+  ASSERT_EQ(file_bytes("./sparse_out.txt"), file_bytes("./dense_out.txt"));
+
+  sparse_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+  dense_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+  ASSERT_EQ(sparse_alg.connected_components().size(), dense_alg.connected_components().size());
+}
+
+TEST(CCAlgTest, NullVerticesNotSerialized) {
+  // only a few of the vertex ids are ever updated
+  node_id_t num_nodes = 1 << 12;
+  CCSketchAlg cc_alg{num_nodes, get_seed()};
+  GraphVerifier verify(num_nodes);
+  std::vector<node_id_t> used = {3, 17, 100, 1000, 2048, 4000};
+  for (size_t i = 0; i + 1 < used.size(); i++) {
+    cc_alg.update({{used[i], used[i + 1]}, INSERT});
+    verify.edge_update({used[i], used[i + 1]});
+  }
+  cc_alg.update({{5, 6}, INSERT});
+  cc_alg.update({{5, 6}, DELETE});  // vertices 5 and 6 return to null
+
+  cc_alg.write_binary("./out_temp.txt");
+  size_t sketch_bytes = Sketch(Sketch::calc_vector_length(num_nodes), 0,
+                               Sketch::calc_cc_samples(num_nodes, 1)).bucket_array_bytes();
+  // the sketches fit in a single chunk
+  size_t header_bytes = 8 + sizeof(uint32_t) + sizeof(size_t) + sizeof(node_id_t) +
+                        sizeof(double) + sizeof(SerialType) + 4 * sizeof(uint32_t) +
+                        sizeof(node_id_t) + sizeof(node_id_t) + 2 * sizeof(SerializedChunk);
+  ASSERT_EQ(file_bytes("./out_temp.txt").size(),
+            header_bytes + used.size() * (sizeof(node_id_t) + sketch_bytes));
+
+  CCSketchAlg *reheat_alg = CCSketchAlg::construct_from_serialized_data("./out_temp.txt");
+  reheat_alg->set_verifier(std::make_unique<GraphVerifier>(verify));
+  ASSERT_EQ(reheat_alg->connected_components().size(), num_nodes - used.size() + 1);
+  delete reheat_alg;
+}
+
+TEST(CCAlgTest, SparseSerialization) {
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg{num_nodes, seed, CCAlgConfiguration().sparse_sketch_factor(0)};
+  GraphVerifier verify(num_nodes);
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    for (node_id_t dst = src + 1; dst < num_nodes; dst++) {
+      if (gen() % 1024 >= 2) continue;
+      cc_alg.update({{src, dst}, INSERT});
+      verify.edge_update({src, dst});
+    }
+  }
+
+  cc_alg.write_binary("./out_temp.txt");
+  cc_alg.write_binary("./sparse_out.txt", SPARSE);
+  ASSERT_LT(file_bytes("./sparse_out.txt").size(), file_bytes("./out_temp.txt").size() / 2);
+
+  CCSketchAlg *full_alg = CCSketchAlg::construct_from_serialized_data("./out_temp.txt");
+  CCSketchAlg *sparse_alg = CCSketchAlg::construct_from_serialized_data("./sparse_out.txt");
+  full_alg->write_binary("./full_out.txt");
+  sparse_alg->write_binary("./dense_out.txt");
+  ASSERT_EQ(file_bytes("./full_out.txt"), file_bytes("./dense_out.txt"));
+
+  sparse_alg->set_verifier(std::make_unique<GraphVerifier>(verify));
+  sparse_alg->connected_components();
+  delete full_alg;
+  delete sparse_alg;
+
+  // a file of an unknown format is rejected rather than read as empty sketches
+  std::fstream file("./sparse_out.txt", std::ios::in | std::ios::out | std::ios::binary);
+  SerialType unknown_type = SerialType(SPARSE + 1);
+  file.seekp(8 + sizeof(uint32_t) + sizeof(size_t) + sizeof(node_id_t) + sizeof(double));
+  file.write((const char *)&unknown_type, sizeof(unknown_type));
+  file.close();
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./sparse_out.txt"), FileIOException);
+}
+
+TEST(CCAlgTest, OldSerializationRejected) {
+  // the format before files had a magic number: the seed, number of vertices, sketches factor
+  // and the FULL sketch of every vertex
+  node_id_t num_nodes = 64;
+  size_t seed = get_seed();
+  double sketches_factor = 1;
+  size_t sketch_bytes = Sketch(Sketch::calc_vector_length(num_nodes), seed,
+                               Sketch::calc_cc_samples(num_nodes, 1)).bucket_array_bytes();
+  {
+    std::ofstream old_file("./out_temp.txt", std::ios::binary | std::ios::trunc);
+    old_file.write((const char *)&seed, sizeof(seed));
+    old_file.write((const char *)&num_nodes, sizeof(num_nodes));
+    old_file.write((const char *)&sketches_factor, sizeof(sketches_factor));
+    std::string sketches(num_nodes * sketch_bytes, '\0');
+    old_file.write(sketches.data(), sketches.size());
+  }
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./out_temp.txt"), FileIOException);
+  CCSketchAlg cc_alg{num_nodes, seed};
+  ASSERT_THROW(cc_alg.merge_serialized_data("./out_temp.txt"), FileIOException);
+}
+
+TEST(CCAlgTest, OtherHashPolicyRejected) {
+  // the sketches of a build of another hash policy put every index in other buckets
+  node_id_t num_nodes = 64;
+  size_t seed = get_seed();
+  CCSketchAlg cc_alg{num_nodes, seed, CCAlgConfiguration().sparse_sketch_factor(0)};
+  for (node_id_t src = 0; src + 1 < num_nodes; src++)
+    cc_alg.update({{src, node_id_t(src + 1)}, INSERT});
+  cc_alg.write_binary("./full_out.txt");
+  cc_alg.update({{0, 2}, INSERT});
+  cc_alg.write_delta("./delta_1.bin");
+  auto set_hash_policy = [](const std::string &file, size_t offset) {
+    std::fstream out(file, std::ios::in | std::ios::out | std::ios::binary);
+    uint32_t other_policy = sketch_hash_policy + 1;
+    out.seekp(offset);
+    out.write((const char *)&other_policy, sizeof(other_policy));
+  };
+
+  delete CCSketchAlg::construct_from_checkpoints("./full_out.txt", {"./delta_1.bin"});
+  set_hash_policy("./delta_1.bin", offsetof(DeltaHeader, hash_policy));
+  ASSERT_THROW(CCSketchAlg::construct_from_checkpoints("./full_out.txt", {"./delta_1.bin"}),
+               FileIOException);
+  set_hash_policy("./full_out.txt", 8 + sizeof(uint32_t) + sizeof(size_t) + sizeof(node_id_t) +
+                                        sizeof(double) + sizeof(SerialType) +
+                                        3 * sizeof(uint32_t));
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./full_out.txt"), FileIOException);
+  ASSERT_THROW(cc_alg.merge_serialized_data("./full_out.txt"), FileIOException);
+  ASSERT_THROW(CCSketchAlg::merge_serialized_files({"./full_out.txt"}, "./out_temp.txt"),
+               FileIOException);
+}
+
+TEST(CCAlgTest, ChunkedSerialization) {
+  // enough vertices with sketches that they are written in many chunks
+  node_id_t num_nodes = 1 << 13;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  auto config = CCAlgConfiguration().sparse_sketch_factor(0);
+  auto direct_config = CCAlgConfiguration().sparse_sketch_factor(0).direct_io(true);
+  CCSketchAlg cc_alg{num_nodes, seed, config};
+  CCSketchAlg direct_alg{num_nodes, seed, direct_config};
+  GraphVerifier verify(num_nodes);
+  std::set<Edge> edges;
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    for (size_t d = 0; d < 4; d++) {
+      node_id_t dst = gen() % num_nodes;
+      Edge edge = {std::min(src, dst), std::max(src, dst)};
+      if (src == dst || !edges.insert(edge).second) continue;
+      verify.edge_update(edge);
+      cc_alg.update({edge, INSERT});
+      direct_alg.update({edge, INSERT});
+    }
+  }
+
+  // direct IO writes and reads the same files
+  for (SerialType type : {FULL, SPARSE}) {
+    cc_alg.write_binary("./out_temp.txt", type);
+    direct_alg.write_binary("./full_out.txt", type);
+    std::string bytes = file_bytes("./out_temp.txt");
+    if (type == FULL) {
+      ASSERT_GT(bytes.size(), size_t(4) << 20);
+    }
+    ASSERT_EQ(bytes, file_bytes("./full_out.txt"));
+
+    CCSketchAlg *loaded =
+        CCSketchAlg::construct_from_serialized_data("./full_out.txt", direct_config);
+    loaded->write_binary("./dense_out.txt", type);
+    ASSERT_EQ(bytes, file_bytes("./dense_out.txt"));
+    loaded->set_verifier(std::make_unique<GraphVerifier>(verify));
+    loaded->connected_components();
+    delete loaded;
+  }
+
+  // a missing chunk is an error rather than empty sketches
+  ASSERT_EQ(truncate("./out_temp.txt", 1 << 20), 0);
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./out_temp.txt"), FileIOException);
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./out_temp.txt", direct_config),
+               FileIOException);
+}
+
+TEST(CCAlgTest, DeltaCheckpoints) {
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg{num_nodes, seed};
+  cc_alg.allocate_worker_memory(1);
+  GraphVerifier verify(num_nodes);
+  std::set<Edge> edges;
+  // insert edges between the vertices in [first, last) through the update batches
+  auto insert_edges = [&](node_id_t first, node_id_t last, size_t num_edges) {
+    std::vector<std::vector<node_id_t>> batches(num_nodes);
+    for (size_t i = 0; i < num_edges; i++) {
+      node_id_t src = first + gen() % (last - first);
+      node_id_t dst = first + gen() % (last - first);
+      Edge edge = {std::min(src, dst), std::max(src, dst)};
+      if (src == dst || !edges.insert(edge).second) continue;
+      verify.edge_update(edge);
+      cc_alg.pre_insert({edge, INSERT}, 0);
+      batches[edge.src].push_back(edge.dst);
+      batches[edge.dst].push_back(edge.src);
+    }
+    for (node_id_t v = 0; v < num_nodes; v++) {
+      if (!batches[v].empty()) cc_alg.apply_update_batch(0, v, batches[v]);
+    }
+  };
+
+  ASSERT_THROW(cc_alg.write_delta("./delta_1.bin"), FileIOException);
+  insert_edges(0, num_nodes, 8 * num_nodes);
+  cc_alg.write_binary("./out_temp.txt");
+  insert_edges(0, 64, 64);
+  cc_alg.write_delta("./delta_1.bin");
+  cc_alg.write_binary("./sparse_out.txt", SPARSE);
+  std::string state_1 = file_bytes("./sparse_out.txt");
+  insert_edges(32, 128, 64);
+  cc_alg.write_delta("./delta_2.bin");
+
+  // the deltas hold only the buckets that changed since the base
+  size_t base_bytes = file_bytes("./out_temp.txt").size();
+  ASSERT_LT(file_bytes("./delta_1.bin").size(), base_bytes / 16);
+  ASSERT_LT(file_bytes("./delta_2.bin").size(), base_bytes / 16);
+
+  CCSketchAlg *restored_1 =
+      CCSketchAlg::construct_from_checkpoints("./out_temp.txt", {"./delta_1.bin"});
+  restored_1->write_binary("./dense_out.txt", SPARSE);
+  ASSERT_EQ(state_1, file_bytes("./dense_out.txt"));
+  delete restored_1;
+  ASSERT_THROW(CCSketchAlg::construct_from_checkpoints("./out_temp.txt", {"./delta_2.bin"}),
+               FileIOException);
+
+  // more deltas may be written against the base of a restored algorithm
+  CCSketchAlg *restored =
+      CCSketchAlg::construct_from_checkpoints("./out_temp.txt", {"./delta_1.bin", "./delta_2.bin"});
+  for (node_id_t src = 900; src < 910; src++) {
+    GraphUpdate upd = {{src, node_id_t(src + 100)}, INSERT};
+    if (!edges.insert(upd.edge).second) continue;
+    verify.edge_update(upd.edge);
+    restored->update(upd);
+  }
+  restored->write_delta("./delta_3.bin");
+  CCSketchAlg *restored_3 = CCSketchAlg::construct_from_checkpoints(
+      "./out_temp.txt", {"./delta_1.bin", "./delta_2.bin", "./delta_3.bin"});
+  restored->write_binary("./full_out.txt");
+  restored_3->write_binary("./dense_out.txt");
+  ASSERT_EQ(file_bytes("./full_out.txt"), file_bytes("./dense_out.txt"));
+
+  restored_3->set_verifier(std::make_unique<GraphVerifier>(verify));
+  restored_3->connected_components();
+  delete restored;
+  delete restored_3;
+}
+
+TEST(CCAlgTest, MergeShards) {
+  // hubs with dense sketches, vertices of low degree with sparse edge sets and null vertices
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  constexpr size_t num_shards = 3;
+  CCSketchAlg whole{num_nodes, seed};
+  std::vector<std::unique_ptr<CCSketchAlg>> shards;
+  for (size_t s = 0; s < num_shards; s++) shards.emplace_back(new CCSketchAlg(num_nodes, seed));
+  GraphVerifier verify(num_nodes);
+  std::set<Edge> edges;
+  auto insert = [&](node_id_t src, node_id_t dst) {
+    Edge edge = {std::min(src, dst), std::max(src, dst)};
+    if (src == dst || !edges.insert(edge).second) return;
+    verify.edge_update(edge);
+    whole.update({edge, INSERT});
+    shards[gen() % num_shards]->update({edge, INSERT});
+  };
+  for (node_id_t hub = 0; hub < 16; hub++) {
+    for (size_t i = 0; i < 256; i++) insert(hub, gen() % num_nodes);
+  }
+  for (size_t i = 0; i < num_nodes / 2; i++) insert(16 + gen() % 512, 16 + gen() % 512);
+
+  // an edge inserted in one shard and deleted in another is not in the graph
+  for (node_id_t hub = 0; hub + 1 < 16; hub += 2) {
+    Edge edge = {hub, node_id_t(hub + 1)};
+    if (edges.count(edge)) continue;
+    shards[0]->update({edge, INSERT});
+    shards[1]->update({edge, DELETE});
+  }
+  whole.write_binary("./full_out.txt");
+  std::string whole_bytes = file_bytes("./full_out.txt");
+
+  // merging files, in either format, gives the file of the whole stream
+  std::vector<std::string> shard_files;
+  for (size_t s = 0; s < num_shards; s++) {
+    shard_files.push_back("./shard_" + std::to_string(s) + ".bin");
+    shards[s]->write_binary(shard_files.back(), s == 0 ? FULL : SPARSE);
+  }
+  CCSketchAlg::merge_serialized_files(shard_files, "./dense_out.txt");
+  ASSERT_EQ(whole_bytes, file_bytes("./dense_out.txt"));
+
+  // as does merging the algorithms
+  for (size_t s = 1; s < num_shards; s++) shards[0]->merge(*shards[s]);
+  shards[0]->write_binary("./dense_out.txt");
+  ASSERT_EQ(whole_bytes, file_bytes("./dense_out.txt"));
+  shards[0]->set_verifier(std::make_unique<GraphVerifier>(verify));
+  shards[0]->connected_components();
+
+  CCSketchAlg other_seed{num_nodes, seed + 1};
+  ASSERT_THROW(shards[1]->merge(other_seed), MergeException);
+  ASSERT_THROW(shards[1]->merge(*shards[1]), MergeException);
+  other_seed.write_binary("./out_temp.txt");
+  ASSERT_THROW(shards[1]->merge_serialized_data("./out_temp.txt"), FileIOException);
+  for (auto &file : shard_files) unlink(file.c_str());
+}
+
+TEST(CCAlgTest, SharedStoreIngestProcesses) {
+  // every vertex has an edge so that every vertex of the whole graph holds a sketch too
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  constexpr size_t num_procs = 3;
+  std::vector<std::vector<Edge>> shards(num_procs);
+  CCSketchAlg whole{num_nodes, seed, CCAlgConfiguration().sparse_sketch_factor(0)};
+  GraphVerifier verify(num_nodes);
+  std::set<Edge> edges;
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    for (size_t d = 0; d < 2; d++) {
+      node_id_t dst = gen() % num_nodes;
+      Edge edge = {std::min(src, dst), std::max(src, dst)};
+      if (src == dst || !edges.insert(edge).second) continue;
+      verify.edge_update(edge);
+      whole.update({edge, INSERT});
+      shards[gen() % num_procs].push_back(edge);
+    }
+  }
+
+  const std::string store_name = "/gz_test_store_" + std::to_string(getpid());
+  CCSketchAlg *store = CCSketchAlg::create_shared_store(store_name, num_nodes, seed);
+  ASSERT_THROW(CCSketchAlg::create_shared_store(store_name, num_nodes, seed),
+               SharedStoreException);
+
+  // each process ingests its shard through the update batches
+  std::vector<pid_t> children;
+  for (size_t p = 0; p < num_procs; p++) {
+    pid_t pid = fork();
+    ASSERT_GE(pid, 0);
+    if (pid > 0) {
+      children.push_back(pid);
+      continue;
+    }
+    int status = 0;
+    try {
+      std::unique_ptr<CCSketchAlg> ingest(CCSketchAlg::attach_shared_store(store_name));
+      ingest->allocate_worker_memory(1);
+      std::vector<std::vector<node_id_t>> batches(num_nodes);
+      for (const Edge &edge : shards[p]) {
+        batches[edge.src].push_back(edge.dst);
+        batches[edge.dst].push_back(edge.src);
+      }
+      for (node_id_t v = 0; v < num_nodes; v++) {
+        if (!batches[v].empty()) ingest->apply_update_batch(0, v, batches[v]);
+      }
+    } catch (...) {
+      status = 1;
+    }
+    _exit(status);
+  }
+  for (pid_t pid : children) {
+    int status;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+
+  // the query process sees the sketches of the whole stream
+  whole.write_binary("./full_out.txt");
+  store->write_binary("./dense_out.txt");
+  ASSERT_EQ(file_bytes("./full_out.txt"), file_bytes("./dense_out.txt"));
+  store->set_verifier(std::make_unique<GraphVerifier>(verify));
+  store->connected_components();
+
+  // and so does another process, which keeps using the store once it is removed
+  CCSketchAlg *query = CCSketchAlg::attach_shared_store(store_name);
+  CCSketchAlg::remove_shared_store(store_name);
+  ASSERT_THROW(CCSketchAlg::attach_shared_store(store_name), SharedStoreException);
+  query->set_verifier(std::make_unique<GraphVerifier>(verify));
+  query->connected_components();
+  delete query;
+  delete store;
+}
+
+TEST(CCAlgTest, SnapshotMatchesSketches) {
+  // hubs with dense sketches, vertices of low degree with sparse edge sets and null vertices
+  node_id_t num_nodes = 1024;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg{num_nodes, seed};
+  GraphVerifier verify(num_nodes);
+  for (node_id_t src = 0; src < num_nodes / 2; src++) {
+    size_t degree = src < 4 ? 400 : gen() % 4;
+    for (size_t d = 0; d < degree; d++) {
+      node_id_t dst = gen() % (num_nodes / 2);
+      if (dst == src) continue;
+      GraphUpdate upd = {{std::min(src, dst), std::max(src, dst)}, INSERT};
+      verify.edge_update(upd.edge);
+      cc_alg.update(upd);
+    }
+  }
+  cc_alg.write_snapshot("./snapshot.bin");
+  std::string snapshot_bytes = file_bytes("./snapshot.bin");
+
+  // the loaded sketches serialize exactly as the ones they were written from
+  CCSketchAlg *loaded = CCSketchAlg::construct_from_snapshot("./snapshot.bin", {}, true);
+  cc_alg.write_binary("./out_temp.txt");
+  loaded->write_binary("./sparse_out.txt");
+  ASSERT_EQ(file_bytes("./out_temp.txt"), file_bytes("./sparse_out.txt"));
+
+  // updates to the loaded algorithm never reach the snapshot
+  for (node_id_t src = 0; src < num_nodes; src += 2) {
+    GraphUpdate upd = {{src, node_id_t(src + 1)}, INSERT};
+    verify.edge_update(upd.edge);
+    loaded->update(upd);
+  }
+  loaded->set_verifier(std::make_unique<GraphVerifier>(verify));
+  loaded->connected_components();
+  delete loaded;
+  ASSERT_EQ(snapshot_bytes, file_bytes("./snapshot.bin"));
+}
+
+TEST(CCAlgTest, SnapshotRejectsCorruption) {
+  node_id_t num_nodes = 1024;
+  CCSketchAlg cc_alg{num_nodes, get_seed(), CCAlgConfiguration().sparse_sketch_factor(0)};
+  for (node_id_t src = 0; src + 1 < num_nodes; src++)
+    cc_alg.update({{src, node_id_t(src + 1)}, INSERT});
+  cc_alg.write_snapshot("./snapshot.bin");
+  std::string snapshot_bytes = file_bytes("./snapshot.bin");
+  SnapshotHeader header;
+  memcpy(&header, snapshot_bytes.data(), sizeof(header));
+
+  auto corrupt = [&](size_t offset) {
+    std::string bytes = snapshot_bytes;
+    bytes[offset] ^= 1;
+    std::ofstream out("./corrupt_snapshot.bin", std::ios::binary | std::ios::trunc);
+    out.write(bytes.data(), bytes.size());
+  };
+  corrupt(0);
+  ASSERT_THROW(CCSketchAlg::construct_from_snapshot("./corrupt_snapshot.bin"), SnapshotException);
+  corrupt(offsetof(SnapshotHeader, seed));
+  ASSERT_THROW(CCSketchAlg::construct_from_snapshot("./corrupt_snapshot.bin"), SnapshotException);
+  corrupt(header.vertices.offset);
+  ASSERT_THROW(CCSketchAlg::construct_from_snapshot("./corrupt_snapshot.bin"), SnapshotException);
+
+  // the sketches are only checked on request, since that reads all of them
+  corrupt(header.slab.offset + 100);
+  delete CCSketchAlg::construct_from_snapshot("./corrupt_snapshot.bin");
+  ASSERT_THROW(CCSketchAlg::construct_from_snapshot("./corrupt_snapshot.bin", {}, true),
+               SnapshotException);
+}
+
+TEST(CCAlgTest, BothSketchAlgorithms) {
+  // the algorithm is chosen at runtime, so both are exercised by every build
+  node_id_t num_nodes = 1024;
+  for (SketchAlgorithm algorithm : {CAMEO_SKETCH, CUBE_SKETCH}) {
+    size_t seed = get_seed();
+    std::mt19937_64 gen(seed);
+    auto config = CCAlgConfiguration().sketch_algorithm(algorithm).sparse_sketch_factor(0);
+    CCSketchAlg cc_alg{num_nodes, seed, config};
+    cc_alg.allocate_worker_memory(1);
+    GraphVerifier verify(num_nodes);
+
+    std::vector<std::vector<node_id_t>> batches(num_nodes);
+    for (node_id_t src = 0; src < num_nodes; src++) {
+      for (node_id_t dst = src + 1; dst < num_nodes; dst++) {
+        if (gen() % 1024 >= 2) continue;
+        cc_alg.pre_insert({{src, dst}, INSERT}, 0);
+        verify.edge_update({src, dst});
+        batches[src].push_back(dst);
+        batches[dst].push_back(src);
+      }
+    }
+    for (node_id_t src = 0; src < num_nodes; src++)
+      cc_alg.apply_update_batch(0, src, batches[src]);
+
+    cc_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+    cc_alg.connected_components();
+
+    // the algorithm is recorded in the file, and only read back under the same one
+    cc_alg.write_binary("./out_temp.txt");
+    CCSketchAlg *loaded = CCSketchAlg::construct_from_serialized_data("./out_temp.txt", config);
+    loaded->set_verifier(std::make_unique<GraphVerifier>(verify));
+    loaded->connected_components();
+    delete loaded;
+    SketchAlgorithm other = algorithm == CAMEO_SKETCH ? CUBE_SKETCH : CAMEO_SKETCH;
+    auto other_config = CCAlgConfiguration(config).sketch_algorithm(other);
+    ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./out_temp.txt", other_config),
+                 FileIOException);
+    CCSketchAlg other_alg{num_nodes, seed, other_config};
+    ASSERT_THROW(other_alg.merge_serialized_data("./out_temp.txt"), FileIOException);
+  }
+}
+
+TEST(CCAlgTest, NarrowIndicesMatchWide) {
+  // the vertices of small graphs are sketched with 32 bit indices unless this is disabled
+  node_id_t num_nodes = 1 << 10;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  auto config = CCAlgConfiguration().sparse_sketch_factor(0);
+  CCSketchAlg narrow_alg{num_nodes, seed, config};
+  CCSketchAlg wide_alg{num_nodes, seed, CCAlgConfiguration(config).narrow_indices(false)};
+  narrow_alg.allocate_worker_memory(1);
+  wide_alg.allocate_worker_memory(1);
+  GraphVerifier verify(num_nodes);
+
+  std::vector<std::vector<node_id_t>> batches(num_nodes);
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    for (node_id_t dst = src + 1; dst < num_nodes; dst++) {
+      if (gen() % 1024 >= 2) continue;
+      narrow_alg.pre_insert({{src, dst}, INSERT}, 0);
+      wide_alg.pre_insert({{src, dst}, INSERT}, 0);
+      verify.edge_update({src, dst});
+      batches[src].push_back(dst);
+      batches[dst].push_back(src);
+    }
+  }
+  for (node_id_t src = 0; src < num_nodes; src++) {
+    narrow_alg.apply_update_batch(0, src, batches[src]);
+    wide_alg.apply_update_batch(0, src, batches[src]);
+  }
+
+  narrow_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+  wide_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+  ASSERT_EQ(narrow_alg.connected_components().size(), wide_alg.connected_components().size());
+
+  // the index width is recorded in the file, and only read back under the same one
+  auto wide_config = CCAlgConfiguration(config).narrow_indices(false);
+  wide_alg.write_binary("./full_out.txt");
+  CCSketchAlg *loaded = CCSketchAlg::construct_from_serialized_data("./full_out.txt", wide_config);
+  loaded->set_verifier(std::make_unique<GraphVerifier>(verify));
+  loaded->connected_components();
+  ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./full_out.txt", config),
+               FileIOException);
+  ASSERT_THROW(narrow_alg.merge_serialized_data("./full_out.txt"), FileIOException);
+  ASSERT_THROW(CCSketchAlg::merge_serialized_files({"./full_out.txt"}, "./out_temp.txt"),
+               FileIOException);
+
+  // and in the deltas written against the file
+  loaded->update({{0, 1}, INSERT});
+  loaded->write_delta("./delta_1.bin");
+  delete CCSketchAlg::construct_from_checkpoints("./full_out.txt", {"./delta_1.bin"}, wide_config);
+  narrow_alg.write_binary("./out_temp.txt");
+  ASSERT_THROW(CCSketchAlg::construct_from_checkpoints("./out_temp.txt", {"./delta_1.bin"}),
+               FileIOException);
+  delete loaded;
+}
+
+TEST(CCAlgTest, SlicedDepths) {
+  node_id_t num_nodes = 1024;
+  for (SketchAlgorithm algorithm : {CAMEO_SKETCH, CUBE_SKETCH}) {
+    size_t seed = get_seed();
+    std::mt19937_64 gen(seed);
+    auto config = CCAlgConfiguration().sketch_algorithm(algorithm).sliced_depths(true)
+                      .sparse_sketch_factor(0);
+    CCSketchAlg cc_alg{num_nodes, seed, config};
+    cc_alg.allocate_worker_memory(1);
+    GraphVerifier verify(num_nodes);
+
+    std::vector<std::vector<node_id_t>> batches(num_nodes);
+    for (node_id_t src = 0; src < num_nodes; src++) {
+      for (node_id_t dst = src + 1; dst < num_nodes; dst++) {
+        if (gen() % 1024 >= 2) continue;
+        verify.edge_update({src, dst});
+        // apply some of the updates directly and the rest in batches
+        if (gen() % 2) {
+          cc_alg.update({{src, dst}, INSERT});
+          continue;
+        }
+        cc_alg.pre_insert({{src, dst}, INSERT}, 0);
+        batches[src].push_back(dst);
+        batches[dst].push_back(src);
+      }
+    }
+    for (node_id_t src = 0; src < num_nodes; src++)
+      cc_alg.apply_update_batch(0, src, batches[src]);
+
+    cc_alg.set_verifier(std::make_unique<GraphVerifier>(verify));
+    cc_alg.connected_components();
+
+    // the depth hashing is recorded in the file, and only read back under the same one
+    cc_alg.write_binary("./out_temp.txt");
+    CCSketchAlg *loaded = CCSketchAlg::construct_from_serialized_data("./out_temp.txt", config);
+    loaded->set_verifier(std::make_unique<GraphVerifier>(verify));
+    loaded->connected_components();
+    delete loaded;
+    auto column_config = CCAlgConfiguration(config).sliced_depths(false);
+    ASSERT_THROW(CCSketchAlg::construct_from_serialized_data("./out_temp.txt", column_config),
+                 FileIOException);
+    CCSketchAlg column_alg{num_nodes, seed, column_config};
+    ASSERT_THROW(column_alg.merge_serialized_data("./out_temp.txt"), FileIOException);
+  }
+}
@@ -0,0 +1,87 @@
+#include <gtest/gtest.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <random>
+#include <set>
+
+#include "forest_edges.h"
+
+TEST(ForestEdgesTest, InsertContainsClear) {
+  node_id_t num_vertices = 1 << 12;
+  ForestEdges forest(num_vertices);
+  std::mt19937_64 gen(num_vertices);
+  std::set<std::pair<node_id_t, node_id_t>> inserted;
+
+  // a full forest, with num_vertices - 1 edges
+  for (node_id_t v = 1; v < num_vertices; v++) {
+    node_id_t parent = gen() % v;
+    // either order of the endpoints is the same edge
+    Edge edge = gen() % 2 ? Edge{parent, v} : Edge{v, parent};
+    ASSERT_TRUE(forest.insert(edge));
+    ASSERT_FALSE(forest.insert({edge.dst, edge.src}));
+    inserted.insert({parent, v});
+  }
+  for (auto &edge : inserted) {
+    ASSERT_TRUE(forest.contains({edge.first, edge.second}));
+    ASSERT_TRUE(forest.contains({edge.second, edge.first}));
+  }
+  for (size_t i = 0; i < 1000; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src == dst) continue;
+    ASSERT_EQ(forest.contains({src, dst}),
+              inserted.count({std::min(src, dst), std::max(src, dst)}) > 0);
+  }
+
+  std::vector<Edge> edges = forest.get_edges();
+  ASSERT_EQ(edges.size(), inserted.size());
+  for (Edge edge : edges) {
+    ASSERT_LT(edge.src, edge.dst);
+    ASSERT_EQ(inserted.count({edge.src, edge.dst}), 1);
+  }
+
+  forest.clear();
+  ASSERT_TRUE(forest.get_edges().empty());
+  for (auto &edge : inserted) ASSERT_FALSE(forest.contains({edge.first, edge.second}));
+}
+
+TEST(ForestEdgesTest, ConcurrentInserts) {
+  // every thread inserts every edge of a path, and exactly one insertion of each edge succeeds
+  node_id_t num_vertices = 1 << 16;
+  ForestEdges forest(num_vertices);
+  std::vector<int> num_inserted(num_vertices, 0);
+#pragma omp parallel num_threads(4)
+  {
+    for (node_id_t v = 1; v < num_vertices; v++) {
+      if (forest.insert({v - 1, v})) {
+#pragma omp atomic update
+        num_inserted[v]++;
+      }
+    }
+  }
+  for (node_id_t v = 1; v < num_vertices; v++) {
+    ASSERT_EQ(num_inserted[v], 1);
+    ASSERT_TRUE(forest.contains({v, v - 1}));
+  }
+  ASSERT_EQ(forest.get_edges().size(), num_vertices - 1);
+}
+
+TEST(ForestEdgesTest, Erase) {
+  node_id_t num_vertices = 1 << 12;
+  ForestEdges forest(num_vertices);
+  for (node_id_t v = 1; v < num_vertices; v++) ASSERT_TRUE(forest.insert({v - 1, v}));
+
+  // erase every other edge, the edges probed past them are still found
+  for (node_id_t v = 1; v < num_vertices; v += 2) ASSERT_TRUE(forest.erase({v, v - 1}));
+  for (node_id_t v = 1; v < num_vertices; v++) {
+    ASSERT_EQ(forest.contains({v - 1, v}), v % 2 == 0);
+    ASSERT_EQ(forest.erase({v - 1, v + 1}), false);
+  }
+  ASSERT_EQ(forest.get_edges().size(), (num_vertices - 1) / 2);
+
+  // erased edges may be inserted again
+  for (node_id_t v = 1; v < num_vertices; v += 2) ASSERT_TRUE(forest.insert({v - 1, v}));
+  for (node_id_t v = 1; v < num_vertices; v++) ASSERT_TRUE(forest.contains({v - 1, v}));
+  ASSERT_EQ(forest.get_edges().size(), num_vertices - 1);
+}
@@ -1,8 +1,11 @@
 #include "sketch.h"
 #include "bucket.h"
+#include "sketch_arena.h"
+#include "sparse_sketch.h"
 #include <chrono>
 #include <gtest/gtest.h>
 #include <random>
+#include <set>
 #include "testing_vector.h"
 
 static size_t get_seed() {
@@ -287,6 +290,125 @@ void test_sketch_large(unsigned long vec_size, unsigned long num_updates) {
   }
 }
 
+TEST(SketchTestSuite, TestUpdateBatchMatchesUpdate) {
+  size_t vec_size = 1 << 16;
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  for (size_t num_updates : {size_t(1), size_t(100), Sketch::update_batch_chunk * 3 + 7}) {
+    Sketch serial(vec_size, seed, 4, num_columns);
+    Sketch batched(vec_size, seed, 4, num_columns);
+
+    std::vector<vec_t> updates(num_updates);
+    for (size_t i = 0; i < num_updates; i++) {
+      updates[i] = gen() % vec_size;
+      serial.update(updates[i]);
+    }
+    batched.update_batch(updates.data(), updates.size());
+
+    ASSERT_EQ(serial, batched);
+  }
+}
+
+TEST(SketchTestSuite, TestHashKernelsMatchScalar) {
+  std::mt19937_64 gen(get_seed());
+  Bucket_Boruvka::HashKernel initial = Bucket_Boruvka::get_hash_kernel();
+  for (auto kernel : {Bucket_Boruvka::SCALAR_HASH, Bucket_Boruvka::AVX2_HASH,
+                      Bucket_Boruvka::AVX512_HASH}) {
+    if (!Bucket_Boruvka::set_hash_kernel(kernel)) continue;
+
+    for (size_t trial = 0; trial < 100; trial++) {
+      size_t n = gen() % 40 + 1;
+      uint64_t seed = gen();
+      vec_hash_t max_depth = gen() % 63 + 1;
+      std::vector<vec_t> idxs(n);
+      for (auto &idx : idxs) idx = gen();
+
+      std::vector<col_hash_t> depths(n);
+      std::vector<vec_hash_t> hashes(n);
+      Bucket_Boruvka::get_index_depths(idxs[0], seed, Sketch::column_seed_stride, n, max_depth,
+                                       depths.data());
+      for (size_t i = 0; i < n; i++) {
+        ASSERT_EQ(depths[i], Bucket_Boruvka::get_index_depth(
+                                 idxs[0], seed + i * Sketch::column_seed_stride, max_depth));
+      }
+
+      Bucket_Boruvka::get_batch_depths(idxs.data(), n, seed, max_depth, depths.data());
+      Bucket_Boruvka::get_batch_hashes(idxs.data(), n, seed, hashes.data());
+      for (size_t i = 0; i < n; i++) {
+        ASSERT_EQ(depths[i], Bucket_Boruvka::get_index_depth(idxs[i], seed, max_depth));
+        ASSERT_EQ(hashes[i], Bucket_Boruvka::get_index_hash(idxs[i], seed));
+        ASSERT_EQ(Bucket_Boruvka::xxh3_index(idxs[i], seed),
+                  XXH3_64bits_withSeed(&idxs[i], sizeof(vec_t), seed));
+      }
+    }
+  }
+  Bucket_Boruvka::set_hash_kernel(initial);
+}
+
+TEST(SketchTestSuite, TestMergeKernelsMatchScalar) {
+  std::mt19937_64 gen(get_seed());
+  Bucket_Boruvka::MergeKernel initial = Bucket_Boruvka::get_merge_kernel();
+  for (auto kernel : {Bucket_Boruvka::SCALAR_MERGE, Bucket_Boruvka::AVX2_MERGE,
+                      Bucket_Boruvka::AVX512_MERGE}) {
+    if (!Bucket_Boruvka::set_merge_kernel(kernel)) continue;
+
+    // unaligned ranges of every length up to a few vectors
+    for (size_t bytes = 0; bytes < 600; bytes += 7) {
+      size_t offset = gen() % 64;
+      std::vector<char> dst(bytes + 64), src(bytes + 64), expected;
+      for (auto &c : dst) c = gen();
+      for (auto &c : src) c = gen();
+      expected = dst;
+      for (size_t i = 0; i < bytes; i++) expected[offset + i] ^= src[offset + i];
+
+      Bucket_Boruvka::xor_bucket_memory(dst.data() + offset, src.data() + offset, bytes);
+      ASSERT_EQ(dst, expected);
+
+      for (size_t i = 0; i < bytes; i++) expected[offset + i] = 0;
+      Bucket_Boruvka::zero_bucket_memory(dst.data() + offset, bytes);
+      ASSERT_EQ(dst, expected);
+    }
+
+    // large enough to use the non-temporal zeroing
+    std::vector<char> large(Bucket_Boruvka::nontemporal_zero_bytes + 13, 1);
+    Bucket_Boruvka::zero_bucket_memory(large.data() + 3, large.size() - 4);
+    ASSERT_EQ(large.front(), 1);
+    ASSERT_EQ(large.back(), 1);
+    for (size_t i = 3; i < large.size() - 1; i++) ASSERT_EQ(large[i], 0);
+
+    // sketch merges agree with applying all the updates to one sketch
+    size_t seed = gen();
+    Sketch sk1(1 << 12, seed, 5, 2);
+    Sketch sk2(1 << 12, seed, 5, 2);
+    Sketch both(1 << 12, seed, 5, 2);
+    for (vec_t i = 0; i < 1000; i++) {
+      vec_t idx1 = gen() % (1 << 12), idx2 = gen() % (1 << 12);
+      sk1.update(idx1);
+      sk2.update(idx2);
+      both.update(idx1);
+      both.update(idx2);
+    }
+    Sketch merged(sk1);
+    merged.merge(sk2);
+    ASSERT_EQ(merged, both);
+
+    Sketch range_merged(sk1);
+    range_merged.range_merge(sk2, 0, 5);
+    ASSERT_EQ(range_merged, both);
+
+    Bucket *raw_buckets = new Bucket[sk2.get_buckets()];
+    sk2.copy_to_raw_bucket_buffer(raw_buckets);
+    Sketch raw_merged(sk1);
+    raw_merged.merge_raw_bucket_buffer(raw_buckets);
+    ASSERT_EQ(raw_merged, both);
+    delete[] raw_buckets;
+
+    merged.zero_contents();
+    ASSERT_EQ(merged, Sketch(1 << 12, seed, 5, 2));
+  }
+  Bucket_Boruvka::set_merge_kernel(initial);
+}
+
 TEST(SketchTestSuite, TestSketchLarge) {
   constexpr uint64_t upper_bound = 1e9;
   for (uint64_t i = 1e4; i <= upper_bound; i *= 10) {
@@ -313,6 +435,108 @@ TEST(SketchTestSuite, TestSerialization) {
   ASSERT_EQ(sketch, reheated);
 }
 
+TEST(SketchTestSuite, TestSparseSerialization) {
+  unsigned long vec_size = 1 << 20;
+  auto seed = get_seed();
+  for (IndexWidth index_width : {WIDE_INDEX, NARROW_INDEX}) {
+    Sketch sketch(vec_size, seed, 8, num_columns, default_sketch_algorithm, index_width);
+    for (vec_t j = 0; j < 20; j++) {
+      sketch.update(j * 7919);
+    }
+    std::stringstream stream;
+    sketch.serialize(stream, SPARSE);
+    ASSERT_EQ(stream.str().size(), sketch.sparse_serialized_bytes());
+    ASSERT_LT(stream.str().size(), sketch.serialized_bytes() / 2);
+
+    // deserializing replaces the previous contents of the sketch
+    Sketch reheated(vec_size, seed, 8, num_columns, default_sketch_algorithm, index_width);
+    reheated.update(1);
+    reheated.deserialize(stream, SPARSE);
+    ASSERT_EQ(sketch, reheated);
+
+    // a position past the sketch or out of order fails the stream rather than being written
+    size_t second_position = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(Bucket);
+    for (uint32_t position : {uint32_t(-1), uint32_t(0)}) {
+      std::string corrupt = stream.str();
+      memcpy(&corrupt[second_position], &position, sizeof(position));
+      std::stringstream corrupt_stream(corrupt);
+      reheated.deserialize(corrupt_stream, SPARSE);
+      ASSERT_TRUE(corrupt_stream.fail());
+    }
+    std::stringstream unknown_stream(stream.str());
+    reheated.deserialize(unknown_stream, SerialType(SPARSE + 1));
+    ASSERT_TRUE(unknown_stream.fail());
+
+    std::stringstream empty_stream;
+    Sketch empty(vec_size, seed, 8, num_columns, default_sketch_algorithm, index_width);
+    empty.serialize(empty_stream, SPARSE);
+    ASSERT_EQ(empty_stream.str().size(), sizeof(uint32_t));
+    Sketch empty_reheated(vec_size, seed, empty_stream, SPARSE, 8, num_columns,
+                          default_sketch_algorithm, index_width);
+    ASSERT_EQ(empty, empty_reheated);
+  }
+}
+
+TEST(SketchTestSuite, TestRangeSerialization) {
+  unsigned long vec_size = 1 << 10;
+  size_t num_samples = 6;
+  auto seed = get_seed();
+  Sketch sketch(vec_size, seed, num_samples, num_columns);
+  for (vec_t j = 0; j < 3000; j++) {
+    sketch.update(j * 3);
+  }
+
+  for (size_t start = 0; start < num_samples; start++) {
+    size_t n_samples = std::min<size_t>(2, num_samples - start);
+    std::stringstream stream;
+    sketch.serialize_range(stream, start, n_samples);
+    Sketch reheated(vec_size, seed, stream, RANGE, num_samples, num_columns);
+
+    // the same as merging the range into an empty sketch
+    Sketch merged(vec_size, seed, num_samples, num_columns);
+    merged.range_merge(sketch, start, n_samples);
+    ASSERT_EQ(merged, reheated);
+    SketchSample sample = reheated.sample();
+    SketchSample expected = merged.sample();
+    ASSERT_EQ(sample.result, expected.result);
+    ASSERT_EQ(sample.idx, expected.idx);
+  }
+
+  // RANGE writes the samples that remain
+  Sketch full_range(vec_size, seed, num_samples, num_columns);
+  full_range.merge(sketch);
+  full_range.sample();
+  full_range.sample();
+  std::stringstream stream;
+  full_range.serialize(stream, RANGE);
+  Sketch reheated(vec_size, seed, stream, RANGE, num_samples, num_columns);
+  Sketch merged(vec_size, seed, num_samples, num_columns);
+  merged.range_merge(sketch, 2, num_samples - 2);
+  ASSERT_EQ(merged, reheated);
+}
+
+// The serialized format must be an array of Buckets regardless of the in-memory bucket layout
+TEST(SketchTestSuite, TestSerializationIsRawBucketArray) {
+  auto seed = get_seed();
+  Sketch sketch(1 << 10, seed, 3, num_columns);
+  for (vec_t j = 0; j < 5000; j++) {
+    sketch.update(j * 7);
+  }
+  std::stringstream stream;
+  sketch.serialize(stream);
+  std::string serialized = stream.str();
+  ASSERT_EQ(serialized.size(), sketch.bucket_array_bytes());
+
+  Bucket *raw_buckets = new Bucket[sketch.get_buckets()];
+  sketch.copy_to_raw_bucket_buffer(raw_buckets);
+  ASSERT_EQ(memcmp(serialized.data(), raw_buckets, sketch.bucket_array_bytes()), 0);
+
+  Sketch merged(1 << 10, seed, 3, num_columns);
+  merged.merge_raw_bucket_buffer(raw_buckets);
+  ASSERT_EQ(sketch, merged);
+  delete[] raw_buckets;
+}
+
 TEST(SketchTestSuite, TestSamplesHaveUniqueSeed) {
   size_t num_samples = 50;
   size_t cols_per_sample = 3;
@@ -431,7 +655,8 @@ TEST(SketchTestSuite, TestRawBucketUpdate) {
       sk1.update(i);
     }
 
-    const Bucket *data = sk1.get_readonly_bucket_ptr();
+    Bucket *data = new Bucket[sk1.get_buckets()];
+    sk1.copy_to_raw_bucket_buffer(data);
 
     sk2.merge_raw_bucket_buffer(data);
 
@@ -452,7 +677,456 @@ TEST(SketchTestSuite, TestRawBucketUpdate) {
     sample = sk2.sample();
     ASSERT_EQ(sample.result, ZERO);
 
+    delete[] data;
     delete[] copy_data;
   }
   ASSERT_GT(successes, 0);
 }
+
+TEST(SketchTestSuite, TestRangeUpdateMatchesRangeMerge) {
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  std::vector<vec_t> updates(40);
+  for (auto &idx : updates) idx = gen() % (1 << 12);
+  Sketch full(1 << 12, seed, 4);
+  full.update_batch(updates.data(), updates.size());
+
+  for (size_t sample = 0; sample < 4; sample++) {
+    Sketch merged(1 << 12, seed, 4);
+    Sketch updated(1 << 12, seed, 4);
+    merged.range_merge(full, sample, 1);
+    updated.range_update_batch(updates.data(), updates.size(), sample, 1);
+    ASSERT_EQ(updated, merged);
+
+    SketchSample merged_sample = merged.sample();
+    SketchSample updated_sample = updated.sample();
+    ASSERT_EQ(updated_sample.result, merged_sample.result);
+    ASSERT_EQ(updated_sample.idx, merged_sample.idx);
+  }
+}
+
+TEST(SketchTestSuite, TestMergeTouchedMatchesMerge) {
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  Sketch expected(1 << 12, seed, 4);
+  Sketch sparse(1 << 12, seed, 4);
+  Sketch full_delta(1 << 12, seed, 4);
+  Sketch sparse_delta(1 << 12, seed, 4);
+  Sketch empty(1 << 12, seed, 4);
+
+  for (size_t batch_size : {1, 2, 5, 17, 64}) {
+    std::vector<vec_t> updates(batch_size);
+    std::vector<bucket_id_t> touched(sparse_delta.max_touched(batch_size));
+    for (size_t t = 0; t < 10; t++) {
+      // repeat an index to exercise a bucket returning to zero within the batch
+      for (size_t i = 0; i < batch_size; i++) updates[i] = gen() % (1 << 12);
+      if (batch_size > 1) updates[batch_size - 1] = updates[0];
+
+      full_delta.zero_contents();
+      full_delta.update_batch(updates.data(), batch_size);
+      expected.merge(full_delta);
+
+      size_t num_touched = sparse_delta.update_batch(updates.data(), batch_size, touched.data());
+      ASSERT_LE(num_touched, touched.size());
+      ASSERT_EQ(sparse_delta, full_delta);
+      sparse.merge_touched(sparse_delta, touched.data(), num_touched);
+      ASSERT_EQ(sparse, expected);
+      ASSERT_EQ(sparse_delta, empty);  // merging clears the delta
+    }
+  }
+}
+
+#ifdef SOA_BUCKETS
+TEST(SketchTestSuite, TestAtomicMergeMatchesMerge) {
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  // an odd number of buckets leaves a gamma tail that is not merged a word at a time
+  for (size_t num_samples : {1, 3, 4}) {
+    Sketch expected(1 << 12, seed, num_samples);
+    Sketch atomic(1 << 12, seed, num_samples);
+    Sketch raw(1 << 12, seed, num_samples);
+    Sketch delta(1 << 12, seed, num_samples);
+    Bucket *raw_buckets = new Bucket[delta.get_buckets()];
+
+    for (size_t t = 0; t < 10; t++) {
+      delta.zero_contents();
+      for (size_t i = 0; i < 200; i++) delta.update(gen() % (1 << 12));
+      delta.copy_to_raw_bucket_buffer(raw_buckets);
+
+      expected.merge(delta);
+      atomic.atomic_merge(delta);
+      raw.atomic_merge_raw_bucket_buffer(raw_buckets);
+      ASSERT_EQ(atomic, expected);
+      ASSERT_EQ(raw, expected);
+
+      // merge the same delta again, but only the buckets that a small batch touched
+      Sketch sparse_delta(1 << 12, seed, num_samples);
+      vec_t updates[2] = {gen() % (1 << 12), gen() % (1 << 12)};
+      std::vector<bucket_id_t> touched(sparse_delta.max_touched(2));
+      size_t num_touched = sparse_delta.update_batch(updates, 2, touched.data());
+      expected.merge(sparse_delta);
+      raw.merge(sparse_delta);
+      atomic.atomic_merge_touched(sparse_delta, touched.data(), num_touched);
+      ASSERT_EQ(atomic, expected);
+      ASSERT_EQ(sparse_delta, Sketch(1 << 12, seed, num_samples));
+    }
+    delete[] raw_buckets;
+  }
+}
+#endif
+
+TEST(SketchTestSuite, TestSketchArenaMatchesStandalone) {
+  size_t seed = get_seed();
+  size_t vec_size = 1 << 12;
+  size_t num_sketches = 50;
+  std::mt19937_64 gen(seed);
+
+  for (auto mode : {NO_HUGE_PAGES, TRANSPARENT_HUGE_PAGES, EXPLICIT_HUGE_PAGES}) {
+    SketchArena arena(num_sketches, vec_size, seed, 4, num_columns, mode);
+    ASSERT_GE(arena.get_slab_bytes(), num_sketches * arena.get_params().bucket_memory_bytes());
+
+    std::vector<Sketch *> standalone;
+    for (size_t i = 0; i < num_sketches; i++) {
+      standalone.push_back(new Sketch(vec_size, seed, 4, num_columns));
+      ASSERT_EQ(arena[i], *standalone[i]);  // arena sketches start out empty
+    }
+
+    for (size_t u = 0; u < 20000; u++) {
+      size_t s = gen() % num_sketches;
+      vec_t idx = gen() % vec_size;
+      arena[s].update(idx);
+      standalone[s]->update(idx);
+    }
+    for (size_t i = 1; i < num_sketches; i++) {
+      arena[0].merge(arena[i]);
+      standalone[0]->merge(*standalone[i]);
+    }
+    for (size_t i = 0; i < num_sketches; i++) {
+      ASSERT_EQ(arena[i], *standalone[i]);
+      SketchSample arena_sample = arena[i].sample();
+      SketchSample standalone_sample = standalone[i]->sample();
+      ASSERT_EQ(arena_sample.result, standalone_sample.result);
+      ASSERT_EQ(arena_sample.idx, standalone_sample.idx);
+    }
+
+    // round trip a standalone sketch through an arena sketch
+    std::stringstream stream;
+    standalone[1]->serialize(stream);
+    arena[2].deserialize(stream);
+    ASSERT_EQ(arena[2], *standalone[1]);
+
+    for (auto sketch : standalone) delete sketch;
+  }
+}
+
+// Arena sketches may be stored differently from standalone sketches (see ROUND_MAJOR_BUCKETS).
+// Check that every operation between the two agrees with the same operation between standalones
+TEST(SketchTestSuite, TestArenaSketchesInteroperate) {
+  size_t seed = get_seed();
+  size_t vec_size = 1 << 12;
+  size_t num_samples = 4;
+  size_t num_sketches = 16;
+  std::mt19937_64 gen(seed);
+
+  SketchArena arena(num_sketches, vec_size, seed, num_samples, num_columns, NO_HUGE_PAGES);
+#ifdef ROUND_MAJOR_BUCKETS
+  // column c of every sketch is one region
+  ASSERT_EQ(arena.get_params().column_stride, num_sketches * arena.get_params().bkt_per_col);
+#endif
+  std::vector<Sketch *> standalone;
+  for (size_t i = 0; i < num_sketches; i++) {
+    standalone.push_back(new Sketch(vec_size, seed, num_samples, num_columns));
+    std::vector<vec_t> updates(200 + 10 * i);
+    for (auto &idx : updates) idx = gen() % vec_size;
+    arena[i].update_batch(updates.data(), updates.size());
+    standalone[i]->update_batch(updates.data(), updates.size());
+  }
+
+  // copies of arena sketches are standalone
+  Sketch copy(arena[3]);
+  ASSERT_EQ(copy, *standalone[3]);
+
+  // merges in both directions
+  Sketch local(vec_size, seed, num_samples, num_columns);
+  Sketch expected(vec_size, seed, num_samples, num_columns);
+  for (size_t i = 0; i < num_sketches; i++) {
+    local.range_merge(arena[i], 1, 2);
+    expected.range_merge(*standalone[i], 1, 2);
+  }
+  ASSERT_EQ(local, expected);
+  arena[4].merge(local);
+  standalone[4]->merge(expected);
+  arena[5].range_merge(arena[6], 0, num_samples);
+  standalone[5]->range_merge(*standalone[6], 0, num_samples);
+
+  // raw bucket buffers
+  std::vector<Bucket> raw(arena[7].get_buckets());
+  arena[8].copy_to_raw_bucket_buffer(raw.data());
+  arena[7].merge_raw_bucket_buffer(raw.data());
+  standalone[7]->merge(*standalone[8]);
+
+  // merging a delta by its touched buckets
+  Sketch delta(vec_size, seed, num_samples, num_columns);
+  std::vector<vec_t> updates(50);
+  for (auto &idx : updates) idx = gen() % vec_size;
+  std::vector<bucket_id_t> touched(delta.max_touched(updates.size()));
+  size_t num_touched = delta.update_batch(updates.data(), updates.size(), touched.data());
+  arena[9].merge_touched(delta, touched.data(), num_touched);
+  standalone[9]->update_batch(updates.data(), updates.size());
+  ASSERT_EQ(delta, Sketch(vec_size, seed, num_samples, num_columns));
+
+  // zeroing a sketch leaves its neighbors alone
+  arena[10].zero_contents();
+  standalone[10]->zero_contents();
+
+  for (size_t i = 0; i < num_sketches; i++) {
+    ASSERT_EQ(arena[i], *standalone[i]) << "sketch " << i;
+    for (size_t s = 0; s < num_samples; s++) {
+      SketchSample arena_sample = arena[i].sample();
+      SketchSample standalone_sample = standalone[i]->sample();
+      ASSERT_EQ(arena_sample.result, standalone_sample.result);
+      ASSERT_EQ(arena_sample.idx, standalone_sample.idx);
+    }
+    delete standalone[i];
+  }
+}
+
+TEST(SketchTestSuite, TestSpecializedKernelsMatchGeneric) {
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  vec_t vec_size = Sketch::calc_vector_length(1 << 10);
+  size_t num_samples = 4;
+
+  for (SketchAlgorithm algorithm : {CAMEO_SKETCH, CUBE_SKETCH}) {
+    // the default columns per sample, and another number of columns
+    for (size_t cols : {Sketch::calc_cols_per_sample(algorithm), size_t(3)}) {
+      Sketch::use_specialized_kernels(false);
+      Sketch generic(vec_size, seed, num_samples, cols, algorithm);
+      Sketch::use_specialized_kernels(true);
+      Sketch specialized(vec_size, seed, num_samples, cols, algorithm);
+      ASSERT_EQ(generic.get_algorithm(), algorithm);
+
+      std::vector<vec_t> updates(1000);
+      for (auto &idx : updates) idx = gen() % vec_size;
+      for (size_t i = 0; i < 100; i++) {
+        generic.update(updates[i]);
+        specialized.update(updates[i]);
+      }
+      generic.update_batch(updates.data() + 100, 700);
+      specialized.update_batch(updates.data() + 100, 700);
+      std::vector<bucket_id_t> touched(generic.max_touched(200));
+      Sketch generic_delta(generic.get_params());
+      Sketch specialized_delta(specialized.get_params());
+      size_t generic_touched = generic_delta.update_batch(updates.data() + 800, 200,
+                                                          touched.data());
+      generic.merge_touched(generic_delta, touched.data(), generic_touched);
+      size_t specialized_touched = specialized_delta.update_batch(updates.data() + 800, 200,
+                                                                  touched.data());
+      specialized.merge_touched(specialized_delta, touched.data(), specialized_touched);
+      ASSERT_EQ(generic_touched, specialized_touched);
+      ASSERT_EQ(generic, specialized);
+
+      for (size_t s = 0; s < num_samples; s++) {
+        SketchSample generic_sample = generic.sample();
+        SketchSample specialized_sample = specialized.sample();
+        ASSERT_EQ(generic_sample.result, specialized_sample.result);
+        ASSERT_EQ(generic_sample.idx, specialized_sample.idx);
+      }
+    }
+  }
+}
+
+TEST(SketchTestSuite, TestSketchAlgorithmsDiffer) {
+  // CubeSketch also updates the buckets below the depth of an update, so with the same seed the
+  // two algorithms only agree on the deterministic bucket
+  size_t seed = get_seed();
+  Sketch cameo(1 << 12, seed, 4, 1, CAMEO_SKETCH);
+  Sketch cube(1 << 12, seed, 4, 1, CUBE_SKETCH);
+  for (vec_t idx = 0; idx < 50; idx++) {
+    cameo.update(idx);
+    cube.update(idx);
+  }
+  ASSERT_FALSE(cameo == cube);
+
+  // both sample exactly one non-zero index
+  Sketch cameo_single(1 << 12, seed, 4, 1, CAMEO_SKETCH);
+  Sketch cube_single(1 << 12, seed, 4, 1, CUBE_SKETCH);
+  cameo_single.update(1234);
+  cube_single.update(1234);
+  SketchSample cameo_sample = cameo_single.sample();
+  SketchSample cube_sample = cube_single.sample();
+  ASSERT_EQ(cameo_sample.result, GOOD);
+  ASSERT_EQ(cube_sample.result, GOOD);
+  ASSERT_EQ(cameo_sample.idx, cube_sample.idx);
+}
+
+TEST(SketchTestSuite, TestNarrowIndexMatchesWide) {
+  size_t seed = get_seed();
+  std::mt19937_64 gen(seed);
+  vec_t vec_size = Sketch::calc_vector_length(1 << 16);
+  size_t num_samples = 8;
+
+  for (SketchAlgorithm algorithm : {CAMEO_SKETCH, CUBE_SKETCH}) {
+    size_t cols = Sketch::calc_cols_per_sample(algorithm);
+    Sketch wide(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX);
+    Sketch narrow(vec_size, seed, num_samples, cols, algorithm, NARROW_INDEX);
+    ASSERT_EQ(narrow.get_index_width(), NARROW_INDEX);
+    ASSERT_EQ(narrow.bucket_array_bytes(),
+              wide.bucket_array_bytes() * sizeof(NarrowBucket) / sizeof(Bucket));
+
+    // indices up to 2^32 - 1 must survive the narrower buckets
+    std::vector<vec_t> updates(1000);
+    for (auto &idx : updates) idx = gen() % (vec_t(1) << 32);
+    for (size_t i = 0; i < 100; i++) {
+      wide.update(updates[i]);
+      narrow.update(updates[i]);
+    }
+    wide.update_batch(updates.data() + 100, 700);
+    narrow.update_batch(updates.data() + 100, 700);
+    std::vector<bucket_id_t> touched(wide.max_touched(100));
+    Sketch wide_delta(wide.get_params());
+    Sketch narrow_delta(narrow.get_params());
+    size_t num_touched = wide_delta.update_batch(updates.data() + 800, 100, touched.data());
+    wide.merge_touched(wide_delta, touched.data(), num_touched);
+    num_touched = narrow_delta.update_batch(updates.data() + 800, 100, touched.data());
+    narrow.merge_touched(narrow_delta, touched.data(), num_touched);
+    wide_delta.update_batch(updates.data() + 900, 100);
+    narrow_delta.update_batch(updates.data() + 900, 100);
+    wide.merge(wide_delta);
+    narrow.merge(narrow_delta);
+    ASSERT_EQ(wide, narrow);
+
+    // both serialize to the same raw buckets
+    std::stringstream wide_out, narrow_out;
+    wide.serialize(wide_out);
+    narrow.serialize(narrow_out);
+    ASSERT_EQ(narrow_out.str().size(), narrow.serialized_bytes());
+    ASSERT_EQ(wide_out.str(), narrow_out.str());
+    Sketch narrow_copy(vec_size, seed, narrow_out, num_samples, cols, algorithm, NARROW_INDEX);
+    ASSERT_EQ(narrow_copy, narrow);
+
+    for (size_t s = 0; s < num_samples; s++) {
+      SketchSample wide_sample = wide.sample();
+      SketchSample narrow_sample = narrow.sample();
+      ASSERT_EQ(wide_sample.result, narrow_sample.result);
+      ASSERT_EQ(wide_sample.idx, narrow_sample.idx);
+    }
+  }
+}
+
+TEST(SketchTestSuite, TestSlicedDepths) {
+  std::mt19937_64 gen(get_seed());
+
+  // the depths keep the distribution of a depth hashed per column, including the depths taken
+  // past the end of a slice
+  size_t num_trials = 1 << 20;
+  vec_hash_t max_depth = 20;
+  std::vector<size_t> counts(max_depth + 1);
+  uint64_t column_seed = gen();
+  std::vector<SketchHash::Key> column_keys;
+  for (size_t slice = 0; slice < Bucket_Boruvka::depth_slice_columns; slice++)
+    column_keys.push_back(SketchHash::make_key(column_seed + slice * Sketch::column_seed_stride));
+  SketchHash::Key slice_key = SketchHash::make_key(column_seed + 1);
+  for (size_t t = 0; t < num_trials; t++) {
+    vec_t idx = gen();
+    uint64_t slice_hash = SketchHash::hash(idx, slice_key);
+    size_t slice = t % 8;
+    counts[Bucket_Boruvka::get_sliced_depth(idx, slice_hash, slice, column_keys[slice],
+                                            max_depth)]++;
+  }
+  for (size_t depth = 0; depth < 12; depth++) {
+    double expected = double(num_trials) / (2ull << depth);
+    ASSERT_NEAR(counts[depth], expected, 6 * sqrt(expected)) << "depth " << depth;
+  }
+
+  // the depths of all the columns sharing a hash at once, including hashes with zero slices
+  for (size_t t = 0; t < 10000; t++) {
+    vec_t idx = gen();
+    uint64_t slice_hash = SketchHash::hash(idx, slice_key);
+    if (t % 4 == 0) slice_hash &= ~(uint64_t(0xFF) << (gen() % 8 * 8));
+    vec_hash_t depth_cap = t % 2 ? max_depth : gen() % 12 + 1;
+    uint64_t packed = Bucket_Boruvka::get_sliced_depths(idx, slice_hash, column_keys.data(),
+                                                        depth_cap);
+    for (size_t slice = 0; slice < Bucket_Boruvka::depth_slice_columns; slice++) {
+      ASSERT_EQ((packed >> (slice * 8)) & 0xFF,
+                Bucket_Boruvka::get_sliced_depth(idx, slice_hash, slice, column_keys[slice],
+                                                 depth_cap));
+    }
+  }
+
+  // sliced sketches of short vectors cap the depth within the slice
+  for (vec_hash_t short_depth = 1; short_depth <= 8; short_depth++) {
+    vec_t idx = gen();
+    uint64_t slice_hash = SketchHash::hash(idx, slice_key);
+    ASSERT_LE(Bucket_Boruvka::get_sliced_depth(idx, slice_hash, 3, column_keys[3], short_depth),
+              short_depth);
+  }
+
+  size_t seed = get_seed();
+  vec_t vec_size = 1 << 16;
+  size_t num_samples = 10;
+  for (SketchAlgorithm algorithm : {CAMEO_SKETCH, CUBE_SKETCH}) {
+    size_t cols = Sketch::calc_cols_per_sample(algorithm);
+    Sketch serial(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX, SLICED_DEPTHS);
+    Sketch batched(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX, SLICED_DEPTHS);
+    Sketch columns(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX, COLUMN_DEPTHS);
+    ASSERT_EQ(serial.get_depth_hashing(), SLICED_DEPTHS);
+
+    std::vector<vec_t> updates(1000);
+    for (auto &idx : updates) idx = gen() % vec_size;
+    for (vec_t idx : updates) {
+      serial.update(idx);
+      columns.update(idx);
+    }
+    batched.update_batch(updates.data(), updates.size());
+    ASSERT_EQ(serial, batched);
+    ASSERT_FALSE(serial == columns);
+
+    // ranges of samples of one column do not start on a slice boundary
+    for (size_t sample = 1; sample < num_samples; sample += 3) {
+      Sketch merged(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX, SLICED_DEPTHS);
+      Sketch updated(vec_size, seed, num_samples, cols, algorithm, WIDE_INDEX, SLICED_DEPTHS);
+      size_t n_samples = std::min<size_t>(3, num_samples - sample);
+      merged.range_merge(serial, sample, n_samples);
+      updated.range_update_batch(updates.data(), updates.size(), sample, n_samples);
+      ASSERT_EQ(updated, merged);
+    }
+
+    // samples are still drawn from the sketched vector
+    std::unordered_set<vec_t> nonzero;
+    for (vec_t idx : updates) {
+      if (!nonzero.insert(idx).second) nonzero.erase(idx);
+    }
+    size_t num_good = 0;
+    for (size_t s = 0; s < num_samples; s++) {
+      SketchSample sample = serial.sample();
+      ASSERT_NE(sample.result, ZERO);
+      if (sample.result == GOOD) {
+        num_good++;
+        ASSERT_TRUE(nonzero.count(sample.idx));
+      }
+    }
+    ASSERT_GT(num_good, 0);
+  }
+}
+
+TEST(SketchTestSuite, TestSparseSketchToggles) {
+  // few distinct indices, so batches toggle indices already in the set and repeat indices
+  std::mt19937_64 gen(get_seed());
+  SparseSketch sparse;
+  std::set<vec_t> expected;
+  for (size_t batch_size : {1, 2, 7, 64, 1, 300, 3}) {
+    for (int b = 0; b < 20; b++) {
+      std::vector<vec_t> batch(batch_size);
+      for (auto &idx : batch) {
+        idx = gen() % 256;
+        if (!expected.erase(idx)) expected.insert(idx);
+      }
+      sparse.update_batch(batch.data(), batch.size());
+      ASSERT_EQ(std::vector<vec_t>(sparse.data(), sparse.data() + sparse.size()),
+                std::vector<vec_t>(expected.begin(), expected.end()));
+    }
+  }
+  sparse.update_batch(nullptr, 0);
+  ASSERT_EQ(sparse.size(), expected.size());
+}
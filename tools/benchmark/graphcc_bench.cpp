@@ -1,19 +1,28 @@
 #include <benchmark/benchmark.h>
+#include <omp.h>
+#include <sys/wait.h>
 #include <unistd.h>
 #include <xxhash.h>
 
 #include <algorithm>
+#include <chrono>
 #include <fstream>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <random>
 #include <thread>
+#include <unordered_set>
 #include <vector>
 #include <sstream>
 
 #include "binary_file_stream.h"
 #include "bucket.h"
+#include "cc_sketch_alg.h"
 #include "dsu.h"
 #include "sketch.h"
+#include "sketch_arena.h"
+#include "sparse_sketch.h"
 
 constexpr uint64_t KB = 1024;
 constexpr uint64_t MB = KB * KB;
@@ -186,6 +195,60 @@ static void BM_index_hash(benchmark::State& state) {
 }
 BENCHMARK(BM_index_hash);
 
+// Benchmark the depth hash policies of hash_policy.h with cached keys. Each iteration computes
+// the depth of one index under each of the given number of keys, as Sketch::update does for
+// the columns of a sketch. Every policy is benchmarked whichever one the build uses
+template <class Hash>
+static void BM_Hash_Policy(benchmark::State& state) {
+  size_t num_keys = state.range(0);
+  std::vector<typename Hash::Key> keys;
+  for (size_t i = 0; i < num_keys; i++)
+    keys.push_back(Hash::make_key(seed + i * Sketch::column_seed_stride));
+
+  uint64_t input = 100'000;
+  for (auto _ : state) {
+    ++input;
+    for (const auto &key : keys)
+      benchmark::DoNotOptimize(__builtin_ctzll(Hash::hash(input, key) | (1ull << 20)));
+  }
+  state.counters["Hash Rate"] =
+      benchmark::Counter(state.iterations() * num_keys, benchmark::Counter::kIsRate);
+}
+BENCHMARK_TEMPLATE(BM_Hash_Policy, XXH3Hash)->Arg(1)->Arg(64);
+BENCHMARK_TEMPLATE(BM_Hash_Policy, MultiplyShiftHash)->Arg(1)->Arg(64);
+BENCHMARK_TEMPLATE(BM_Hash_Policy, TabulationHash)->Arg(1)->Arg(64);
+
+// Benchmark the multi-lane hash kernels. The argument selects the kernel:
+// 0 = scalar, 1 = AVX2, 2 = AVX-512
+// Each iteration computes the depth of one index in 32 columns (as Sketch::update does) and
+// the checksums of 32 indices (as Sketch::update_batch and Sketch::sample do)
+static void BM_Hash_Kernel(benchmark::State& state) {
+  constexpr size_t lanes = 32;
+  auto kernel = (Bucket_Boruvka::HashKernel) state.range(0);
+  Bucket_Boruvka::HashKernel initial = Bucket_Boruvka::get_hash_kernel();
+  if (!Bucket_Boruvka::set_hash_kernel(kernel)) {
+    state.SkipWithError("hash kernel not supported on this CPU");
+    return;
+  }
+
+  vec_t idxs[lanes];
+  col_hash_t depths[lanes];
+  vec_hash_t hashes[lanes];
+  uint64_t input = 100'000;
+  for (auto _ : state) {
+    ++input;
+    for (size_t i = 0; i < lanes; i++) idxs[i] = input + i;
+    Bucket_Boruvka::get_index_depths(input, seed, Sketch::column_seed_stride, lanes, 20, depths);
+    Bucket_Boruvka::get_batch_hashes(idxs, lanes, seed, hashes);
+    benchmark::DoNotOptimize(depths);
+    benchmark::DoNotOptimize(hashes);
+  }
+  Bucket_Boruvka::set_hash_kernel(initial);
+  state.counters["Hash Rate"] =
+      benchmark::Counter(state.iterations() * 2 * lanes, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Hash_Kernel)->DenseRange(0, 2);
+
 static void BM_update_bucket(benchmark::State& state) {
   Bucket bkt;
   vec_t input = 0x0EADBEEF;
@@ -218,6 +281,631 @@ static void BM_Sketch_Update(benchmark::State& state) {
 }
 BENCHMARK(BM_Sketch_Update)->RangeMultiplier(4)->Ranges({{KB << 4, MB << 4}});
 
+// Benchmark the speed of updating sketches with update_batch
+// The arguments are the vector size and the number of updates per batch
+static void BM_Sketch_Update_Batch(benchmark::State& state) {
+  size_t vec_size = state.range(0);
+  size_t batch_size = state.range(1);
+  vec_t input = vec_size / 3;
+  // initialize sketches
+  Sketch skt(vec_size, seed, 1, Sketch::default_cols_per_sample);
+  std::vector<vec_t> updates(batch_size);
+
+  // Test the speed of updating the sketches
+  for (auto _ : state) {
+    for (size_t i = 0; i < batch_size; i++) updates[i] = ++input;
+    skt.update_batch(updates.data(), batch_size);
+  }
+  state.counters["Updates"] =
+      benchmark::Counter(state.iterations() * batch_size, benchmark::Counter::kIsRate);
+  state.counters["Hashes"] = benchmark::Counter(
+      state.iterations() * batch_size * (skt.get_columns() + 1), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Sketch_Update_Batch)->ArgsProduct({{KB << 4, MB << 4}, {16, 256, 4096}});
+
+// Benchmark the speed of updating a sketch sized for connected components on a graph with
+// the given number of vertices. The second argument selects the hash kernel (see BM_Hash_Kernel)
+static void BM_CC_Sketch_Update(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  auto kernel = (Bucket_Boruvka::HashKernel) state.range(1);
+  Bucket_Boruvka::HashKernel initial = Bucket_Boruvka::get_hash_kernel();
+  if (!Bucket_Boruvka::set_hash_kernel(kernel)) {
+    state.SkipWithError("hash kernel not supported on this CPU");
+    return;
+  }
+
+  Sketch skt(Sketch::calc_vector_length(num_vertices), seed,
+             Sketch::calc_cc_samples(num_vertices, 1));
+  vec_t input = 0;
+  for (auto _ : state) {
+    ++input;
+    skt.update(static_cast<vec_t>(concat_pairing_fn(input % num_vertices, input / num_vertices)));
+  }
+  Bucket_Boruvka::set_hash_kernel(initial);
+  state.counters["Updates"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+  state.counters["Hashes"] =
+      benchmark::Counter(state.iterations() * (skt.get_columns() + 1), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Sketch_Update)->ArgsProduct({{1 << 14, 1 << 20}, {0, 1, 2}});
+
+// Benchmark the update and sample kernels specialized for the shape of a sketch against the
+// generic kernels. Arguments are the number of vertices, the algorithm (0 = CameoSketch,
+// 1 = CubeSketch) and whether to use the specialized kernels
+static void BM_CC_Specialized_Update(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  auto algorithm = (SketchAlgorithm) state.range(1);
+  Sketch::use_specialized_kernels(state.range(2));
+  Sketch skt(Sketch::calc_vector_length(num_vertices), seed,
+             Sketch::calc_cc_samples(num_vertices, 1, algorithm),
+             Sketch::calc_cols_per_sample(algorithm), algorithm);
+  Sketch::use_specialized_kernels(true);
+
+  vec_t input = 0;
+  for (auto _ : state) {
+    ++input;
+    skt.update(static_cast<vec_t>(concat_pairing_fn(input % num_vertices, input / num_vertices)));
+  }
+  state.counters["Updates"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Specialized_Update)->ArgsProduct({{1 << 10, 1 << 16}, {0, 1}, {0, 1}});
+
+static void BM_CC_Specialized_Sample(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  auto algorithm = (SketchAlgorithm) state.range(1);
+  Sketch::use_specialized_kernels(state.range(2));
+  Sketch skt(Sketch::calc_vector_length(num_vertices), seed,
+             Sketch::calc_cc_samples(num_vertices, 1, algorithm),
+             Sketch::calc_cols_per_sample(algorithm), algorithm);
+  Sketch::use_specialized_kernels(true);
+
+  // enough updates that the deterministic bucket does not answer the samples
+  for (node_id_t i = 1; i < 64; i++) skt.update(concat_pairing_fn(0, i));
+  size_t num_samples = skt.get_num_samples();
+  size_t samples = 0;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(skt.sample());
+    if (++samples % num_samples == 0) skt.reset_sample_state();
+  }
+  state.counters["Samples"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Specialized_Sample)->ArgsProduct({{1 << 10, 1 << 16}, {0, 1}, {0, 1}});
+
+// Benchmark hashing the depths of an update once per column against slicing them from shared
+// hashes. Arguments are the depth hashing, the hash kernel and the batch size (1 applies the
+// updates with Sketch::update)
+static void BM_CC_Sliced_Depths(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  auto depth_hashing = (DepthHashing) state.range(0);
+  auto kernel = (Bucket_Boruvka::HashKernel) state.range(1);
+  size_t batch_size = state.range(2);
+  Bucket_Boruvka::HashKernel initial = Bucket_Boruvka::get_hash_kernel();
+  if (!Bucket_Boruvka::set_hash_kernel(kernel)) {
+    state.SkipWithError("hash kernel not supported on this CPU");
+    return;
+  }
+
+  Sketch skt(Sketch::calc_vector_length(num_vertices), seed,
+             Sketch::calc_cc_samples(num_vertices, 1), Sketch::default_cols_per_sample,
+             default_sketch_algorithm, WIDE_INDEX, depth_hashing);
+  std::vector<vec_t> updates(batch_size);
+  vec_t input = 0;
+  for (auto _ : state) {
+    for (auto &idx : updates) {
+      ++input;
+      idx = concat_pairing_fn(input % num_vertices, input / num_vertices);
+    }
+    if (batch_size == 1) skt.update(updates[0]);
+    else skt.update_batch(updates.data(), batch_size);
+  }
+  Bucket_Boruvka::set_hash_kernel(initial);
+  state.counters["Updates"] = benchmark::Counter(state.iterations() * batch_size,
+                                                 benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Sliced_Depths)->ArgsProduct({{0, 1}, {0, 1, 2}, {1, 256}});
+
+// Benchmark updating the sketches of randomly chosen vertices, so that the sketches are rarely
+// in cache. Compile with and without DEPTH_MAJOR_BUCKETS to compare the bucket layouts.
+static void BM_CC_Random_Sketch_Update(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  SketchArena sketches(num_vertices, Sketch::calc_vector_length(num_vertices), seed,
+                       Sketch::calc_cc_samples(num_vertices, 1));
+  std::mt19937_64 gen(seed);
+  for (auto _ : state) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    sketches[src].update(static_cast<vec_t>(concat_pairing_fn(src, dst)));
+  }
+  state.counters["Updates"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Random_Sketch_Update)->RangeMultiplier(16)->Range(1 << 8, 1 << 16);
+
+// Benchmark applying batches of updates to the sketches of random vertices through a delta
+// sketch, as CCSketchAlg::apply_update_batch does. Arguments are the number of updates in the
+// batch and the merge: 0 = zero and merge the whole delta, 1 = merge only the touched buckets
+static void BM_CC_Delta_Update_Batch(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  size_t batch_size = state.range(0);
+  bool sparse = state.range(1);
+  vec_t vec_len = Sketch::calc_vector_length(num_vertices);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+  SketchArena sketches(num_vertices, vec_len, seed, num_samples);
+  Sketch delta(vec_len, seed, num_samples);
+  std::vector<bucket_id_t> touched(delta.max_touched(batch_size));
+
+  std::vector<vec_t> updates(batch_size);
+  std::mt19937_64 gen(seed);
+  for (auto _ : state) {
+    node_id_t src = gen() % num_vertices;
+    Sketch &vertex_sketch = sketches[src];
+    for (size_t i = 0; i < batch_size; i++)
+      updates[i] = concat_pairing_fn(src, gen() % num_vertices);
+    if (sparse) {
+      size_t num_touched = delta.update_batch(updates.data(), batch_size, touched.data());
+      vertex_sketch.merge_touched(delta, touched.data(), num_touched);
+    } else {
+      delta.zero_contents();
+      delta.update_batch(updates.data(), batch_size);
+      vertex_sketch.merge(delta);
+    }
+  }
+  state.counters["Updates"] =
+      benchmark::Counter(state.iterations() * batch_size, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Delta_Update_Batch)->ArgsProduct({{1, 4, 16, 64, 256}, {0, 1}});
+
+// resident memory of this process in bytes
+static size_t resident_bytes() {
+  std::ifstream statm("/proc/self/statm");
+  size_t total_pages, resident_pages;
+  statm >> total_pages >> resident_pages;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+// Benchmark ingesting a graph with power law degrees and computing its connected components. The
+// argument is whether low degree vertices store their exact edge sets instead of sketches.
+// Reports the resident memory gained while building the algorithm and ingesting the graph
+static void BM_CC_Sparse_Sketches(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  auto config = CCAlgConfiguration().sparse_sketch_factor(state.range(0) ? 0.125 : 0)
+                                    .huge_pages(NO_HUGE_PAGES);
+  std::mt19937_64 gen(seed);
+  std::vector<std::vector<node_id_t>> batches(num_vertices);
+  for (node_id_t src = 0; src < num_vertices; src++) {
+    // P(degree >= d) is roughly 1 / d
+    size_t degree = 1 / std::uniform_real_distribution<double>(1e-4, 1)(gen);
+    for (size_t d = 0; d < degree; d++) {
+      node_id_t dst = gen() % num_vertices;
+      if (dst == src) continue;
+      batches[src].push_back(dst);
+      batches[dst].push_back(src);
+    }
+  }
+
+  size_t resident = 0;
+  for (auto _ : state) {
+    size_t resident_before = resident_bytes();
+    CCSketchAlg cc_alg(num_vertices, seed, config);
+    cc_alg.allocate_worker_memory(1);
+    for (node_id_t src = 0; src < num_vertices; src++)
+      cc_alg.apply_update_batch(0, src, batches[src]);
+    resident = resident_bytes() - resident_before;
+    benchmark::DoNotOptimize(cc_alg.connected_components());
+  }
+  state.counters["Resident_MiB"] = double(resident) / MB;
+}
+BENCHMARK(BM_CC_Sparse_Sketches)->DenseRange(0, 1)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+// Benchmark toggling batches of edges of a vertex whose exact edge set is just below the size at
+// which a 2^16 vertex graph moves it into its sketch. The arguments are the batch size and the
+// sparse sketch factor in eighths. Every batch is applied twice so the set keeps its size
+static void BM_Sparse_Sketch_Near_Threshold(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  size_t batch_size = state.range(0);
+  double factor = state.range(1) / 8.0;
+  vec_t vec_size = Sketch::calc_vector_length(num_vertices);
+  size_t max_sparse_size = factor * Sketch(vec_size, seed, Sketch::calc_cc_samples(num_vertices, 1))
+                                        .bucket_array_bytes() / sizeof(vec_t);
+  std::mt19937_64 gen(seed);
+  SparseSketch sparse;
+  std::vector<vec_t> updates(max_sparse_size - batch_size);
+  for (auto &idx : updates) idx = gen() % vec_size;
+  sparse.update_batch(updates.data(), updates.size());
+
+  updates.resize(batch_size);
+  for (auto _ : state) {
+    for (auto &idx : updates) idx = gen() % vec_size;
+    sparse.update_batch(updates.data(), batch_size);
+    sparse.update_batch(updates.data(), batch_size);
+  }
+  state.counters["Set_Size"] = sparse.size();
+  state.counters["Updates"] =
+      benchmark::Counter(state.iterations() * 2 * batch_size, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Sparse_Sketch_Near_Threshold)->ArgsProduct({{1, 4, 16, 64}, {1, 8}});
+
+// Benchmark the memory that the algorithm keeps for each vertex besides its sketch, which is never
+// touched. The argument is the number of vertices. Reports the resident bytes per vertex
+static void BM_CC_Vertex_Overhead(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  auto config = CCAlgConfiguration().huge_pages(NO_HUGE_PAGES);
+  size_t resident = 0;
+  for (auto _ : state) {
+    size_t resident_before = resident_bytes();
+    CCSketchAlg cc_alg(num_vertices, seed, config);
+    resident = resident_bytes() - resident_before;
+  }
+  state.counters["Bytes_Per_Vertex"] = double(resident) / num_vertices;
+}
+BENCHMARK(BM_CC_Vertex_Overhead)
+    ->RangeMultiplier(4)
+    ->Range(1 << 14, 1 << 18)
+    ->Iterations(1)
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark building a spanning forest of a graph with the given number of vertices and half as
+// many random edges from the forest that the eager DSU maintains as the edges are inserted. Reports
+// the edges inserted into the eager DSU per second
+static void BM_CC_Spanning_Forest(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg(num_vertices, seed);
+  auto start = std::chrono::steady_clock::now();
+  for (node_id_t i = 0; i < num_vertices / 2; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) cc_alg.pre_insert({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+  double insert_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cc_alg.calc_spanning_forest());
+  }
+  state.counters["Eager_Insert_Rate"] = num_vertices / 2 / insert_s;
+}
+BENCHMARK(BM_CC_Spanning_Forest)
+    ->RangeMultiplier(4)
+    ->Range(1 << 14, 1 << 18)
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark stream threads keeping the eager DSU in pre_insert() at once. The first argument is
+// the number of threads. The second selects the updates: 0 = random edges, 1 = edges that all
+// touch one of 16 hot vertices, in random order. Reports the updates per second
+static void BM_CC_Eager_DSU_Threads(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  constexpr size_t num_updates = 1 << 20;
+  constexpr node_id_t num_hot = num_updates / num_vertices;
+  // each edge is inserted once, inserting it again would delete it and invalidate the DSU
+  std::mt19937_64 gen(seed);
+  std::vector<GraphUpdate> updates;
+  std::unordered_set<edge_id_t> inserted;
+  for (size_t i = 0; i < num_updates; i++) {
+    node_id_t src = state.range(1) == 1 ? i % num_hot : gen() % num_vertices;
+    node_id_t dst = state.range(1) == 1 ? i / num_hot : gen() % num_vertices;
+    Edge edge = {std::min(src, dst), std::max(src, dst)};
+    if (src == dst || !inserted.insert(concat_pairing_fn(edge.src, edge.dst)).second) continue;
+    updates.push_back({edge, INSERT});
+  }
+  std::shuffle(updates.begin(), updates.end(), gen);
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    CCSketchAlg cc_alg(num_vertices, seed);
+    state.ResumeTiming();
+#pragma omp parallel for num_threads(state.range(0))
+    for (size_t i = 0; i < updates.size(); i++) cc_alg.pre_insert(updates[i], 0);
+  }
+  state.counters["Update_Rate"] = benchmark::Counter(state.iterations() * updates.size(),
+                                                     benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Eager_DSU_Threads)
+    ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark querying after deleting a number of spanning forest edges, given by the argument,
+// from a random graph. The query replaces them without rerunning Boruvka on every vertex
+static void BM_CC_Forest_Repair(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg(num_vertices, seed);
+  for (size_t i = 0; i < 4 * num_vertices; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) cc_alg.update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+  cc_alg.connected_components();
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Edge> forest = cc_alg.calc_spanning_forest().get_edges();
+    std::shuffle(forest.begin(), forest.end(), gen);
+    forest.resize(state.range(0));
+    for (Edge edge : forest) cc_alg.update({edge, DELETE});
+    state.ResumeTiming();
+
+    cc_alg.connected_components();
+
+    // insert the edges again, which keeps the graph the same for the next iteration
+    state.PauseTiming();
+    for (Edge edge : forest) cc_alg.update({edge, INSERT});
+    state.ResumeTiming();
+  }
+  state.counters["Query_Rounds"] = cc_alg.last_query_rounds;
+}
+BENCHMARK(BM_CC_Forest_Repair)
+    ->RangeMultiplier(8)
+    ->Range(1, 512)
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark the query that follows deleting so many edges of the spanning forest of a random
+// graph that the query cannot repair the forest, and reruns Boruvka. The argument is the number
+// of deleted forest edges
+static void BM_CC_Repeated_Query(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  std::mt19937_64 gen(seed);
+  CCSketchAlg cc_alg(num_vertices, seed);
+  for (size_t i = 0; i < 4 * num_vertices; i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) cc_alg.update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+  cc_alg.connected_components();
+
+  for (auto _ : state) {
+    state.PauseTiming();
+    std::vector<Edge> forest = cc_alg.calc_spanning_forest().get_edges();
+    std::shuffle(forest.begin(), forest.end(), gen);
+    forest.resize(std::min(forest.size(), size_t(state.range(0))));
+    for (Edge edge : forest) cc_alg.update({edge, DELETE});
+    state.ResumeTiming();
+
+    cc_alg.connected_components();
+
+    state.PauseTiming();
+    for (Edge edge : forest) cc_alg.update({edge, INSERT});
+    state.ResumeTiming();
+  }
+  state.counters["Query_Rounds"] = cc_alg.last_query_rounds;
+}
+BENCHMARK(BM_CC_Repeated_Query)
+    ->RangeMultiplier(4)
+    ->Range(1 << 13, 1 << 15)
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark building the algorithm for a sparse vertex id space, where only 1 in 64 ids is used,
+// and computing its connected components. The argument is the size of the id space
+static void BM_CC_Sparse_Vertex_Ids(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  std::mt19937_64 gen(seed);
+  std::vector<GraphUpdate> updates;
+  for (node_id_t src = 0; src < num_vertices; src += 64) {
+    for (size_t d = 0; d < 4; d++) {
+      node_id_t dst = gen() % num_vertices / 64 * 64;
+      if (dst != src) updates.push_back({{src, dst}, INSERT});
+    }
+  }
+
+  for (auto _ : state) {
+    CCSketchAlg cc_alg(num_vertices, seed);
+    for (auto &upd : updates) cc_alg.update(upd);
+    benchmark::DoNotOptimize(cc_alg.connected_components());
+  }
+}
+BENCHMARK(BM_CC_Sparse_Vertex_Ids)
+    ->RangeMultiplier(16)
+    ->Range(1 << 12, 1 << 16)
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark ingesting a 65536 vertex graph of average degree 8 into a shared store with the given
+// number of processes, each of which attaches to the store and applies the update batches of a
+// share of the vertices. Reports the updates ingested per second, including the time to fork and
+// attach the processes
+static void BM_CC_Shared_Store(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  const std::string store_name = "/gz_bench_store_" + std::to_string(getpid());
+  size_t num_procs = state.range(0);
+  std::mt19937_64 gen(seed);
+  std::vector<std::vector<node_id_t>> batches(num_vertices);
+  size_t num_updates = 0;
+  for (size_t i = 0; i < 4 * size_t(num_vertices); i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src == dst) continue;
+    batches[src].push_back(dst);
+    batches[dst].push_back(src);
+    num_updates += 2;
+  }
+
+  std::unique_ptr<CCSketchAlg> store(CCSketchAlg::create_shared_store(store_name, num_vertices,
+                                                                      seed));
+  for (auto _ : state) {
+    std::vector<pid_t> children;
+    for (size_t p = 0; p < num_procs; p++) {
+      pid_t pid = fork();
+      if (pid != 0) {
+        children.push_back(pid);
+        continue;
+      }
+      std::unique_ptr<CCSketchAlg> ingest(CCSketchAlg::attach_shared_store(store_name));
+      ingest->allocate_worker_memory(1);
+      for (node_id_t src = p; src < num_vertices; src += num_procs)
+        ingest->apply_update_batch(0, src, batches[src]);
+      _exit(0);
+    }
+    for (pid_t pid : children) waitpid(pid, nullptr, 0);
+  }
+  CCSketchAlg::remove_shared_store(store_name);
+  state.counters["Ingestion_Rate"] =
+      benchmark::Counter(state.iterations() * num_updates, benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Shared_Store)
+    ->RangeMultiplier(2)
+    ->Range(1, 4)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark restarting from the saved state of a 65536 vertex graph of average degree 8, where
+// every vertex has a sketch. The argument is how the state was saved: 0 = write_binary with FULL
+// sketches, 1 = write_binary with SPARSE sketches, 2 = write_snapshot. Reports the time to load
+// the state and then the time of the first connected components query, which touches every
+// sketch
+static void BM_CC_Warm_Start(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  const std::string file = "./warm_start.bin";
+  int mode = state.range(0);
+  {
+    CCSketchAlg cc_alg(num_vertices, seed, CCAlgConfiguration().sparse_sketch_factor(0));
+    std::mt19937_64 gen(seed);
+    for (size_t i = 0; i < 4 * size_t(num_vertices); i++) {
+      node_id_t src = gen() % num_vertices;
+      node_id_t dst = gen() % num_vertices;
+      if (src != dst) cc_alg.update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+    }
+    if (mode == 2) cc_alg.write_snapshot(file);
+    else cc_alg.write_binary(file, mode == 1 ? SPARSE : FULL);
+  }
+
+  double load_ms = 0;
+  double query_ms = 0;
+  for (auto _ : state) {
+    auto start = std::chrono::steady_clock::now();
+    CCSketchAlg *cc_alg = mode == 2 ? CCSketchAlg::construct_from_snapshot(file)
+                                    : CCSketchAlg::construct_from_serialized_data(file);
+    auto loaded = std::chrono::steady_clock::now();
+    benchmark::DoNotOptimize(cc_alg->connected_components());
+    auto queried = std::chrono::steady_clock::now();
+    delete cc_alg;
+    load_ms += std::chrono::duration<double, std::milli>(loaded - start).count();
+    query_ms += std::chrono::duration<double, std::milli>(queried - loaded).count();
+  }
+  state.counters["Load_ms"] = load_ms / state.iterations();
+  state.counters["Query_ms"] = query_ms / state.iterations();
+  unlink(file.c_str());
+}
+BENCHMARK(BM_CC_Warm_Start)->DenseRange(0, 2)->Iterations(3)->Unit(benchmark::kMillisecond);
+
+// Benchmark checkpointing the state of a 65536 vertex graph of average degree 8, where every
+// vertex has a sketch, with write_binary and reading the checkpoint back. The first argument is
+// the number of threads and the second whether to use direct IO. Reports the bytes written and
+// read per second
+static void BM_CC_Checkpoint(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  const std::string file = "./checkpoint.bin";
+  auto config = CCAlgConfiguration().sparse_sketch_factor(0).direct_io(state.range(1));
+  CCSketchAlg cc_alg(num_vertices, seed, config);
+  std::mt19937_64 gen(seed);
+  for (size_t i = 0; i < 4 * size_t(num_vertices); i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) cc_alg.update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+
+  int max_threads = omp_get_max_threads();
+  omp_set_num_threads(state.range(0));
+  double read_s = 0;
+  for (auto _ : state) {
+    cc_alg.write_binary(file);
+    state.PauseTiming();
+    auto start = std::chrono::steady_clock::now();
+    delete CCSketchAlg::construct_from_serialized_data(file, config);
+    read_s += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    state.ResumeTiming();
+  }
+  omp_set_num_threads(max_threads);
+
+  std::ifstream checkpoint(file, std::ios::binary | std::ios::ate);
+  double file_bytes = checkpoint.tellg();
+  state.counters["Write_Rate"] =
+      benchmark::Counter(state.iterations() * file_bytes, benchmark::Counter::kIsRate,
+                         benchmark::Counter::kIs1024);
+  state.counters["Read_Rate"] =
+      benchmark::Counter(state.iterations() * file_bytes / read_s,
+                         benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+  unlink(file.c_str());
+}
+BENCHMARK(BM_CC_Checkpoint)
+    ->ArgsProduct({{1, 2, 4, 8}, {0, 1}})
+    ->Iterations(3)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark writing a delta checkpoint of the same graph as BM_CC_Checkpoint against a FULL
+// checkpoint of it, after updating the given percentage of its vertices. Reports the bytes of the
+// delta and of the FULL checkpoint
+static void BM_CC_Delta_Checkpoint(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  const std::string base_file = "./checkpoint.bin";
+  const std::string delta_file = "./checkpoint.delta";
+  CCSketchAlg cc_alg(num_vertices, seed, CCAlgConfiguration().sparse_sketch_factor(0));
+  std::mt19937_64 gen(seed);
+  for (size_t i = 0; i < 4 * size_t(num_vertices); i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src != dst) cc_alg.update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+  cc_alg.write_binary(base_file);
+
+  node_id_t num_dirty = num_vertices * state.range(0) / 100;
+  for (auto _ : state) {
+    state.PauseTiming();
+    for (node_id_t v = 0; v + 1 < num_dirty; v += 2) cc_alg.update({{v, v + 1}, INSERT});
+    state.ResumeTiming();
+    cc_alg.write_delta(delta_file);
+  }
+
+  std::ifstream base(base_file, std::ios::binary | std::ios::ate);
+  std::ifstream delta(delta_file, std::ios::binary | std::ios::ate);
+  state.counters["Delta_Bytes"] =
+      benchmark::Counter(delta.tellg(), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+  state.counters["Full_Bytes"] =
+      benchmark::Counter(base.tellg(), benchmark::Counter::kDefaults, benchmark::Counter::kIs1024);
+  unlink(base_file.c_str());
+  unlink(delta_file.c_str());
+}
+BENCHMARK(BM_CC_Delta_Checkpoint)
+    ->Arg(1)
+    ->Arg(10)
+    ->Arg(100)
+    ->Iterations(3)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark merging two algorithms of the same 65536 vertex graph as BM_CC_Checkpoint, each of
+// which ingested half of its edges, with the given number of threads. Reports the bytes of
+// sketches merged per second
+static void BM_CC_Merge(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  auto config = CCAlgConfiguration().sparse_sketch_factor(0);
+  CCSketchAlg cc_alg(num_vertices, seed, config);
+  CCSketchAlg shard(num_vertices, seed, config);
+  std::mt19937_64 gen(seed);
+  for (size_t i = 0; i < 4 * size_t(num_vertices); i++) {
+    node_id_t src = gen() % num_vertices;
+    node_id_t dst = gen() % num_vertices;
+    if (src == dst) continue;
+    (i % 2 ? shard : cc_alg).update({{std::min(src, dst), std::max(src, dst)}, INSERT});
+  }
+
+  int max_threads = omp_get_max_threads();
+  omp_set_num_threads(state.range(0));
+  for (auto _ : state) {
+    cc_alg.merge(shard);
+  }
+  omp_set_num_threads(max_threads);
+
+  double sketch_bytes = Sketch(Sketch::calc_vector_length(num_vertices), seed,
+                               Sketch::calc_cc_samples(num_vertices, 1))
+                            .bucket_array_bytes();
+  state.counters["Merge_Rate"] =
+      benchmark::Counter(state.iterations() * num_vertices * sketch_bytes,
+                         benchmark::Counter::kIsRate, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_CC_Merge)
+    ->RangeMultiplier(2)
+    ->Range(1, 8)
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
 // Benchmark the speed of querying sketches
 static void BM_Sketch_Query(benchmark::State& state) {
   constexpr size_t vec_size = KB << 5;
@@ -267,6 +955,199 @@ static void BM_Sketch_Merge(benchmark::State& state) {
 }
 BENCHMARK(BM_Sketch_Merge)->RangeMultiplier(10)->Range(1e3, 1e6);
 
+// Benchmark merging sketches sized for connected components on a graph with the given number of
+// vertices. Compile with and without SOA_BUCKETS to compare the bucket layouts.
+static void BM_Sketch_CC_Merge(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+  Sketch s1(Sketch::calc_vector_length(num_vertices), seed, num_samples);
+  Sketch s2(Sketch::calc_vector_length(num_vertices), seed, num_samples);
+
+  for (node_id_t i = 0; i < num_vertices; i++) {
+    s1.update(static_cast<vec_t>(concat_pairing_fn(i, (i + 1) % num_vertices)));
+    s2.update(static_cast<vec_t>(concat_pairing_fn(i, (i + 2) % num_vertices)));
+  }
+
+  for (auto _ : state) {
+    s1.merge(s2);
+    benchmark::ClobberMemory();
+  }
+  state.counters["Merge_Bandwidth"] = benchmark::Counter(
+      state.iterations() * s1.bucket_array_bytes(), benchmark::Counter::kIsRate,
+      benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_Sketch_CC_Merge)->RangeMultiplier(16)->Range(1 << 10, 1 << 18);
+
+// Benchmark many threads merging delta sketches into the sketch of one hot vertex, as happens
+// when a high degree vertex receives many update batches at once. The argument selects how the
+// merges are synchronized: 0 = a shared mutex, 1 = atomic_merge (requires SOA_BUCKETS)
+static void BM_Sketch_Contended_Merge(benchmark::State& state) {
+  static std::unique_ptr<Sketch> hot_sketch;
+  static std::mutex hot_mtx;
+  constexpr node_id_t num_vertices = 1 << 16;
+  vec_t vec_len = Sketch::calc_vector_length(num_vertices);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+  if (state.thread_index() == 0) hot_sketch.reset(new Sketch(vec_len, seed, num_samples));
+
+  Sketch delta(vec_len, seed, num_samples);
+  for (node_id_t i = 0; i < 64; i++)
+    delta.update(concat_pairing_fn(state.thread_index(), i + state.thread_index() + 1));
+
+  for (auto _ : state) {
+#ifdef SOA_BUCKETS
+    if (state.range(0) == 1) {
+      hot_sketch->atomic_merge(delta);
+      continue;
+    }
+#else
+    if (state.range(0) == 1) {
+      state.SkipWithError("atomic merging requires SOA_BUCKETS");
+      break;
+    }
+#endif
+    std::lock_guard<std::mutex> lk(hot_mtx);
+    hot_sketch->merge(delta);
+  }
+  state.counters["Merge_Rate"] = benchmark::Counter(state.iterations(),
+                                                    benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Sketch_Contended_Merge)->DenseRange(0, 1)->ThreadRange(1, 8)->UseRealTime();
+
+// Benchmark constructing the sketches of every vertex of a graph.
+// The arguments are the number of vertices and where the sketches live:
+// 0 = one heap allocated Sketch per vertex, 1 = SketchArena with regular pages,
+// 2 = SketchArena with transparent huge pages, 3 = SketchArena with MAP_HUGETLB
+static void BM_Sketch_Arena_Construct(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  size_t mode = state.range(1);
+  vec_t vec_len = Sketch::calc_vector_length(num_vertices);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+
+  for (auto _ : state) {
+    if (mode == 0) {
+      std::vector<Sketch *> sketches(num_vertices);
+      for (node_id_t i = 0; i < num_vertices; i++)
+        sketches[i] = new Sketch(vec_len, seed, num_samples);
+      for (node_id_t i = 0; i < num_vertices; i++) delete sketches[i];
+    } else {
+      SketchArena arena(num_vertices, vec_len, seed, num_samples,
+                        Sketch::default_cols_per_sample, HugePageMode(mode - 1));
+      benchmark::DoNotOptimize(arena[num_vertices - 1]);
+    }
+  }
+}
+BENCHMARK(BM_Sketch_Arena_Construct)
+    ->ArgsProduct({{1 << 12, 1 << 16}, {0, 1, 2, 3}})
+    ->Unit(benchmark::kMillisecond);
+
+// Benchmark range merging the sketches of randomly chosen vertices into a local sketch, the
+// access pattern of a Boruvka round. Arguments are the same as BM_Sketch_Arena_Construct.
+static void BM_Sketch_Arena_Random_Merge(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  size_t mode = state.range(1);
+  vec_t vec_len = Sketch::calc_vector_length(num_vertices);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+
+  std::vector<Sketch *> heap_sketches;
+  std::unique_ptr<SketchArena> arena;
+  if (mode == 0) {
+    for (node_id_t i = 0; i < num_vertices; i++)
+      heap_sketches.push_back(new Sketch(vec_len, seed, num_samples));
+  } else {
+    arena.reset(new SketchArena(num_vertices, vec_len, seed, num_samples,
+                                Sketch::default_cols_per_sample, HugePageMode(mode - 1)));
+  }
+  auto vertex_sketch = [&](node_id_t v) -> Sketch & {
+    return mode == 0 ? *heap_sketches[v] : (*arena)[v];
+  };
+  for (node_id_t i = 0; i < num_vertices; i++) {
+    vertex_sketch(i).update(concat_pairing_fn(i, (i + 1) % num_vertices));
+  }
+
+  Sketch local_sketch(vec_len, seed, num_samples);
+  std::mt19937 gen(seed);
+  size_t round = 0;
+  for (auto _ : state) {
+    local_sketch.range_merge(vertex_sketch(gen() % num_vertices), round, 1);
+    round = (round + 1) % num_samples;
+    local_sketch.reset_sample_state();
+  }
+  state.counters["Merge_Rate"] = benchmark::Counter(state.iterations(),
+                                                    benchmark::Counter::kIsRate);
+  for (auto sketch : heap_sketches) delete sketch;
+}
+BENCHMARK(BM_Sketch_Arena_Random_Merge)->ArgsProduct({{1 << 12, 1 << 16}, {0, 1, 2, 3}});
+
+// Benchmark a whole Boruvka round: range merge one sample of every vertex sketch, in vertex
+// order, into a local sketch. Each iteration uses the next sample, as the next round would.
+// Compile with and without ROUND_MAJOR_BUCKETS to compare the arena layouts.
+static void BM_Sketch_Arena_Round_Merge(benchmark::State& state) {
+  node_id_t num_vertices = state.range(0);
+  vec_t vec_len = Sketch::calc_vector_length(num_vertices);
+  size_t num_samples = Sketch::calc_cc_samples(num_vertices, 1);
+
+  SketchArena arena(num_vertices, vec_len, seed, num_samples);
+  for (node_id_t i = 0; i < num_vertices; i++) {
+    arena[i].update(concat_pairing_fn(i, (i + 1) % num_vertices));
+  }
+
+  Sketch local_sketch(vec_len, seed, num_samples);
+  size_t round = 0;
+  for (auto _ : state) {
+    for (node_id_t i = 0; i < num_vertices; i++) local_sketch.range_merge(arena[i], round, 1);
+    round = (round + 1) % num_samples;
+    local_sketch.reset_sample_state();
+  }
+  state.counters["Merge_Rate"] = benchmark::Counter(state.iterations() * num_vertices,
+                                                    benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_Sketch_Arena_Round_Merge)->RangeMultiplier(16)->Range(1 << 12, 1 << 16);
+
+// Benchmark the bucket memory kernels used by Sketch::merge, range_merge, merge_raw_bucket_buffer,
+// and zero_contents. The arguments are the kernel and the number of bytes.
+// 0 = scalar, 1 = AVX2, 2 = AVX-512
+static void BM_Merge_Kernel(benchmark::State& state) {
+  auto kernel = (Bucket_Boruvka::MergeKernel) state.range(0);
+  size_t bytes = state.range(1);
+  Bucket_Boruvka::MergeKernel initial = Bucket_Boruvka::get_merge_kernel();
+  if (!Bucket_Boruvka::set_merge_kernel(kernel)) {
+    state.SkipWithError("merge kernel not supported on this CPU");
+    return;
+  }
+
+  std::vector<char> dst(bytes, 1);
+  std::vector<char> src(bytes, 3);
+  for (auto _ : state) {
+    Bucket_Boruvka::xor_bucket_memory(dst.data(), src.data(), bytes);
+    benchmark::ClobberMemory();
+  }
+  Bucket_Boruvka::set_merge_kernel(initial);
+  state.counters["Merge_Bandwidth"] = benchmark::Counter(
+      state.iterations() * bytes, benchmark::Counter::kIsRate, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_Merge_Kernel)->ArgsProduct({{0, 1, 2}, {1 << 10, 12 << 10, 1 << 20, 64 << 20}});
+
+// Zeroing at or above Bucket_Boruvka::nontemporal_zero_bytes uses non-temporal stores
+static void BM_Zero_Kernel(benchmark::State& state) {
+  auto kernel = (Bucket_Boruvka::MergeKernel) state.range(0);
+  size_t bytes = state.range(1);
+  Bucket_Boruvka::MergeKernel initial = Bucket_Boruvka::get_merge_kernel();
+  if (!Bucket_Boruvka::set_merge_kernel(kernel)) {
+    state.SkipWithError("merge kernel not supported on this CPU");
+    return;
+  }
+
+  std::vector<char> dst(bytes, 1);
+  for (auto _ : state) {
+    Bucket_Boruvka::zero_bucket_memory(dst.data(), bytes);
+    benchmark::ClobberMemory();
+  }
+  Bucket_Boruvka::set_merge_kernel(initial);
+  state.counters["Zero_Bandwidth"] = benchmark::Counter(
+      state.iterations() * bytes, benchmark::Counter::kIsRate, benchmark::Counter::kIs1024);
+}
+BENCHMARK(BM_Zero_Kernel)->ArgsProduct({{0, 1, 2}, {12 << 10, 1 << 20, 16 << 20, 256 << 20}});
+
 static void BM_Sketch_Serialize(benchmark::State& state) {
   size_t n = state.range(0);
   size_t upds = n / 100;
@@ -280,24 +1161,49 @@ static void BM_Sketch_Serialize(benchmark::State& state) {
     std::stringstream stream;
     s1.serialize(stream);
   }
+  state.counters["Bytes"] = s1.serialized_bytes();
 }
 BENCHMARK(BM_Sketch_Serialize)->RangeMultiplier(10)->Range(1e3, 1e6);
 
-// static void BM_Sketch_Sparse_Serialize(benchmark::State& state) {
-//   size_t n = state.range(0);
-//   size_t upds = n / 100;
-//   Sketch s1(n, seed);
-
-//   for (size_t i = 0; i < upds; i++) {
-//     s1.update(static_cast<vec_t>(concat_pairing_fn(rand() % n, rand() % n)));
-//   }
-
-//   for (auto _ : state) {
-//     std::stringstream stream;
-//     s1.serialize(stream, SPARSE);
-//   }
-// }
-// BENCHMARK(BM_Sketch_Sparse_Serialize)->RangeMultiplier(10)->Range(1e3, 1e6);
+static void BM_Sketch_Sparse_Serialize(benchmark::State& state) {
+  size_t n = state.range(0);
+  size_t upds = n / 100;
+  Sketch s1(n, seed);
+
+  for (size_t i = 0; i < upds; i++) {
+    s1.update(static_cast<vec_t>(concat_pairing_fn(rand() % n, rand() % n)));
+  }
+
+  for (auto _ : state) {
+    std::stringstream stream;
+    s1.serialize(stream, SPARSE);
+  }
+  state.counters["Bytes"] = s1.sparse_serialized_bytes();
+}
+BENCHMARK(BM_Sketch_Sparse_Serialize)->RangeMultiplier(10)->Range(1e3, 1e6);
+
+// Benchmark serializing the sketch of a vertex of the given degree in a 65536 vertex graph, as
+// CCSketchAlg::write_binary does. The second argument is the SerialType: 0 = FULL, 2 = SPARSE
+static void BM_CC_Sketch_Serialize(benchmark::State& state) {
+  constexpr node_id_t num_vertices = 1 << 16;
+  size_t degree = state.range(0);
+  auto type = (SerialType) state.range(1);
+  Sketch skt(Sketch::calc_vector_length(num_vertices), seed,
+             Sketch::calc_cc_samples(num_vertices, 1));
+  std::mt19937_64 gen(seed);
+  for (size_t i = 0; i < degree; i++)
+    skt.update(static_cast<vec_t>(concat_pairing_fn(0, gen() % num_vertices)));
+
+  std::stringstream stream;
+  for (auto _ : state) {
+    stream.seekp(0);
+    skt.serialize(stream, type);
+  }
+  size_t bytes = type == SPARSE ? skt.sparse_serialized_bytes() : skt.serialized_bytes();
+  state.counters["Bytes"] = bytes;
+  state.counters["Sketches"] = benchmark::Counter(state.iterations(), benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_CC_Sketch_Serialize)->ArgsProduct({{1, 16, 256}, {FULL, SPARSE}});
 
 // Benchmark DSU Find Root
 static void BM_DSU_Find(benchmark::State& state) {
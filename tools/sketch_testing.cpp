@@ -2,6 +2,7 @@
 #include <random>
 #include <set>
 #include <cassert>
+#include <string>
 
 #include "sketch.h"
 #include "cc_alg_configuration.h"
@@ -26,6 +27,12 @@
   For parity with the main code, column seeds are sequential.
 
   The output of this is intended to be parsed into summary stats by sum_sketch_testing.py
+
+  Run with --narrow to test sketches that store 32 bit indices. The indices tested are below
+  2^32, so the success probabilities should match those of the default 64 bit indices.
+
+  Run with --sliced to test sketches that take the depths of their columns from slices of a
+  shared hash. The success probabilities should match those of a hash per column.
 */
 
 
@@ -43,6 +50,9 @@ rand_type gen(rand_type n)
 
 rand_type seed = gen(1ll << 62);
 
+IndexWidth index_width = WIDE_INDEX;
+DepthHashing depth_hashing = COLUMN_DEPTHS;
+
 rand_type gen_seed()
 {
     //std::uniform_int_distribution<rand_type> dist(0,1ll << 63);
@@ -61,7 +71,7 @@ ResultType test_z(rand_type n, rand_type z)
 {
     assert(z >= 1);
     assert(z <= n*n);
-    Sketch sketch(n, gen_seed(), 1, 1);
+    Sketch sketch(n, gen_seed(), 1, 1, default_sketch_algorithm, index_width, depth_hashing);
 
     // Generate z edges and track them
     /*std::unordered_set<rand_type> edges;
@@ -116,7 +126,7 @@ std::pair<double, double> test_nz_pair(rand_type n, rand_type z)
 
 void test_n_one(rand_type n, rand_type* good, rand_type max_z)
 {
-  Sketch sketch(n*n, gen_seed(), 1, 1);
+  Sketch sketch(n*n, gen_seed(), 1, 1, default_sketch_algorithm, index_width, depth_hashing);
   for (rand_type i = 0; i < max_z; i++)
   {
     sketch.update(i);
@@ -162,9 +172,16 @@ void test_n(rand_type n)
   delete[] good;  
 }
 
-int main()
+int main(int argc, char **argv)
 {
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--narrow") index_width = NARROW_INDEX;
+    if (std::string(argv[i]) == "--sliced") depth_hashing = SLICED_DEPTHS;
+  }
   std::cout << CCAlgConfiguration() << std::endl;
+  std::cout << "INDEX WIDTH: " << (index_width == NARROW_INDEX ? 32 : 64) << " bits" << std::endl;
+  std::cout << "COLUMN DEPTHS: " << (depth_hashing == SLICED_DEPTHS ? "Sliced" : "Per column")
+            << std::endl;
   rand_type n = 1 << 13;
   std::cout << "TESTING: " << n << " TO " << (n*n)/4 << std::endl;
   test_n(n);